@@ -0,0 +1,244 @@
+#include "board.h"
+#include "hal.h"
+#include "i2c_async.h"
+#include "accel.h"
+#include "prof.h"
+
+PROF_HIST(prof_read_data, "accel read");
+PROF_HIST(prof_irq_read, "accel irq");
+
+// Probed in this order
+static const accel_driver_t *const drivers[] = {
+    &accel_mma8451q,
+    &accel_lis2dw12,
+};
+
+static const accel_driver_t *selected;
+
+// Ring filled from the INT1 interrupt, NULL until it is enabled
+static sample_ring_t *int1_ring;
+static hal_gpio_irq_handler_t int1_handler;
+static uint32_t fifo_overflows;
+static uint8_t fifo_watermark;
+// Sample clock, restarted whenever INT1 is routed
+static timebase_t timebase;
+
+// Read started from the INT1 interrupt and finished from the I2C interrupt.
+// INT1 stays asserted until the data is read, so there is at most one.
+static struct {
+    i2c_xfer_t xfer;
+    uint8_t reg;
+    uint8_t fifo_status;
+    uint8_t raw_data[ACCEL_FIFO_MAX * 6];
+    int count;
+    uint64_t newest_us;
+    uint32_t start_cycles;
+    uint64_t edge_us;
+    bool edge;              // entered from an INT1 edge at edge_us
+    bool rerun;             // entered again with INT1 still asserted, no edge
+    volatile bool busy;
+} irq_read;
+
+bool accel_probe(void) {
+    for (size_t i = 0; i < count_of(drivers); i++) {
+        if (drivers[i]->probe()) {
+            selected = drivers[i];
+            return true;
+        }
+    }
+    return false;
+}
+
+const accel_driver_t *accel_driver(void) {
+    return selected;
+}
+
+bool accel_init(const accel_config_t *config) {
+    return selected && selected->init(config);
+}
+
+uint32_t accel_odr_period_us(void) {
+    return selected ? selected->odr_period_us() : 0;
+}
+
+bool accel_read_data(int16_t *x, int16_t *y, int16_t *z) {
+    if (!selected)
+        return false;
+    PROF_BEGIN(prof_read_data);
+    bool ok = selected->read_data(x, y, z);
+    PROF_END(prof_read_data);
+    return ok;
+}
+
+// Push count samples from a burst read, the last one completed at newest_us
+static void accel_push_samples(const uint8_t *raw_data, int count, uint64_t newest_us) {
+    static accel_sample_t samples[ACCEL_FIFO_MAX];
+
+    selected->unpack_q12(raw_data, count, samples);
+    timebase_stamp(&timebase, samples, count, newest_us);
+    for (int i = 0; i < count; i++)
+        sample_ring_push(int1_ring, &samples[i]);
+}
+
+static void accel_submit_irq_read(uint8_t reg_address, uint8_t *buffer, size_t len, i2c_xfer_callback_t callback) {
+    irq_read.reg = reg_address;
+    irq_read.xfer.addr = selected->address;
+    irq_read.xfer.tx = &irq_read.reg;
+    irq_read.xfer.tx_len = 1;
+    irq_read.xfer.rx = buffer;
+    irq_read.xfer.rx_len = len;
+    irq_read.xfer.callback = callback;
+    irq_read.xfer.priority = I2C_PRIORITY_SENSOR;
+    i2c_async_submit(&irq_read.xfer);
+}
+
+// Interrupt edge to samples in the ring, including time queued behind other transfers
+static void accel_samples_read(i2c_xfer_t *xfer) {
+    if (xfer->result != PICO_ERROR_GENERIC) {
+        accel_push_samples(irq_read.raw_data, irq_read.count, irq_read.newest_us);
+        PROF_RECORD(prof_irq_read, hal_cycles() - irq_read.start_cycles);
+    } else {
+        // a failed burst may still have popped some of the FIFO
+        timebase_restart(&timebase);
+    }
+    irq_read.busy = false;
+    // data that came in while the read was queued leaves INT1 asserted
+    // without another edge, so go again rather than wait for the main loop
+    if (xfer->result != PICO_ERROR_GENERIC && !hal_gpio_get(ACCEL_INT1_PIN)) {
+        irq_read.rerun = true;
+        int1_handler(ACCEL_INT1_PIN);
+    }
+}
+
+// Queue a burst read of one sample, with its edge fed to the timebase. It
+// has to finish before the next sample replaces it, and the bus is kept
+// clear for that one, give or take an eighth of a period of clock error.
+static void accel_data_ready_irq(unsigned int gpio) {
+    (void)gpio;
+    uint64_t now_us = hal_time_us();
+    bool edge = !irq_read.rerun;
+    irq_read.rerun = false;
+    if (irq_read.busy)
+        return;
+    uint32_t period_us = selected->odr_period_us();
+    irq_read.busy = true;
+    irq_read.start_cycles = hal_cycles();
+    irq_read.newest_us = now_us;
+    irq_read.count = 1;
+    timebase_observe_newest(&timebase, now_us, edge);
+    irq_read.xfer.deadline_us = irq_read.newest_us + period_us;
+    i2c_async_reserve(irq_read.newest_us + period_us - period_us / 8, period_us / 2);
+    accel_submit_irq_read(selected->sample_reg, irq_read.raw_data, 6, accel_samples_read);
+}
+
+// Drain everything in the FIFO with one burst read, each 6 byte pass over
+// the output registers pops one sample
+static void accel_fifo_status_read(i2c_xfer_t *xfer) {
+    if (xfer->result == PICO_ERROR_GENERIC) {
+        irq_read.busy = false;
+        return;
+    }
+    // the newest sample in the FIFO completed roughly now, which stamps the
+    // batch until the timebase has seen an edge
+    irq_read.newest_us = hal_time_us();
+
+    // the watermark edge came with sample fifo_watermark of this batch,
+    // unless an overflow threw away some of the ones before it
+    if (irq_read.fifo_status & selected->fifo_overflow) {
+        fifo_overflows++;
+        timebase_restart(&timebase);
+    } else if (irq_read.edge) {
+        timebase_observe(&timebase, fifo_watermark - 1, irq_read.edge_us);
+    }
+
+    irq_read.count = irq_read.fifo_status & selected->fifo_count_mask;
+    if (irq_read.count > selected->fifo_size)
+        irq_read.count = selected->fifo_size;
+    if (irq_read.count == 0) {
+        irq_read.busy = false;
+        return;
+    }
+    accel_submit_irq_read(selected->sample_reg, irq_read.raw_data, irq_read.count * 6, accel_samples_read);
+}
+
+// The FIFO absorbs a late drain until it is full, so only the deadline is
+// set and nothing is reserved
+static void accel_fifo_irq(unsigned int gpio) {
+    (void)gpio;
+    uint64_t now_us = hal_time_us();
+    bool edge = !irq_read.rerun;
+    irq_read.rerun = false;
+    if (irq_read.busy)
+        return;
+    irq_read.busy = true;
+    irq_read.start_cycles = hal_cycles();
+    irq_read.edge = edge;
+    irq_read.edge_us = now_us;
+    irq_read.xfer.deadline_us = now_us + (uint64_t)(selected->fifo_size - fifo_watermark) * selected->odr_period_us();
+    accel_submit_irq_read(selected->fifo_status_reg, &irq_read.fifo_status, 1, accel_fifo_status_read);
+}
+
+// Route one source to INT1 and hand it to the given handler
+static bool accel_route_int1(accel_int1_source_t source, uint8_t watermark, hal_gpio_irq_handler_t handler,
+                             sample_ring_t *ring) {
+    if (!selected || !selected->route_int1(source, watermark)) return false;
+
+    fifo_watermark = watermark;
+    timebase_init(&timebase, selected->odr_period_us());
+    int1_ring = ring;
+    int1_handler = handler;
+    hal_gpio_set_irq(ACCEL_INT1_PIN, handler);
+    return true;
+}
+
+/**
+ * @brief Routes the data-ready interrupt to INT1 and reads every sample into a ring.
+ * @param ring Ring the interrupt handler pushes samples to.
+ * @return true if the sensor was reconfigured.
+ */
+bool accel_enable_data_ready_irq(sample_ring_t *ring) {
+    return accel_route_int1(ACCEL_INT1_DATA_READY, 0, accel_data_ready_irq, ring);
+}
+
+/**
+ * @brief Buffers samples in the sensor FIFO and drains it in batches from INT1.
+ * @param watermark FIFO fill level that raises the interrupt, within the
+ *        part's FIFO.
+ * @param ring Ring the interrupt handler pushes samples to.
+ * @return true if the sensor was reconfigured.
+ */
+bool accel_enable_fifo_irq(uint8_t watermark, sample_ring_t *ring) {
+    if (!selected || watermark == 0 || watermark > selected->fifo_size) return false;
+    return accel_route_int1(ACCEL_INT1_FIFO, watermark, accel_fifo_irq, ring);
+}
+
+// INT1 stays asserted until the sensor is serviced. If a read failed there
+// is no new edge to trigger the interrupt again, so pick it up from the main
+// loop. Also lets go of the bus if data-ready edges have stopped while it
+// was reserved for the next one.
+void accel_service_irq(void) {
+    if (!selected)
+        return;
+    i2c_async_poll();
+    uint32_t irq_state = hal_enter_critical();
+    if (int1_handler && !irq_read.busy && !hal_gpio_get(ACCEL_INT1_PIN)) {
+        irq_read.rerun = true;
+        int1_handler(ACCEL_INT1_PIN);
+    }
+    hal_exit_critical(irq_state);
+    if (selected->service_irq)
+        selected->service_irq();
+}
+
+// Number of times the FIFO overflowed and dropped its oldest samples
+uint32_t accel_fifo_overflows(void) {
+    return fifo_overflows;
+}
+
+bool accel_set_offsets(int16_t bias[3]) {
+    return selected && selected->set_offsets(bias);
+}
+
+timebase_t *accel_timebase(void) {
+    return &timebase;
+}
@@ -0,0 +1,120 @@
+#ifndef ACCEL_H
+#define ACCEL_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "sample_ring.h"
+#include "timebase.h"
+
+/* Accelerometer behind a common interface.
+
+   Each supported part implements accel_driver_t, and accel_probe() picks
+   the first one that answers on the bus, so a board revision can fit
+   either part without changes to the acquisition pipeline. Every backend
+   delivers samples the same way: Q12 g, timestamped, pushed into a
+   sample_ring_t from INT1, either one per data-ready edge or in batches
+   from the sensor FIFO. Sample times come from a timebase_t fitted to the
+   interrupt edges, so they sit on the part's real output data rate rather
+   than the time each read happened to finish.
+
+   Each part also takes out a zero-g bias in its own offset registers, so
+   the samples come out already corrected, see accel_cal.h.
+
+   Part specific extras, such as the MMA8451Q motion events, stay in the
+   part's own header.
+*/
+
+// Acceleration is kept in Q12 fixed point, ACCEL_Q12_ONE_G = 1 g at every
+// range, and the 8 g range still fits an int16
+#define ACCEL_Q12_ONE_G     4096
+
+// Requested output data rate and full scale range. A backend runs at the
+// slowest rate it has at or above ACCEL_ODR_HZ.
+#ifndef ACCEL_ODR_HZ
+#define ACCEL_ODR_HZ 100
+#endif
+
+#ifndef ACCEL_RANGE_G
+#define ACCEL_RANGE_G 2
+#endif
+
+typedef struct {
+    uint16_t odr_hz;
+    uint8_t range_g;        // 2, 4 or 8
+    int16_t bias[3];        // Q12 g, subtracted by the sensor
+} accel_config_t;
+
+// Interrupt sources a backend routes to INT1
+typedef enum {
+    ACCEL_INT1_DATA_READY,
+    ACCEL_INT1_FIFO,        // FIFO watermark
+} accel_int1_source_t;
+
+// Largest FIFO of any backend, in samples
+#define ACCEL_FIFO_MAX 32
+
+/* A backend supplies its registers and configuration. The interrupt reads,
+   their deadlines and bus reservation and the timebase are shared, in
+   accel.c:
+
+   - data-ready: each INT1 edge reads 6 bytes from sample_reg.
+   - FIFO: each INT1 edge reads fifo_status_reg, then the samples it counts
+     in one burst from sample_reg, 6 bytes per sample. The part must wrap
+     the address back to sample_reg after the last output register while
+     the FIFO is on, so that each pass pops one sample.
+
+   INT1 is a falling edge that stays low until the data is read.
+*/
+typedef struct {
+    const char *name;
+    uint8_t address;            // 7-bit I2C address
+    uint8_t fifo_size;          // samples, at most ACCEL_FIFO_MAX
+    uint8_t sample_reg;         // first output register of X, Y and Z
+    uint8_t fifo_status_reg;
+    uint8_t fifo_count_mask;    // samples in the FIFO, in fifo_status_reg
+    uint8_t fifo_overflow;      // set in fifo_status_reg if samples were lost
+    bool (*probe)(void);    // WHO_AM_I check, quiet
+    // Configure the rate and range and start sampling
+    bool (*init)(const accel_config_t *config);
+    uint32_t (*odr_period_us)(void);
+    // Blocking read of the newest sample, in Q12 g
+    bool (*read_data)(int16_t *x, int16_t *y, int16_t *z);
+    // count bursts of output registers from sample_reg to Q12 g
+    void (*unpack_q12)(const uint8_t *raw_data, size_t count, accel_sample_t *samples);
+    // Route one source to INT1. For the FIFO, also set it up to raise the
+    // watermark at that many samples and to keep the newest on overflow.
+    bool (*route_int1)(accel_int1_source_t source, uint8_t watermark);
+    // Pick up interrupts of the part's own beyond INT1, NULL if none
+    void (*service_irq)(void);
+    // Change the bias while sampling. It is rounded to the offset register
+    // step and clamped to its range, and updated to what was applied.
+    bool (*set_offsets)(int16_t bias[3]);
+} accel_driver_t;
+
+extern const accel_driver_t accel_mma8451q;
+extern const accel_driver_t accel_lis2dw12;
+
+// Probe the supported parts in turn and select the first one found
+bool accel_probe(void);
+// The selected part, NULL before a successful probe
+const accel_driver_t *accel_driver(void);
+
+bool accel_init(const accel_config_t *config);
+uint32_t accel_odr_period_us(void);
+bool accel_read_data(int16_t *x, int16_t *y, int16_t *z);
+bool accel_enable_data_ready_irq(sample_ring_t *ring);
+bool accel_enable_fifo_irq(uint8_t watermark, sample_ring_t *ring);
+void accel_service_irq(void);
+uint32_t accel_fifo_overflows(void);
+bool accel_set_offsets(int16_t bias[3]);
+// Sample clock recovered from INT1, valid once an interrupt is enabled.
+// A backend restarts it when the part restarts its sample clock.
+timebase_t *accel_timebase(void);
+
+// Q12 to milli-g, rounded
+static inline int32_t accel_q12_to_mg(int16_t q12) {
+    return (q12 * 1000 + ACCEL_Q12_ONE_G / 2) >> 12;
+}
+
+#endif
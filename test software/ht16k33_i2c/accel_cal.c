@@ -0,0 +1,178 @@
+#include <stdlib.h>
+#include <string.h>
+#include "board.h"
+#include "hal.h"
+#include "accel.h"
+#include "telemetry.h"
+#include "accel_cal.h"
+
+#define CAL_SECTOR (CAL_FLASH_OFFSET - LOG_FLASH_OFFSET)
+#define CAL_PAGES (CAL_FLASH_SIZE / HAL_FLASH_PAGE_SIZE)
+
+static int16_t bias[3];
+static enum { BIAS_NONE, BIAS_LOADED, BIAS_CALIBRATED } bias_source;
+// Page for the next record, CAL_PAGES once the sector is full
+static unsigned int next_page;
+
+static uint32_t target;         // samples to average, 0 when idle
+static uint32_t seen;
+static int64_t sum[3];
+static int16_t min[3];
+static int16_t max[3];
+
+static uint32_t get32(const uint8_t *p) {
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static void put32(uint8_t *p, uint32_t v) {
+    p[0] = v;
+    p[1] = v >> 8;
+    p[2] = v >> 16;
+    p[3] = v >> 24;
+}
+
+static bool record_valid(const uint8_t *record) {
+    return get32(record) == ACCEL_CAL_MAGIC &&
+           telemetry_crc8(record, ACCEL_CAL_RECORD_SIZE - 1) == record[ACCEL_CAL_RECORD_SIZE - 1];
+}
+
+static bool record_blank(const uint8_t *record) {
+    for (size_t i = 0; i < ACCEL_CAL_RECORD_SIZE; i++) {
+        if (record[i] != 0xFF)
+            return false;
+    }
+    return true;
+}
+
+static bool record_for_part(const uint8_t *record, const char *part) {
+    char name[ACCEL_CAL_PART_LEN + 1];
+
+    memcpy(name, &record[4], ACCEL_CAL_PART_LEN);
+    name[ACCEL_CAL_PART_LEN] = '\0';
+    return !strcmp(name, part);
+}
+
+bool accel_cal_load(int16_t out[3]) {
+    uint8_t record[ACCEL_CAL_RECORD_SIZE];
+    const accel_driver_t *driver = accel_driver();
+
+    memset(bias, 0, sizeof(bias));
+    bias_source = BIAS_NONE;
+    // Records run from page 0 up to the first blank one. Anything else, such
+    // as a torn write, gets the sector erased by the next save.
+    next_page = CAL_PAGES;
+    for (unsigned int page = 0; page < CAL_PAGES; page++) {
+        hal_flash_read(CAL_SECTOR + page * HAL_FLASH_PAGE_SIZE, record, sizeof(record));
+        if (record_blank(record)) {
+            next_page = page;
+            break;
+        }
+        if (!record_valid(record))
+            break;
+        if (driver && record_for_part(record, driver->name)) {
+            for (int axis = 0; axis < 3; axis++)
+                bias[axis] = (int16_t)(record[16 + 2 * axis] | (record[17 + 2 * axis] << 8));
+            bias_source = BIAS_LOADED;
+        }
+    }
+    memcpy(out, bias, sizeof(bias));
+    return bias_source == BIAS_LOADED;
+}
+
+static bool accel_cal_save(void) {
+    uint8_t page[HAL_FLASH_PAGE_SIZE];
+
+    memset(page, 0xFF, sizeof(page));
+    put32(page, ACCEL_CAL_MAGIC);
+    memset(&page[4], 0, ACCEL_CAL_PART_LEN);
+    strncpy((char *)&page[4], accel_driver()->name, ACCEL_CAL_PART_LEN);
+    for (int axis = 0; axis < 3; axis++) {
+        page[16 + 2 * axis] = (uint16_t)bias[axis] & 0xFF;
+        page[17 + 2 * axis] = (uint16_t)bias[axis] >> 8;
+    }
+    page[ACCEL_CAL_RECORD_SIZE - 1] = telemetry_crc8(page, ACCEL_CAL_RECORD_SIZE - 1);
+
+    if (next_page == CAL_PAGES) {
+        if (!hal_flash_erase_sector(CAL_SECTOR))
+            return false;
+        next_page = 0;
+    }
+    if (!hal_flash_program_page(CAL_SECTOR + next_page * HAL_FLASH_PAGE_SIZE, page))
+        return false;
+    next_page++;
+    return true;
+}
+
+void accel_cal_start(uint32_t period_us) {
+    target = (uint32_t)((uint64_t)ACCEL_CAL_MS * 1000 / period_us);
+    if (target == 0)
+        target = 1;
+    seen = 0;
+    for (int axis = 0; axis < 3; axis++) {
+        sum[axis] = 0;
+        min[axis] = INT16_MAX;
+        max[axis] = INT16_MIN;
+    }
+}
+
+bool accel_cal_running(void) {
+    return target != 0;
+}
+
+accel_cal_status_t accel_cal_add(const accel_sample_t *samples, size_t count) {
+    const int32_t max_spread = ACCEL_CAL_MAX_SPREAD_MG * ACCEL_Q12_ONE_G / 1000;
+    int16_t mean[3];
+    int16_t next[3];
+    int vertical = 0;
+
+    if (!target)
+        return ACCEL_CAL_IDLE;
+    for (size_t i = 0; i < count && seen < target; i++, seen++) {
+        const int16_t v[3] = { samples[i].x, samples[i].y, samples[i].z };
+
+        for (int axis = 0; axis < 3; axis++) {
+            sum[axis] += v[axis];
+            if (v[axis] < min[axis])
+                min[axis] = v[axis];
+            if (v[axis] > max[axis])
+                max[axis] = v[axis];
+        }
+    }
+    if (seen < target)
+        return ACCEL_CAL_COLLECTING;
+    target = 0;
+
+    for (int axis = 0; axis < 3; axis++) {
+        if (max[axis] - min[axis] > max_spread)
+            return ACCEL_CAL_MOVED;
+        int64_t half = sum[axis] >= 0 ? (int64_t)seen / 2 : -(int64_t)seen / 2;
+        mean[axis] = (int16_t)((sum[axis] + half) / (int64_t)seen);
+        if (abs(mean[axis]) > abs(mean[vertical]))
+            vertical = axis;
+    }
+    // gravity is all that should be left, on the vertical axis
+    mean[vertical] -= mean[vertical] < 0 ? -ACCEL_Q12_ONE_G : ACCEL_Q12_ONE_G;
+    for (int axis = 0; axis < 3; axis++) {
+        int32_t total = bias[axis] + mean[axis];
+        if (total > ACCEL_Q12_ONE_G / 4 || total < -ACCEL_Q12_ONE_G / 4)
+            return ACCEL_CAL_NOT_LEVEL;
+        next[axis] = (int16_t)total;
+    }
+
+    if (!accel_set_offsets(next))
+        return ACCEL_CAL_FAILED;
+    memcpy(bias, next, sizeof(bias));
+    bias_source = BIAS_CALIBRATED;
+    return accel_cal_save() ? ACCEL_CAL_DONE : ACCEL_CAL_FAILED;
+}
+
+void accel_cal_report(FILE *out) {
+    static const char *const sources[] = {
+        [BIAS_NONE] = "not calibrated",
+        [BIAS_LOADED] = "from flash",
+        [BIAS_CALIBRATED] = "calibrated",
+    };
+
+    fprintf(out, "accel cal: bias X: %ldmg, Y: %ldmg, Z: %ldmg, %s\n", (long)accel_q12_to_mg(bias[0]),
+            (long)accel_q12_to_mg(bias[1]), (long)accel_q12_to_mg(bias[2]), sources[bias_source]);
+}
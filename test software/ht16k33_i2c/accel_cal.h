@@ -0,0 +1,69 @@
+#ifndef ACCEL_CAL_H
+#define ACCEL_CAL_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "sample_ring.h"
+
+/* Zero-g calibration kept in the accelerometer's own offset registers.
+
+   With the board lying still, accel_cal_start() averages the next
+   ACCEL_CAL_MS of samples. The axis nearest vertical should read +-1 g and
+   the other two 0, whatever is left over is bias. It goes to the part with
+   accel_set_offsets(), so the samples leave the sensor already corrected
+   and the correction costs nothing per sample. The samples are averaged
+   with the current offsets applied, so a second run refines the first.
+
+   Each result is saved to the calibration sector of the boot flash (see
+   board.h), and accel_cal_load() hands the newest one for the fitted part
+   to accel_init() at boot. Records take a page each and are written in
+   order, so the sector is erased once every 16 calibrations:
+
+     0..3   ACCEL_CAL_MAGIC
+     4..15  part name, NUL padded
+     16..21 bias x, y, z, Q12 g, little-endian
+     22..30 0xFF
+     31     CRC-8 over bytes 0..30
+*/
+
+#define ACCEL_CAL_MAGIC 0x4C414341u // "ACAL"
+#define ACCEL_CAL_RECORD_SIZE 32
+#define ACCEL_CAL_PART_LEN 12
+
+// Time averaged per calibration. A whole number of seconds also averages
+// out the simulator's 1 Hz tilt.
+#ifndef ACCEL_CAL_MS
+#define ACCEL_CAL_MS 1000
+#endif
+
+// Largest swing of any axis while averaging that still counts as lying still
+#ifndef ACCEL_CAL_MAX_SPREAD_MG
+#define ACCEL_CAL_MAX_SPREAD_MG 150
+#endif
+
+typedef enum {
+    ACCEL_CAL_IDLE,
+    ACCEL_CAL_COLLECTING,
+    ACCEL_CAL_DONE,         // applied and saved
+    ACCEL_CAL_MOVED,        // swing over ACCEL_CAL_MAX_SPREAD_MG, nothing changed
+    ACCEL_CAL_NOT_LEVEL,    // over 250 mg of bias, the board is not lying flat
+    ACCEL_CAL_FAILED,       // the sensor or the flash did not take it
+} accel_cal_status_t;
+
+// Newest saved bias for the fitted part, for accel_config_t.bias. Leaves
+// zero and returns false if there is none.
+bool accel_cal_load(int16_t bias[3]);
+
+// Average the next samples, period_us apart
+void accel_cal_start(uint32_t period_us);
+bool accel_cal_running(void);
+// Feed samples as they come from the sensor, before any filtering. Returns
+// ACCEL_CAL_COLLECTING until enough have been seen, then the outcome.
+accel_cal_status_t accel_cal_add(const accel_sample_t *samples, size_t count);
+
+// Bias taken out by the sensor and where it came from
+void accel_cal_report(FILE *out);
+
+#endif
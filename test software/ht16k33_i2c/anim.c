@@ -0,0 +1,125 @@
+#include "hal.h"
+#include "anim.h"
+
+#define SEG_A HT16K33_SEG_A
+#define SEG_B HT16K33_SEG_B
+#define SEG_C HT16K33_SEG_C
+#define SEG_D HT16K33_SEG_D
+#define SEG_E HT16K33_SEG_E
+#define SEG_F HT16K33_SEG_F
+#define SEG_G HT16K33_SEG_G1
+
+#define DIGITS(d0, d1, d2, d3, ms) { .digits = {d0, d1, d2, d3}, .flags = ANIM_DIGITS, .hold_ms = (ms) }
+#define ALL(seg, ms) DIGITS(seg, seg, seg, seg, ms)
+#define LEVEL(level, ms) { .flags = ANIM_BRIGHTNESS, .brightness = (level), .hold_ms = (ms) }
+
+// A single segment running along the outer loop of all four digits
+static const anim_frame_t snake_frames[] = {
+    DIGITS(SEG_A, 0, 0, 0, 100), DIGITS(0, SEG_A, 0, 0, 100),
+    DIGITS(0, 0, SEG_A, 0, 100), DIGITS(0, 0, 0, SEG_A, 100),
+    DIGITS(0, 0, 0, SEG_B, 100), DIGITS(0, 0, 0, SEG_G, 100),
+    DIGITS(0, 0, SEG_G, 0, 100), DIGITS(0, SEG_G, 0, 0, 100),
+    DIGITS(SEG_G, 0, 0, 0, 100), DIGITS(SEG_E, 0, 0, 0, 100),
+    DIGITS(SEG_D, 0, 0, 0, 100), DIGITS(0, SEG_D, 0, 0, 100),
+    DIGITS(0, 0, SEG_D, 0, 100), DIGITS(0, 0, 0, SEG_D, 100),
+    DIGITS(0, 0, 0, SEG_C, 100), DIGITS(0, 0, 0, SEG_G, 100),
+    DIGITS(0, 0, SEG_G, 0, 100), DIGITS(0, SEG_G, 0, 0, 100),
+    DIGITS(SEG_G, 0, 0, 0, 100), DIGITS(SEG_F, 0, 0, 0, 100),
+    DIGITS(0, 0, 0, 0, 0),
+};
+
+// The inner segments of every digit turning like a propeller
+static const anim_frame_t propeller_frames[] = {
+    ALL(HT16K33_SEG_G1, 60), ALL(HT16K33_SEG_H, 60), ALL(HT16K33_SEG_J, 60), ALL(HT16K33_SEG_K, 60),
+    ALL(HT16K33_SEG_G2, 60), ALL(HT16K33_SEG_N, 60), ALL(HT16K33_SEG_M, 60), ALL(HT16K33_SEG_L, 60),
+};
+
+// Brightness down to the minimum and back, the digits are left alone
+static const anim_frame_t fade_frames[] = {
+    LEVEL(15, 30), LEVEL(14, 30), LEVEL(13, 30), LEVEL(12, 30), LEVEL(11, 30), LEVEL(10, 30),
+    LEVEL(9, 30), LEVEL(8, 30), LEVEL(7, 30), LEVEL(6, 30), LEVEL(5, 30), LEVEL(4, 30),
+    LEVEL(3, 30), LEVEL(2, 30), LEVEL(1, 30), LEVEL(0, 30), LEVEL(1, 30), LEVEL(2, 30),
+    LEVEL(3, 30), LEVEL(4, 30), LEVEL(5, 30), LEVEL(6, 30), LEVEL(7, 30), LEVEL(8, 30),
+    LEVEL(9, 30), LEVEL(10, 30), LEVEL(11, 30), LEVEL(12, 30), LEVEL(13, 30), LEVEL(14, 30),
+    LEVEL(15, 0),
+};
+
+const anim_t anim_snake = { snake_frames, count_of(snake_frames), 1 };
+const anim_t anim_propeller = { propeller_frames, count_of(propeller_frames), 0 };
+const anim_t anim_fade = { fade_frames, count_of(fade_frames), 1 };
+
+static const anim_t *current;
+static int frame_index;
+static int rounds;
+static uint64_t next_us;
+
+static void anim_text_frame(anim_frame_t *frame, const ht16k33_text_t *text, int offset, uint16_t hold_ms) {
+    for (int digit = 0; digit < NUM_DIGITS; digit++) {
+        int i = offset + digit;
+        frame->digits[digit] = i < text->len ? text->glyphs[i] : 0;
+    }
+    frame->flags = ANIM_DIGITS;
+    frame->brightness = 0;
+    frame->hold_ms = hold_ms;
+}
+
+int anim_build_scroll(anim_frame_t *frames, int max, const ht16k33_text_t *text, uint16_t interval_ms) {
+    int count = 0;
+
+    do {
+        anim_text_frame(&frames[count], text, count, interval_ms);
+        count++;
+    } while (count < max && count + NUM_DIGITS <= text->len);
+    return count;
+}
+
+int anim_build_blink(anim_frame_t frames[2], const ht16k33_text_t *text, uint16_t on_ms, uint16_t off_ms) {
+    anim_text_frame(&frames[0], text, 0, on_ms);
+    anim_text_frame(&frames[1], text, text->len, off_ms);
+    return 2;
+}
+
+void anim_start(const anim_t *anim) {
+    current = anim->count > 0 ? anim : NULL;
+    frame_index = 0;
+    rounds = 0;
+    next_us = 0;
+}
+
+void anim_stop(void) {
+    current = NULL;
+}
+
+bool anim_running(void) {
+    return current != NULL;
+}
+
+uint64_t anim_service(uint64_t now_us) {
+    if (!current)
+        return ANIM_IDLE;
+    if (now_us < next_us)
+        return next_us;
+
+    if (frame_index == current->count) {
+        frame_index = 0;
+        if (current->repeat && ++rounds >= current->repeat) {
+            current = NULL;
+            return ANIM_IDLE;
+        }
+    }
+
+    const anim_frame_t *frame = &current->frames[frame_index++];
+    if (frame->flags & ANIM_DIGITS) {
+        for (int digit = 0; digit < NUM_DIGITS; digit++)
+            ht16k33_display_set(digit, frame->digits[digit]);
+        ht16k33_flush();
+    }
+    if (frame->flags & ANIM_BRIGHTNESS)
+        ht16k33_set_brightness(frame->brightness);
+
+    // keep the cadence unless we fell a whole frame behind
+    next_us += frame->hold_ms * 1000ull;
+    if (next_us < now_us)
+        next_us = now_us + frame->hold_ms * 1000ull;
+    return next_us;
+}
@@ -0,0 +1,56 @@
+#ifndef ANIM_H
+#define ANIM_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "ht16k33.h"
+
+/* Non-blocking display animations.
+
+   An animation is a sequence of precomputed frames, each with the digits to
+   show and/or a brightness, and how long it stays up. anim_service() puts up
+   the frame that is due and returns when the next one is, so the caller can
+   sleep until then; the UI scheduler runs it as a task with that deadline.
+   A frame is one queued flush of the digits that changed and at most one
+   queued brightness command, so nothing waits on the bus.
+*/
+
+#define ANIM_IDLE UINT64_MAX
+
+// What a frame changes
+#define ANIM_DIGITS     0x01
+#define ANIM_BRIGHTNESS 0x02
+
+typedef struct {
+    uint16_t digits[NUM_DIGITS];
+    uint8_t flags;
+    uint8_t brightness;
+    uint16_t hold_ms;
+} anim_frame_t;
+
+typedef struct {
+    const anim_frame_t *frames;
+    int count;
+    int repeat;     // times to play, 0 for forever
+} anim_t;
+
+// Built in sequences, in flash
+extern const anim_t anim_snake;
+extern const anim_t anim_propeller;
+extern const anim_t anim_fade;
+
+// Frames for rendered text: a scroll through it, or the first digits
+// blinking. Return the number of frames written.
+int anim_build_scroll(anim_frame_t *frames, int max, const ht16k33_text_t *text, uint16_t interval_ms);
+int anim_build_blink(anim_frame_t frames[2], const ht16k33_text_t *text, uint16_t on_ms, uint16_t off_ms);
+
+// Replace whatever is playing, the first frame is due at once
+void anim_start(const anim_t *anim);
+void anim_stop(void);
+bool anim_running(void);
+
+// Show the frame due at now_us, if any. Returns when the next one is due,
+// or ANIM_IDLE once the animation has finished.
+uint64_t anim_service(uint64_t now_us);
+
+#endif
@@ -0,0 +1,526 @@
+#include <stdio.h>
+#include "board.h"
+#include "hal.h"
+#include "i2c_async.h"
+#include "i2c_bus.h"
+#include "ht16k33.h"
+#include "anim.h"
+#include "accel.h"
+#include "accel_cal.h"
+#include "mma8451q.h"
+#include "hc595.h"
+#include "input.h"
+#include "sample_ring.h"
+#include "dsp.h"
+#include "telemetry.h"
+#include "flash_log.h"
+#include "sched.h"
+#include "prof.h"
+#include "boot.h"
+#include "app.h"
+
+// Sensor FIFO watermark in samples, 0 reads every sample on data-ready.
+// Batching amortises the bus overhead and lets the CPU sleep between drains,
+// which pays off at high output data rates.
+#ifndef APP_FIFO_WATERMARK
+#if ACCEL_ODR_HZ >= 400
+#define APP_FIFO_WATERMARK 16
+#else
+#define APP_FIFO_WATERMARK 0
+#endif
+#endif
+
+// Stream samples as binary telemetry records instead of printing them.
+// Formatting floats for every sample cannot keep up at high data rates.
+#ifndef APP_TELEMETRY
+#define APP_TELEMETRY 0
+#endif
+
+// Record samples to the flash log. A long press on button 1 starts and stops
+// a capture, a long press on button 2 dumps the last one as telemetry.
+#ifndef APP_FLASH_LOG
+#define APP_FLASH_LOG 0
+#endif
+
+// Let the sensor detect freefall, transients, taps and orientation changes
+// and print those events.
+#ifndef APP_MOTION_EVENTS
+#define APP_MOTION_EVENTS 0
+#endif
+
+// Read every sample from the sensor. With motion events and nothing to
+// record, the bus stays idle until the sensor reports an event.
+#ifndef APP_RAW_SAMPLES
+#define APP_RAW_SAMPLES (!APP_MOTION_EVENTS || APP_TELEMETRY || APP_FLASH_LOG)
+#endif
+
+// Filter and decimate the samples before they go out, see dsp.h. Printing,
+// telemetry and the flash log then get DSP_CONFIG_DEFAULT's decimated
+// stream, and the RMS and peak features are printed.
+#ifndef APP_DSP
+#define APP_DSP 0
+#endif
+
+// Samples taken from the ring per pass of the samples task
+#define APP_SAMPLE_BLOCK 32
+
+// Fallback poll for an accelerometer interrupt left pending by a failed read
+#define APP_SENSOR_SERVICE_US (100 * 1000)
+
+static uint8_t spidata[3];
+
+static sample_ring_t accel_samples;
+static dsp_t accel_dsp;
+
+// One scheduler per core. Without APP_DUAL_CORE both halves share the first.
+static sched_t schedulers[1 + APP_DUAL_CORE];
+#define UI_SCHED (&schedulers[0])
+#define SENSOR_SCHED (&schedulers[APP_DUAL_CORE])
+
+static void app_sensor_service_task(sched_task_t *task, uint64_t now_us);
+static void app_input_task(sched_task_t *task, uint64_t now_us);
+static void app_samples_task(sched_task_t *task, uint64_t now_us);
+static bool app_samples_ready(void);
+static void app_flash_log_task(sched_task_t *task, uint64_t now_us);
+static void app_display_task(sched_task_t *task, uint64_t now_us);
+
+PROF_HIST(prof_sample_print, "sample printf");
+
+static sched_task_t sensor_service_task = SCHED_TASK("sensor", app_sensor_service_task, NULL);
+static sched_task_t input_task = SCHED_TASK("input", app_input_task, input_wake_pending);
+static sched_task_t samples_task = SCHED_TASK("samples", app_samples_task, app_samples_ready);
+static sched_task_t flash_log_task = SCHED_TASK("flash log", app_flash_log_task, NULL);
+static sched_task_t display_task = SCHED_TASK("display", app_display_task, NULL);
+
+// Button 3 steps through the display animations
+#define APP_DEMO_TEXT "HELLO FROM THE PICO 2.  "
+enum { DEMO_SCROLL, DEMO_SNAKE, DEMO_PROPELLER, DEMO_FADE, DEMO_BLINK, DEMO_COUNT };
+static int demo = DEMO_COUNT - 1;
+static anim_frame_t demo_frames[HT16K33_TEXT_MAX];
+static anim_t demo_anim;
+
+// Traffic light leds are lit for one scan period after button activity
+static bool traffic_leds_on;
+
+static const char *const input_event_names[] = {
+    [INPUT_PRESS] = "pressed",
+    [INPUT_RELEASE] = "released",
+    [INPUT_LONG_PRESS] = "long press",
+};
+
+static const char *const cal_status_names[] = {
+    [ACCEL_CAL_DONE] = "done",
+    [ACCEL_CAL_MOVED] = "the board moved, nothing changed",
+    [ACCEL_CAL_NOT_LEVEL] = "the board is not lying flat, nothing changed",
+    [ACCEL_CAL_FAILED] = "failed",
+};
+
+static const char *const motion_event_names[] = {
+    [MMA8451Q_EVENT_FREEFALL] = "freefall",
+    [MMA8451Q_EVENT_MOTION] = "motion",
+    [MMA8451Q_EVENT_TRANSIENT] = "transient",
+    [MMA8451Q_EVENT_TAP] = "tap",
+    [MMA8451Q_EVENT_DOUBLE_TAP] = "double tap",
+    [MMA8451Q_EVENT_ORIENTATION] = "orientation",
+};
+
+static const char *const orientation_names[] = {
+    [MMA8451Q_PORTRAIT_UP] = "portrait up",
+    [MMA8451Q_PORTRAIT_DOWN] = "portrait down",
+    [MMA8451Q_LANDSCAPE_RIGHT] = "landscape right",
+    [MMA8451Q_LANDSCAPE_LEFT] = "landscape left",
+};
+
+static const i2c_bus_device_t bus_devices[] = {
+    { "ht16k33", ht16k33_probe },
+    { "accel", accel_probe },
+};
+
+bool app_bus_init(void) {
+    boot_begin(BOOT_BUS);
+    bool ok = i2c_bus_init(I2C_BUS_HZ, bus_devices, count_of(bus_devices));
+    boot_end(BOOT_BUS);
+    i2c_bus_report(stdout);
+    return ok;
+}
+
+bool app_init(void) {
+    if (!app_ui_init()) {
+        return false;
+    }
+    return app_sensor_init();
+}
+
+// Run the tasks of both halves for one loop period, sleeping whenever none
+// of them has work
+void app_step(void) {
+    sched_run_until(UI_SCHED, hal_time_us() + APP_LOOP_PERIOD_MS * 1000);
+}
+
+void app_report(FILE *out) {
+    boot_report(out);
+    accel_cal_report(out);
+    for (size_t i = 0; i < count_of(schedulers); i++) {
+        sched_report(&schedulers[i], out);
+    }
+    i2c_bus_report(out);
+    i2c_async_report(out);
+    ht16k33_report(out);
+    if (APP_RAW_SAMPLES && accel_driver()) {
+        timebase_report(accel_timebase(), accel_driver()->name, out);
+    }
+    if (APP_DSP) {
+        dsp_report(&accel_dsp, out);
+    }
+    if (PROF_ENABLED) {
+        prof_report(out);
+    }
+}
+
+bool app_sensor_init(void) {
+    boot_begin(BOOT_SENSOR);
+    if (APP_DUAL_CORE) {
+        sched_init(SENSOR_SCHED);
+    }
+    // the sensor takes out the saved bias from the first sample
+    accel_config_t config = { .odr_hz = ACCEL_ODR_HZ, .range_g = ACCEL_RANGE_G };
+    accel_cal_load(config.bias);
+    if (!accel_init(&config)) {
+        return false;
+    }
+    sched_add(SENSOR_SCHED, &sensor_service_task, hal_time_us() + APP_SENSOR_SERVICE_US);
+
+    sample_ring_init(&accel_samples);
+    if (APP_DSP) {
+        const dsp_config_t dsp = DSP_CONFIG_DEFAULT(ACCEL_ODR_HZ);
+        if (!dsp_init(&accel_dsp, &dsp, 1e6f / accel_odr_period_us())) {
+            return false;
+        }
+    }
+    if (APP_MOTION_EVENTS) {
+        // The event engines are part specific, only the MMA8451Q's are used
+        if (accel_driver() != &accel_mma8451q) {
+            printf("Motion events need the MMA8451Q, found %s\n", accel_driver()->name);
+            return false;
+        }
+        const mma8451q_motion_config_t motion = MMA8451Q_MOTION_CONFIG_DEFAULT;
+        if (!mma8451q_enable_motion_events(&motion)) {
+            return false;
+        }
+    }
+    if (!APP_RAW_SAMPLES) {
+        boot_end(BOOT_SENSOR);
+        return true;
+    }
+    bool ok;
+    if (APP_FIFO_WATERMARK > 0) {
+        ok = accel_enable_fifo_irq(APP_FIFO_WATERMARK, &accel_samples);
+    } else {
+        ok = accel_enable_data_ready_irq(&accel_samples);
+    }
+    boot_end(BOOT_SENSOR);
+    boot_begin(BOOT_FIRST_SAMPLE);
+    return ok;
+}
+
+void app_sensor_step(void) {
+    sched_run_until(SENSOR_SCHED, hal_time_us() + APP_LOOP_PERIOD_MS * 1000);
+}
+
+// Samples and events arrive from interrupts, this only catches an
+// accelerometer interrupt that is still pending after a failed read, and
+// slows the bus down if transfers keep failing
+static void app_sensor_service_task(sched_task_t *task, uint64_t now_us) {
+    accel_service_irq();
+    i2c_bus_service();
+    sched_at(task, now_us + APP_SENSOR_SERVICE_US);
+}
+
+// Buttons in bits 0-3, switches in bits 4-11, as in the telemetry records
+static uint16_t app_input_bitmap(void) {
+    uint64_t state = input_state();
+
+    return ((state >> BTN1) & 0x0f) | (((state >> SW1) & 0xff) << 4);
+}
+
+// Mirror the switches on all three shift registers. The switches sit on
+// consecutive gpios, so the byte comes straight out of the input state.
+static void app_update_switch_leds(void) {
+    uint8_t switches = input_state() >> SW1;
+
+    spidata[0] = switches;
+    spidata[1] = switches;
+    spidata[2] = switches;
+    hc595_write(spidata);
+}
+
+static void app_print_motion_event(const mma8451q_event_t *event) {
+    printf("t: %llu us, %s", (unsigned long long)event->timestamp_us, motion_event_names[event->type]);
+    if (event->type == MMA8451Q_EVENT_ORIENTATION) {
+        printf(": %s, %s\n", orientation_names[event->orientation], event->back ? "back" : "front");
+        return;
+    }
+    for (int axis = 0; axis < 3; axis++) {
+        if (event->axes & (1u << axis)) {
+            printf(" %c%c", (event->negative & (1u << axis)) ? '-' : '+', "XYZ"[axis]);
+        }
+    }
+    printf("\n");
+}
+
+static void app_next_demo(uint64_t now_us) {
+    ht16k33_text_t text;
+
+    demo = (demo + 1) % DEMO_COUNT;
+    ht16k33_set_brightness(15);
+    switch (demo) {
+    case DEMO_SCROLL:
+        ht16k33_text_render(&text, APP_DEMO_TEXT);
+        demo_anim.frames = demo_frames;
+        demo_anim.count = anim_build_scroll(demo_frames, count_of(demo_frames), &text, 250);
+        demo_anim.repeat = 1;
+        anim_start(&demo_anim);
+        break;
+    case DEMO_SNAKE:
+        anim_start(&anim_snake);
+        break;
+    case DEMO_PROPELLER:
+        anim_start(&anim_propeller);
+        break;
+    case DEMO_FADE:
+        anim_start(&anim_fade);
+        break;
+    case DEMO_BLINK:
+        ht16k33_text_render(&text, "ACC.");
+        demo_anim.frames = demo_frames;
+        demo_anim.count = anim_build_blink(demo_frames, &text, 300, 200);
+        demo_anim.repeat = 5;
+        anim_start(&demo_anim);
+        break;
+    }
+    sched_at(&display_task, now_us);
+}
+
+static void app_long_press(unsigned int gpio) {
+    if (gpio == BTN4 && !APP_TELEMETRY) {
+        app_report(stdout);
+        return;
+    }
+    // calibrate the accelerometer, with the board lying still
+    if (gpio == BTN3 && APP_RAW_SAMPLES) {
+        accel_cal_start(accel_odr_period_us());
+        if (!APP_TELEMETRY) {
+            printf("accel cal: keep the board still\n");
+        }
+        return;
+    }
+    if (!APP_FLASH_LOG) {
+        return;
+    }
+    if (gpio == BTN1 && !flash_log_recording()) {
+        flash_log_start();
+        printf("flash log: recording\n");
+    } else if (gpio == BTN1) {
+        flash_log_stop();
+        printf("flash log: stopped, %lu records dropped\n", (unsigned long)flash_log_dropped());
+    } else if (gpio == BTN2) {
+        flash_log_dump();
+    }
+}
+
+bool app_ui_init(void) {
+    boot_begin(BOOT_UI);
+    sched_init(UI_SCHED);
+
+    // init ht16k33 after i2c init
+    ht16k33_init();
+
+    // Test brightness and blinking
+    // Set all segments on all digits on
+    ht16k33_display_set(0, 0xff);
+    ht16k33_display_set(1, 0xff);
+    ht16k33_display_set(2, 0xff);
+    ht16k33_display_set(3, 0xff);
+    ht16k33_flush();
+    ht16k33_set_brightness(15);
+
+    input_init();
+    app_update_switch_leds();
+    telemetry_init();
+    if (APP_FLASH_LOG) {
+        flash_log_init();
+    }
+
+    uint64_t now_us = hal_time_us();
+    sched_add(UI_SCHED, &input_task, now_us);
+    sched_add(UI_SCHED, &samples_task, SCHED_NEVER);
+    sched_add(UI_SCHED, &display_task, SCHED_NEVER);
+    if (APP_FLASH_LOG) {
+        sched_add(UI_SCHED, &flash_log_task, now_us);
+    }
+    boot_end(BOOT_UI);
+    return true;
+}
+
+void app_ui_step(void) {
+    sched_run_until(UI_SCHED, hal_time_us() + APP_LOOP_PERIOD_MS * 1000);
+}
+
+// Scans run every INPUT_SCAN_PERIOD_US while an input settles or a button is
+// held, and start again on the next edge interrupt
+static void app_input_task(sched_task_t *task, uint64_t now_us) {
+    input_event_t event;
+    bool buttons_changed = false;
+    bool switches_changed = false;
+
+    input_scan(now_us);
+    while (input_event_pop(&event)) {
+        bool is_switch = event.gpio >= SW1 && event.gpio <= SW8;
+
+        switches_changed |= is_switch;
+        buttons_changed |= !is_switch;
+        if (event.type == INPUT_LONG_PRESS) {
+            app_long_press(event.gpio);
+        } else if (event.type == INPUT_PRESS && event.gpio == BTN3) {
+            app_next_demo(now_us);
+        }
+        // in telemetry mode the input state travels with every record
+        if (APP_TELEMETRY) {
+            continue;
+        }
+        if (is_switch) {
+            printf("t: %llu us, switch%d: %s\n", (unsigned long long)event.timestamp_us,
+                   event.gpio - SW1 + 1, event.type == INPUT_PRESS ? "on" : "off");
+        } else {
+            printf("t: %llu us, button%d: %s\n", (unsigned long long)event.timestamp_us,
+                   event.gpio - BTN1 + 1, input_event_names[event.type]);
+        }
+    }
+
+    // flash the traffic light leds on button activity
+    if (buttons_changed != traffic_leds_on) {
+        traffic_leds_on = buttons_changed;
+        hal_gpio_put(LED_RED, buttons_changed);
+        hal_gpio_put(LED_YELLOW, buttons_changed);
+        hal_gpio_put(LED_GREEN, buttons_changed);
+    }
+
+    // send switch data to shift register leds
+    if (switches_changed) {
+        app_update_switch_leds();
+    }
+
+    if (input_busy() || traffic_leds_on) {
+        sched_at(task, now_us + INPUT_SCAN_PERIOD_US);
+    }
+}
+
+static bool app_samples_ready(void) {
+    return sample_ring_count(&accel_samples) > 0 || (APP_MOTION_EVENTS && mma8451q_event_pending());
+}
+
+static void app_record_sample(const accel_sample_t *sample, uint16_t inputs) {
+    telemetry_record_t record = {
+        .timestamp_us = sample->timestamp_us,
+        .x = sample->x,
+        .y = sample->y,
+        .z = sample->z,
+        .inputs = inputs,
+    };
+
+    if (APP_TELEMETRY) {
+        telemetry_put(&record);
+    }
+    if (APP_FLASH_LOG) {
+        flash_log_put(&record);
+    }
+}
+
+static void app_print_sample(const accel_sample_t *sample) {
+    PROF_BEGIN(prof_sample_print);
+    // Convert to milli-g, no floats on the sample path
+    printf("t: %llu us, X: %ldmg, Y: %ldmg, Z: %ldmg\n",
+           (unsigned long long)sample->timestamp_us, (long)accel_q12_to_mg(sample->x),
+           (long)accel_q12_to_mg(sample->y), (long)accel_q12_to_mg(sample->z));
+    PROF_END(prof_sample_print);
+}
+
+static void app_print_features(const dsp_features_t *features) {
+    printf("t: %llu us, RMS X: %ldmg, Y: %ldmg, Z: %ldmg, peak X: %ldmg, Y: %ldmg, Z: %ldmg\n",
+           (unsigned long long)features->timestamp_us,
+           (long)accel_q12_to_mg(features->rms[0]), (long)accel_q12_to_mg(features->rms[1]),
+           (long)accel_q12_to_mg(features->rms[2]), (long)accel_q12_to_mg(features->peak[0]),
+           (long)accel_q12_to_mg(features->peak[1]), (long)accel_q12_to_mg(features->peak[2]));
+}
+
+// Runs when the sensor interrupts have queued samples or events. Telemetry
+// also needs a tick to write out a partial chunk after its maximum delay.
+static void app_samples_task(sched_task_t *task, uint64_t now_us) {
+    accel_sample_t block[APP_SAMPLE_BLOCK];
+
+    if (APP_MOTION_EVENTS) {
+        mma8451q_event_t motion_event;
+
+        while (mma8451q_event_pop(&motion_event)) {
+            if (!APP_TELEMETRY) {
+                app_print_motion_event(&motion_event);
+            }
+        }
+    }
+
+    bool record = APP_TELEMETRY || (APP_FLASH_LOG && flash_log_recording());
+    uint16_t inputs = record ? app_input_bitmap() : 0;
+    size_t count;
+
+    while ((count = sample_ring_pop_block(&accel_samples, block, count_of(block))) > 0) {
+        if (!boot_done(BOOT_FIRST_SAMPLE)) {
+            boot_end(BOOT_FIRST_SAMPLE);
+            if (!APP_TELEMETRY) {
+                boot_report(stdout);
+            }
+        }
+        if (accel_cal_running()) {
+            accel_cal_status_t status = accel_cal_add(block, count);
+            if (status != ACCEL_CAL_COLLECTING && !APP_TELEMETRY) {
+                printf("accel cal: %s\n", cal_status_names[status]);
+                accel_cal_report(stdout);
+            }
+        }
+        if (APP_DSP) {
+            count = dsp_process(&accel_dsp, block, count);
+        }
+        for (size_t i = 0; i < count; i++) {
+            if (record) {
+                app_record_sample(&block[i], inputs);
+            } else {
+                app_print_sample(&block[i]);
+            }
+        }
+    }
+    if (APP_DSP && !APP_TELEMETRY) {
+        dsp_features_t features;
+
+        while (dsp_features_pop(&accel_dsp, &features)) {
+            app_print_features(&features);
+        }
+    }
+    if (APP_TELEMETRY) {
+        telemetry_drain(now_us);
+        sched_at(task, now_us + APP_LOOP_PERIOD_MS * 1000);
+    }
+}
+
+// Puts up animation frames as they fall due
+static void app_display_task(sched_task_t *task, uint64_t now_us) {
+    uint64_t next_us = anim_service(now_us);
+
+    if (next_us != ANIM_IDLE) {
+        sched_at(task, next_us);
+    }
+}
+
+// Programs queued pages and erases ahead while idle
+static void app_flash_log_task(sched_task_t *task, uint64_t now_us) {
+    flash_log_service();
+    sched_at(task, now_us + APP_LOOP_PERIOD_MS * 1000);
+}
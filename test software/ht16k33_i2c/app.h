@@ -0,0 +1,42 @@
+#ifndef APP_H
+#define APP_H
+
+#include <stdbool.h>
+#include <stdio.h>
+
+// Application shared by the firmware and the host build. app_init() brings up
+// the display and accelerometer once the HAL is initialised, app_step() runs
+// one iteration of the main loop.
+//
+// The application is split in a sensor half, which owns the accelerometer
+// and fills the sample ring, and a UI half, which handles buttons, switches,
+// the display and the LEDs and drains the ring. With APP_DUAL_CORE the
+// firmware runs the sensor half on core 1, otherwise app_init() and
+// app_step() run both halves on one core.
+//
+// Each half is a set of tasks on a cooperative scheduler (sched.h) that
+// sleeps the core whenever no task has work. The step functions run it for
+// APP_LOOP_PERIOD_MS, a long press on button 4 prints its idle report.
+
+#ifndef APP_DUAL_CORE
+#define APP_DUAL_CORE 0
+#endif
+
+#define APP_LOOP_PERIOD_MS 10
+
+// Pick the bus speed before anything else uses the bus, on core 0
+bool app_bus_init(void);
+
+bool app_init(void);
+void app_step(void);
+
+bool app_sensor_init(void);
+void app_sensor_step(void);
+bool app_ui_init(void);
+void app_ui_step(void);
+
+// Idle time and per task busy time of the schedulers, the bus profile, and
+// bus traffic and missed deadlines per priority
+void app_report(FILE *out);
+
+#endif
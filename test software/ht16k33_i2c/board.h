@@ -0,0 +1,73 @@
+#ifndef BOARD_H
+#define BOARD_H
+
+// Pin and peripheral assignments for the RP2350B thesis board.
+// Shared by the firmware, the HAL and the host simulator.
+
+#ifndef I2C_PORT
+#define I2C_PORT i2c0
+#endif
+
+#ifndef I2C_SDA_PIN
+#define I2C_SDA_PIN 20
+#endif
+
+#ifndef I2C_SCL_PIN
+#define I2C_SCL_PIN 21
+#endif
+
+// Fastest bus clock to try at boot, see i2c_bus.h. Both devices are rated
+// for fast mode.
+#ifndef I2C_BUS_HZ
+#define I2C_BUS_HZ (400 * 1000)
+#endif
+
+// 74hc595 chain, shifted and latched by PIO
+#define HC595_SHIFT_HZ (4 * 1000 * 1000)
+#define PIN_SHCP  34
+#define PIN_DS 35
+#define PIN_STCP 36
+#define PIN_OE 37
+#define PIN_MR 38
+
+// button and switch define
+#define BTN1 30
+#define BTN2 31
+#define BTN3 32
+#define BTN4 33
+
+#define SW1 22
+#define SW2 23
+#define SW3 24
+#define SW4 25
+#define SW5 26
+#define SW6 27
+#define SW7 28
+#define SW8 29
+
+// Accelerometer interrupt outputs, active low
+#define ACCEL_INT1_PIN 18
+#define ACCEL_INT2_PIN 19
+
+// Region of the 16 MB W25Q128 boot flash reserved for the sample log, as an
+// offset from the start of flash. The firmware stays in the first half. The
+// last sector of flash, right after the log, keeps the accelerometer
+// calibration.
+#define LOG_FLASH_OFFSET (8u * 1024 * 1024)
+#define LOG_FLASH_SIZE   (8u * 1024 * 1024 - CAL_FLASH_SIZE)
+#define CAL_FLASH_OFFSET (LOG_FLASH_OFFSET + LOG_FLASH_SIZE)
+#define CAL_FLASH_SIZE   4096u
+
+#define LED_RED 17
+#define LED_YELLOW 16
+#define LED_GREEN 15
+
+// Pin groups for bulk gpio operations, bit n is gpio n
+#define GPIO_BIT(gpio) (1ull << (gpio))
+#define BUTTON_MASK (GPIO_BIT(BTN1) | GPIO_BIT(BTN2) | GPIO_BIT(BTN3) | GPIO_BIT(BTN4))
+#define SWITCH_MASK (GPIO_BIT(SW1) | GPIO_BIT(SW2) | GPIO_BIT(SW3) | GPIO_BIT(SW4) | \
+                     GPIO_BIT(SW5) | GPIO_BIT(SW6) | GPIO_BIT(SW7) | GPIO_BIT(SW8))
+#define ACCEL_INT_MASK (GPIO_BIT(ACCEL_INT1_PIN) | GPIO_BIT(ACCEL_INT2_PIN))
+#define LED_MASK (GPIO_BIT(LED_RED) | GPIO_BIT(LED_YELLOW) | GPIO_BIT(LED_GREEN))
+
+#endif
@@ -0,0 +1,42 @@
+#include "hal.h"
+#include "boot.h"
+
+static const char *const stage_names[BOOT_STAGES] = {
+    [BOOT_HAL] = "hal",
+    [BOOT_BUS] = "bus probe",
+    [BOOT_UI] = "ui",
+    [BOOT_SENSOR] = "sensor",
+    [BOOT_FIRST_SAMPLE] = "first sample",
+};
+
+// Each stage is written by one core only, before the report reads it
+static volatile uint64_t begin_us[BOOT_STAGES];
+static volatile uint64_t end_us[BOOT_STAGES];
+static volatile bool ended[BOOT_STAGES];
+
+void boot_begin(boot_stage_t stage) {
+    begin_us[stage] = hal_time_us();
+}
+
+void boot_end(boot_stage_t stage) {
+    end_us[stage] = hal_time_us();
+    ended[stage] = true;
+}
+
+bool boot_done(boot_stage_t stage) {
+    return ended[stage];
+}
+
+void boot_report(FILE *out) {
+    fprintf(out, "boot:");
+    if (ended[BOOT_FIRST_SAMPLE])
+        fprintf(out, " first sample at %llu us", (unsigned long long)end_us[BOOT_FIRST_SAMPLE]);
+    fprintf(out, "\n");
+    for (int i = 0; i < BOOT_STAGES; i++) {
+        if (!ended[i])
+            continue;
+        fprintf(out, "  %-12s %10llu .. %10llu us %10llu us\n", stage_names[i],
+                (unsigned long long)begin_us[i], (unsigned long long)end_us[i],
+                (unsigned long long)(end_us[i] - begin_us[i]));
+    }
+}
@@ -0,0 +1,31 @@
+#ifndef BOOT_H
+#define BOOT_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/* Boot time per stage, from the microsecond timer that starts at reset.
+
+   Each stage records when it began and ended, so stages that overlap, such
+   as the sensor on core 1 and the UI on core 0, show up as such. The
+   last stage is the wait from the end of sensor setup to the first sample
+   leaving the ring, which is what time-to-first-sample adds up to.
+*/
+
+typedef enum {
+    BOOT_HAL,               // stdio, gpio, i2c, pio
+    BOOT_BUS,               // bus speed probe
+    BOOT_UI,                // display, inputs, telemetry
+    BOOT_SENSOR,
+    BOOT_FIRST_SAMPLE,
+    BOOT_STAGES
+} boot_stage_t;
+
+void boot_begin(boot_stage_t stage);
+void boot_end(boot_stage_t stage);
+// True once the stage has ended
+bool boot_done(boot_stage_t stage);
+void boot_report(FILE *out);
+
+#endif
@@ -0,0 +1,199 @@
+#include <math.h>
+#include <string.h>
+#include "dsp.h"
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+#define DSP_COEF_BITS 28
+// Fraction bits the filter state keeps below Q12
+#define DSP_STATE_BITS 8
+
+static int64_t dsp_coef(double value) {
+    return (int64_t)llround(value * (1 << DSP_COEF_BITS));
+}
+
+// Butterworth (Q = 1/sqrt(2)) section from the RBJ audio EQ cookbook
+static void dsp_biquad_init(dsp_biquad_t *bq, float cutoff_hz, float rate_hz, bool highpass) {
+    memset(bq, 0, sizeof(*bq));
+    if (cutoff_hz <= 0)
+        return;
+
+    double w0 = 2 * M_PI * cutoff_hz / rate_hz;
+    double cos_w0 = cos(w0);
+    double alpha = sin(w0) / sqrt(2.0);
+    double a0 = 1 + alpha;
+    double b1 = highpass ? -(1 + cos_w0) : 1 - cos_w0;
+
+    bq->b0 = dsp_coef(fabs(b1) / 2 / a0);
+    bq->b1 = dsp_coef(b1 / a0);
+    bq->b2 = bq->b0;
+    bq->a1 = dsp_coef(-2 * cos_w0 / a0);
+    bq->a2 = dsp_coef((1 - alpha) / a0);
+    bq->enabled = true;
+}
+
+// One sample of one axis through a section, in and out in Q20
+static inline int32_t dsp_biquad_step(dsp_biquad_t *bq, int axis, int32_t x) {
+    if (!bq->primed) {
+        bq->x1[axis] = bq->x2[axis] = x;
+        bq->y1[axis] = bq->y2[axis] = bq->b1 < 0 ? 0 : x;
+        if (axis == 2)
+            bq->primed = true;
+    }
+    int64_t acc = bq->b0 * x + bq->b1 * bq->x1[axis] + bq->b2 * bq->x2[axis]
+                - bq->a1 * bq->y1[axis] - bq->a2 * bq->y2[axis];
+    int32_t y = (int32_t)((acc + (1 << (DSP_COEF_BITS - 1))) >> DSP_COEF_BITS);
+
+    bq->x2[axis] = bq->x1[axis];
+    bq->x1[axis] = x;
+    bq->y2[axis] = bq->y1[axis];
+    bq->y1[axis] = y;
+    return y;
+}
+
+static inline int16_t dsp_saturate(int32_t value) {
+    if (value > INT16_MAX)
+        return INT16_MAX;
+    if (value < INT16_MIN)
+        return INT16_MIN;
+    return (int16_t)value;
+}
+
+static uint32_t dsp_isqrt(uint32_t value) {
+    uint32_t root = 0;
+    uint32_t bit = 1u << 30;
+
+    while (bit > value)
+        bit >>= 2;
+    while (bit) {
+        if (value >= root + bit) {
+            value -= root + bit;
+            root = (root >> 1) + bit;
+        } else {
+            root >>= 1;
+        }
+        bit >>= 2;
+    }
+    return root;
+}
+
+bool dsp_init(dsp_t *dsp, const dsp_config_t *config, float rate_hz) {
+    if (config->decimation < 1 || config->decimation > DSP_DECIMATION_MAX ||
+        config->cic_order < 1 || config->cic_order > DSP_CIC_ORDER_MAX ||
+        config->highpass_hz >= rate_hz / 2 || config->lowpass_hz >= rate_hz / 2)
+        return false;
+
+    memset(dsp, 0, sizeof(*dsp));
+    dsp->config = *config;
+    dsp_biquad_init(&dsp->highpass, config->highpass_hz, rate_hz, true);
+    dsp_biquad_init(&dsp->lowpass, config->lowpass_hz, rate_hz, false);
+    dsp->settle = config->cic_order - 1;
+    dsp->cic_gain = 1;
+    for (int i = 0; i < config->cic_order; i++)
+        dsp->cic_gain *= config->decimation;
+    return true;
+}
+
+static void dsp_push_features(dsp_t *dsp, uint64_t timestamp_us) {
+    dsp_features_t *f;
+
+    if (dsp->features_count == DSP_FEATURE_QUEUE) {
+        dsp->features_head = (dsp->features_head + 1) % DSP_FEATURE_QUEUE;
+        dsp->features_count--;
+        dsp->features_dropped++;
+    }
+    f = &dsp->features[(dsp->features_head + dsp->features_count) % DSP_FEATURE_QUEUE];
+    dsp->features_count++;
+
+    f->timestamp_us = timestamp_us;
+    for (int axis = 0; axis < 3; axis++) {
+        f->rms[axis] = (int16_t)dsp_isqrt((uint32_t)(dsp->sum_squares[axis] / dsp->window_count));
+        f->peak[axis] = dsp->peak[axis];
+        dsp->sum_squares[axis] = 0;
+        dsp->peak[axis] = 0;
+    }
+    dsp->window_count = 0;
+}
+
+size_t dsp_process(dsp_t *dsp, accel_sample_t *samples, size_t count) {
+    const int order = dsp->config.cic_order;
+    size_t out = 0;
+
+    for (size_t i = 0; i < count; i++) {
+        int16_t in[3] = { samples[i].x, samples[i].y, samples[i].z };
+        int16_t filtered[3];
+
+        for (int axis = 0; axis < 3; axis++) {
+            int32_t v = (int32_t)in[axis] * (1 << DSP_STATE_BITS);
+
+            if (dsp->highpass.enabled)
+                v = dsp_biquad_step(&dsp->highpass, axis, v);
+            if (dsp->lowpass.enabled)
+                v = dsp_biquad_step(&dsp->lowpass, axis, v);
+            filtered[axis] = dsp_saturate((v + (1 << (DSP_STATE_BITS - 1))) >> DSP_STATE_BITS);
+
+            dsp->integrator[0][axis] += (uint32_t)(int32_t)filtered[axis];
+            for (int k = 1; k < order; k++)
+                dsp->integrator[k][axis] += dsp->integrator[k - 1][axis];
+
+            if (dsp->config.window) {
+                int32_t magnitude = filtered[axis] < 0 ? -(int32_t)filtered[axis] : filtered[axis];
+                dsp->sum_squares[axis] += (int32_t)filtered[axis] * filtered[axis];
+                if (magnitude > dsp->peak[axis])
+                    dsp->peak[axis] = dsp_saturate(magnitude);
+            }
+        }
+        dsp->samples_in++;
+
+        if (dsp->config.window && ++dsp->window_count == dsp->config.window)
+            dsp_push_features(dsp, samples[i].timestamp_us);
+
+        if (++dsp->phase < dsp->config.decimation)
+            continue;
+        dsp->phase = 0;
+
+        // Combs at the output rate, then take out the R^N gain
+        int16_t decimated[3];
+        for (int axis = 0; axis < 3; axis++) {
+            uint32_t v = dsp->integrator[order - 1][axis];
+            for (int k = 0; k < order; k++) {
+                uint32_t delayed = dsp->comb[k][axis];
+                dsp->comb[k][axis] = v;
+                v -= delayed;
+            }
+            int32_t sum = (int32_t)v;
+            int32_t half = dsp->cic_gain / 2;
+            decimated[axis] = dsp_saturate((sum >= 0 ? sum + half : sum - half) / dsp->cic_gain);
+        }
+        if (dsp->settle) {
+            dsp->settle--;
+            continue;
+        }
+        samples[out].timestamp_us = samples[i].timestamp_us;
+        samples[out].x = decimated[0];
+        samples[out].y = decimated[1];
+        samples[out].z = decimated[2];
+        out++;
+    }
+    dsp->samples_out += out;
+    return out;
+}
+
+bool dsp_features_pop(dsp_t *dsp, dsp_features_t *features) {
+    if (dsp->features_count == 0)
+        return false;
+    *features = dsp->features[dsp->features_head];
+    dsp->features_head = (dsp->features_head + 1) % DSP_FEATURE_QUEUE;
+    dsp->features_count--;
+    return true;
+}
+
+void dsp_report(const dsp_t *dsp, FILE *out) {
+    fprintf(out, "dsp: %lu samples in, %lu out", (unsigned long)dsp->samples_in, (unsigned long)dsp->samples_out);
+    if (dsp->samples_out)
+        fprintf(out, ", %lu.%01lu:1", (unsigned long)(dsp->samples_in / dsp->samples_out),
+                (unsigned long)(dsp->samples_in * 10ull / dsp->samples_out % 10));
+    fprintf(out, ", %lu features dropped\n", (unsigned long)dsp->features_dropped);
+}
@@ -0,0 +1,114 @@
+#ifndef DSP_H
+#define DSP_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "sample_ring.h"
+
+/* Streaming filter and decimation stage between the sample ring and the
+   output.
+
+   Blocks of samples popped from the ring go through, per axis:
+
+     high-pass biquad -> low-pass biquad -> CIC decimator
+                                         \-> RMS and peak over a window
+
+   The biquads are second order Butterworth sections with Q28 coefficients
+   worked out once by dsp_init(). The sample path is integer only: Q12 g
+   samples, 8 extra fraction bits in the filter state and 64-bit
+   accumulators. The CIC decimator of order N and rate R averages R samples
+   into one with a gain of R^N, so everything downstream sees 1/R of the
+   data. Its group delay is N * (R - 1) / 2 input samples. Output samples
+   carry the timestamp of the newest input sample they include.
+
+   Each biquad starts from the steady state for its first sample, so a
+   high-pass does not ring from the 1 g step of gravity at start up, and
+   the first N - 1 CIC outputs, which still hold the start up ramp, are
+   dropped.
+
+   Features are taken after the filters at the full input rate, so a short
+   peak is not averaged away by the decimator.
+*/
+
+#define DSP_DECIMATION_MAX 32
+#define DSP_CIC_ORDER_MAX 3
+// Features waiting for dsp_features_pop(), the oldest are dropped
+#define DSP_FEATURE_QUEUE 4
+
+typedef struct {
+    float highpass_hz;      // 0 disables, e.g. 0.5 to take out gravity
+    float lowpass_hz;       // 0 disables, keep it below the output Nyquist rate
+    uint8_t decimation;     // R, 1 to DSP_DECIMATION_MAX, 1 disables
+    uint8_t cic_order;      // N, 1 (moving average) to DSP_CIC_ORDER_MAX
+    uint16_t window;        // input samples per RMS and peak feature, 0 disables
+} dsp_config_t;
+
+// A 10:1 cut in output bandwidth with the band kept up to a tenth of the
+// sample rate, and one feature set per second
+#define DSP_CONFIG_DEFAULT(rate_hz) { \
+    .highpass_hz = 0, \
+    .lowpass_hz = (rate_hz) / 10.0f, \
+    .decimation = 4, \
+    .cic_order = 2, \
+    .window = (rate_hz), \
+}
+
+typedef struct {
+    int64_t b0, b1, b2, a1, a2;     // Q28
+    int32_t x1[3], x2[3];           // Q20 g
+    int32_t y1[3], y2[3];
+    bool enabled;
+    bool primed;
+} dsp_biquad_t;
+
+typedef struct {
+    uint64_t timestamp_us;          // end of the window
+    int16_t rms[3];                 // Q12 g
+    int16_t peak[3];                // largest magnitude, Q12 g
+} dsp_features_t;
+
+typedef struct {
+    dsp_config_t config;
+    dsp_biquad_t highpass;
+    dsp_biquad_t lowpass;
+
+    // CIC state, unsigned so the integrators wrap without overflow
+    uint32_t integrator[DSP_CIC_ORDER_MAX][3];
+    uint32_t comb[DSP_CIC_ORDER_MAX][3];
+    uint8_t phase;
+    uint8_t settle;                 // outputs left to drop
+    int32_t cic_gain;
+
+    // Running window for the features
+    int64_t sum_squares[3];
+    int16_t peak[3];
+    uint16_t window_count;
+    dsp_features_t features[DSP_FEATURE_QUEUE];
+    uint8_t features_head;
+    uint8_t features_count;
+
+    uint32_t samples_in;
+    uint32_t samples_out;
+    uint32_t features_dropped;
+} dsp_t;
+
+/**
+ * @brief Works out the filter coefficients and clears the state.
+ * @param config Filters, decimation and feature window.
+ * @param rate_hz Input sample rate.
+ * @return false if the config is out of range.
+ */
+bool dsp_init(dsp_t *dsp, const dsp_config_t *config, float rate_hz);
+
+// Filter count samples in place and pack the decimated ones at the front.
+// Returns how many are left.
+size_t dsp_process(dsp_t *dsp, accel_sample_t *samples, size_t count);
+
+bool dsp_features_pop(dsp_t *dsp, dsp_features_t *features);
+
+// Samples in and out and the resulting cut in bandwidth
+void dsp_report(const dsp_t *dsp, FILE *out);
+
+#endif
@@ -0,0 +1,213 @@
+#include <string.h>
+#include "flash_log.h"
+
+// Pages waiting to be programmed are [queue_tail, queue_head), the page at
+// queue_head is being filled
+static uint8_t queue[FLASH_LOG_QUEUE_PAGES][HAL_FLASH_PAGE_SIZE];
+static uint32_t queue_head;
+static uint32_t queue_tail;
+static unsigned int fill;
+
+static uint32_t next_seq;       // sequence number for the next page queued
+static uint32_t erased_end;     // pages from the write position up to here are erased
+static uint32_t newest_seq;     // newest page in flash, valid if have_pages
+static bool have_pages;
+static uint16_t session;
+static bool recording;
+static uint8_t record_seq;
+static bool drop_pending;
+static uint32_t dropped;
+
+static uint32_t get32(const uint8_t *p) {
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static void put32(uint8_t *p, uint32_t v) {
+    p[0] = v;
+    p[1] = v >> 8;
+    p[2] = v >> 16;
+    p[3] = v >> 24;
+}
+
+static uint32_t page_offset(uint32_t seq) {
+    return (seq % FLASH_LOG_PAGES) * HAL_FLASH_PAGE_SIZE;
+}
+
+static bool header_valid(const uint8_t *header) {
+    return get32(header) == FLASH_LOG_MAGIC &&
+           telemetry_crc8(header, FLASH_LOG_HEADER_SIZE - 1) == header[FLASH_LOG_HEADER_SIZE - 1];
+}
+
+// Read and check the header of the page that holds seq
+static bool read_header(uint32_t seq, uint8_t header[FLASH_LOG_HEADER_SIZE]) {
+    hal_flash_read(page_offset(seq), header, FLASH_LOG_HEADER_SIZE);
+    return header_valid(header) && get32(&header[4]) == seq;
+}
+
+static bool sector_blank(uint32_t offset) {
+    uint8_t buf[HAL_FLASH_PAGE_SIZE];
+
+    for (uint32_t done = 0; done < HAL_FLASH_SECTOR_SIZE; done += sizeof(buf)) {
+        hal_flash_read(offset + done, buf, sizeof(buf));
+        for (size_t i = 0; i < sizeof(buf); i++) {
+            if (buf[i] != 0xFF)
+                return false;
+        }
+    }
+    return true;
+}
+
+// Make the sector at erased_end writable. Sectors that are still blank are
+// not erased again.
+static void erase_next_sector(void) {
+    uint32_t offset = page_offset(erased_end);
+
+    if (sector_blank(offset) || hal_flash_erase_sector(offset))
+        erased_end += FLASH_LOG_PAGES_PER_SECTOR;
+}
+
+void flash_log_init(void) {
+    uint8_t header[FLASH_LOG_HEADER_SIZE];
+
+    queue_head = 0;
+    queue_tail = 0;
+    fill = 0;
+    have_pages = false;
+    recording = false;
+    drop_pending = false;
+    dropped = 0;
+    session = 0;
+
+    // The first page of each sector is enough to find the newest sector
+    for (uint32_t i = 0; i < FLASH_LOG_PAGES; i += FLASH_LOG_PAGES_PER_SECTOR) {
+        hal_flash_read(i * HAL_FLASH_PAGE_SIZE, header, sizeof(header));
+        if (!header_valid(header))
+            continue;
+        uint32_t seq = get32(&header[4]);
+        if (!have_pages || seq > newest_seq) {
+            newest_seq = seq;
+            have_pages = true;
+        }
+    }
+    if (have_pages) {
+        while ((newest_seq + 1) % FLASH_LOG_PAGES_PER_SECTOR && read_header(newest_seq + 1, header))
+            newest_seq++;
+        read_header(newest_seq, header);
+        session = header[8] | (header[9] << 8);
+        // carry on in a fresh sector, the rest of this one may hold a torn page
+        next_seq = (newest_seq / FLASH_LOG_PAGES_PER_SECTOR + 1) * FLASH_LOG_PAGES_PER_SECTOR;
+    } else {
+        next_seq = 0;
+    }
+    erased_end = next_seq;
+}
+
+// Queue the page being filled
+static void finish_page(void) {
+    uint8_t *page = queue[queue_head % FLASH_LOG_QUEUE_PAGES];
+
+    put32(&page[0], FLASH_LOG_MAGIC);
+    put32(&page[4], next_seq++);
+    page[8] = session;
+    page[9] = session >> 8;
+    page[10] = fill;
+    memset(&page[11], 0xFF, 4);
+    page[15] = telemetry_crc8(page, FLASH_LOG_HEADER_SIZE - 1);
+    // leave unused record slots erased
+    memset(&page[FLASH_LOG_HEADER_SIZE + fill * TELEMETRY_RECORD_SIZE], 0xFF,
+           (FLASH_LOG_RECORDS_PER_PAGE - fill) * TELEMETRY_RECORD_SIZE);
+
+    queue_head++;
+    fill = 0;
+}
+
+void flash_log_start(void) {
+    if (recording)
+        return;
+    session++;
+    record_seq = 0;
+    fill = 0;
+    recording = true;
+}
+
+void flash_log_stop(void) {
+    if (!recording)
+        return;
+    if (fill)
+        finish_page();
+    recording = false;
+}
+
+bool flash_log_recording(void) {
+    return recording;
+}
+
+void flash_log_put(const telemetry_record_t *record) {
+    if (!recording)
+        return;
+    if (fill == 0 && queue_head - queue_tail == FLASH_LOG_QUEUE_PAGES) {
+        dropped++;
+        drop_pending = true;
+        return;
+    }
+
+    uint8_t *page = queue[queue_head % FLASH_LOG_QUEUE_PAGES];
+    telemetry_encode(record, record_seq++, drop_pending ? TELEMETRY_FLAG_DROPPED : 0,
+                     &page[FLASH_LOG_HEADER_SIZE + fill * TELEMETRY_RECORD_SIZE]);
+    drop_pending = false;
+    if (++fill == FLASH_LOG_RECORDS_PER_PAGE)
+        finish_page();
+}
+
+void flash_log_service(void) {
+    if (queue_tail != queue_head) {
+        const uint8_t *page = queue[queue_tail % FLASH_LOG_QUEUE_PAGES];
+        uint32_t seq = get32(&page[4]);
+
+        if (seq >= erased_end) {
+            erased_end = seq / FLASH_LOG_PAGES_PER_SECTOR * FLASH_LOG_PAGES_PER_SECTOR;
+            erase_next_sector();
+            return;
+        }
+        if (hal_flash_program_page(page_offset(seq), page)) {
+            newest_seq = seq;
+            have_pages = true;
+        }
+        queue_tail++;
+        return;
+    }
+    if (!recording && erased_end - next_seq < FLASH_LOG_ERASE_AHEAD * FLASH_LOG_PAGES_PER_SECTOR)
+        erase_next_sector();
+}
+
+void flash_log_dump(void) {
+    uint8_t header[FLASH_LOG_HEADER_SIZE];
+    uint8_t records[FLASH_LOG_RECORDS_PER_PAGE * TELEMETRY_RECORD_SIZE];
+
+    flash_log_stop();
+    while (queue_tail != queue_head)
+        flash_log_service();
+    if (!have_pages || !read_header(newest_seq, header))
+        return;
+
+    // walk back through the index to the first page of the session
+    uint16_t dump_session = header[8] | (header[9] << 8);
+    uint32_t first = newest_seq;
+    while (first > 0 && newest_seq - first + 1 < FLASH_LOG_PAGES && read_header(first - 1, header) &&
+           (header[8] | (header[9] << 8)) == dump_session)
+        first--;
+
+    for (uint32_t seq = first; seq <= newest_seq; seq++) {
+        if (!read_header(seq, header))
+            continue;
+        size_t len = header[10] * TELEMETRY_RECORD_SIZE;
+        if (len > sizeof(records))
+            continue;
+        hal_flash_read(page_offset(seq) + FLASH_LOG_HEADER_SIZE, records, len);
+        hal_stdio_write(records, len);
+    }
+}
+
+uint32_t flash_log_dropped(void) {
+    return dropped;
+}
@@ -0,0 +1,65 @@
+#ifndef FLASH_LOG_H
+#define FLASH_LOG_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "board.h"
+#include "hal.h"
+#include "telemetry.h"
+
+/* Sample recorder in the log region of the boot flash (see board.h).
+
+   Records are batched into page-sized buffers in RAM and programmed one page
+   per flash_log_service() call from the main loop, so capture does not
+   depend on USB being attached. Each page holds a header and
+   FLASH_LOG_RECORDS_PER_PAGE records in the telemetry.h format:
+
+     0..3   FLASH_LOG_MAGIC
+     4..7   page sequence number, increments per page ever written
+     8..9   session, increments per flash_log_start()
+     10     number of records
+     11..14 0xFF
+     15     CRC-8 over bytes 0..14, records carry their own
+
+   The region is written as a ring of sectors in sequence order, so every
+   sector sees the same number of erases, and page n always lives at page
+   n % FLASH_LOG_PAGES. The sequence number is the index: finding any recent
+   page costs one read.
+
+   A sector erase stalls everything for ~45 ms. While not recording, the
+   service call erases up to FLASH_LOG_ERASE_AHEAD sectors ahead of the
+   write position (at the cost of the oldest data there), so that a capture
+   can run that long without erasing.
+*/
+
+#define FLASH_LOG_MAGIC 0x474F4C41u // "ALOG"
+#define FLASH_LOG_HEADER_SIZE 16
+#define FLASH_LOG_RECORDS_PER_PAGE ((HAL_FLASH_PAGE_SIZE - FLASH_LOG_HEADER_SIZE) / TELEMETRY_RECORD_SIZE)
+#define FLASH_LOG_PAGES (LOG_FLASH_SIZE / HAL_FLASH_PAGE_SIZE)
+#define FLASH_LOG_PAGES_PER_SECTOR (HAL_FLASH_SECTOR_SIZE / HAL_FLASH_PAGE_SIZE)
+
+// 64 sectors is 1024 pages, 15360 records, 19.2 s at 800 Hz
+#define FLASH_LOG_ERASE_AHEAD 64
+
+// Pages buffered in RAM while waiting to be programmed
+#define FLASH_LOG_QUEUE_PAGES 8
+
+// Find the newest page written before reset
+void flash_log_init(void);
+
+void flash_log_start(void);
+// Pad out and queue the current page, it is written by the following services
+void flash_log_stop(void);
+bool flash_log_recording(void);
+
+void flash_log_put(const telemetry_record_t *record);
+// Program one queued page, or erase one sector ahead when idle
+void flash_log_service(void);
+
+// Write the records of the newest session to the console, oldest first, as
+// a telemetry stream. Stops recording first.
+void flash_log_dump(void);
+
+uint32_t flash_log_dropped(void);
+
+#endif
@@ -0,0 +1,99 @@
+#ifndef HAL_H
+#define HAL_H
+
+/* Thin hardware abstraction layer used by the drivers.
+
+   The firmware implements it on top of the Pico SDK in hal_pico.c. The host
+   build (see host/) implements it on top of simulated HT16K33, MMA8451Q and
+   74HC595 devices, so the same driver code can be built and measured on Linux.
+
+   Return values follow the SDK: number of bytes transferred, or
+   PICO_ERROR_GENERIC on failure.
+*/
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef HAL_HOST
+#define PICO_ERROR_GENERIC (-1)
+#ifndef count_of
+#define count_of(a) (sizeof(a)/sizeof((a)[0]))
+#endif
+#else
+#include "pico/stdlib.h"
+#endif
+
+// Bring up stdio, gpio, the i2c bus and the 74hc595 chain used by the board.
+void hal_init(void);
+// Per core setup, hal_init() does it for core 0. Call it first thing on core 1.
+void hal_core_init(void);
+
+// Non-blocking transfer on I2C_PORT: write tx, then after a repeated start
+// read rx, then STOP. Either half may be empty. done() is called from the
+// I2C interrupt with the number of bytes transferred or PICO_ERROR_GENERIC.
+// Only one transfer may be in flight, see i2c_async.h for the queue on top.
+#define HAL_I2C_XFER_MAX 256
+typedef void (*hal_i2c_done_t)(int result);
+bool hal_i2c_xfer_start(uint8_t addr, const uint8_t *tx, size_t tx_len,
+                        uint8_t *rx, size_t rx_len, hal_i2c_done_t done);
+
+// Actual SCL rate of I2C_PORT, for estimating how long a transfer takes
+uint32_t hal_i2c_baudrate(void);
+// Change the SCL rate while no transfer is in flight. hal_init() starts the
+// bus at 100 kHz. Returns the rate actually set.
+uint32_t hal_i2c_set_baudrate(uint32_t hz);
+
+// Take or give up the I2C interrupt, and with it the done() callbacks, on
+// the calling core. hal_init() enables it on core 0.
+void hal_i2c_irq_enable(bool enabled);
+
+// Shift 24 bits into the 74HC595 chain, MSB first, and latch them to the
+// outputs. Returns once the word is queued, the shift runs in the background.
+void hal_hc595_write(uint32_t bits);
+
+// Log region of the boot flash, LOG_FLASH_SIZE bytes at LOG_FLASH_OFFSET,
+// and the calibration sector after it. Offsets are relative to
+// LOG_FLASH_OFFSET. Erase and program stall both cores while they run,
+// since code executes from the same flash.
+#define HAL_FLASH_PAGE_SIZE 256
+#define HAL_FLASH_SECTOR_SIZE 4096
+bool hal_flash_erase_sector(uint32_t offset);
+bool hal_flash_program_page(uint32_t offset, const uint8_t *src);
+void hal_flash_read(uint32_t offset, uint8_t *dst, size_t len);
+
+// Raw bytes to the console (USB CDC on the Pico), without newline
+// translation. Returns the number of bytes taken.
+int hal_stdio_write(const uint8_t *src, size_t len);
+
+bool hal_gpio_get(unsigned int gpio);
+void hal_gpio_put(unsigned int gpio, bool value);
+// Levels of all gpios in one read, bit n is gpio n
+uint64_t hal_gpio_get_all(void);
+
+// Falling edge interrupt on an input pin. Pass NULL to disable it.
+typedef void (*hal_gpio_irq_handler_t)(unsigned int gpio);
+void hal_gpio_set_irq(unsigned int gpio, hal_gpio_irq_handler_t handler);
+// Same on both edges
+void hal_gpio_set_change_irq(unsigned int gpio, hal_gpio_irq_handler_t handler);
+
+// Mask interrupts around bus transactions that an interrupt handler could
+// otherwise split, and keep the other core out. Calls nest, pass the
+// returned state back to restore it.
+uint32_t hal_enter_critical(void);
+void hal_exit_critical(uint32_t state);
+
+// Wait until an interrupt or event has happened. Callers re-check their
+// condition in a loop.
+void hal_wait_for_event(void);
+// Same, but give up at deadline_us. Returns true if the deadline passed.
+bool hal_wait_for_event_until(uint64_t deadline_us);
+
+void hal_sleep_ms(uint32_t ms);
+uint64_t hal_time_us(void);
+
+// Free running cycle counter of the calling core, wraps every ~28 s at 150 MHz
+uint32_t hal_cycles(void);
+uint32_t hal_cycles_per_us(void);
+
+#endif
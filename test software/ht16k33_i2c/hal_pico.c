@@ -0,0 +1,351 @@
+#include <string.h>
+#include "pico/stdlib.h"
+#include "hardware/i2c.h"
+#include "hardware/gpio.h"
+#include "hardware/sync.h"
+#include "hardware/dma.h"
+#include "hardware/irq.h"
+#include "hardware/pio.h"
+#include "hardware/flash.h"
+#include "hardware/clocks.h"
+#include "hardware/structs/m33.h"
+#include "pico/binary_info.h"
+#include "pico/platform.h"
+#include "pico/stdio_usb.h"
+#include "pico/flash.h"
+
+#include "board.h"
+#include "hal.h"
+#include "hc595.pio.h"
+
+static hal_gpio_irq_handler_t gpio_irq_handlers[NUM_BANK0_GPIOS];
+
+// Critical sections are shared by both cores. The spin lock is taken once
+// per core and the nesting depth counted, since it is not recursive.
+static spin_lock_t *critical_lock;
+static volatile int critical_owner = -1;
+static int critical_depth;
+
+// The SDK has a single gpio callback per core, dispatch from it per pin
+static void gpio_irq_dispatch(uint gpio, uint32_t events) {
+    (void)events;
+    if (gpio < NUM_BANK0_GPIOS && gpio_irq_handlers[gpio])
+        gpio_irq_handlers[gpio](gpio);
+}
+
+/* I2C transfers run from DMA. The TX channel feeds IC_DATA_CMD with one
+   command word per byte (data, read, RESTART and STOP flags), the RX channel
+   empties the receive FIFO, and the I2C interrupt reports completion on
+   STOP_DET or failure on TX_ABRT. */
+static int i2c_tx_dma;
+static int i2c_rx_dma;
+static uint32_t i2c_cmd[HAL_I2C_XFER_MAX];
+static hal_i2c_done_t i2c_done;
+static int i2c_len;
+static bool i2c_aborted;
+static uint32_t i2c_baudrate;
+
+static void i2c_irq_handler(void) {
+    i2c_hw_t *hw = i2c_get_hw(I2C_PORT);
+    uint32_t status = hw->intr_stat;
+
+    if (status & I2C_IC_INTR_STAT_R_TX_ABRT_BITS) {
+        // The TX FIFO is held flushed until TX_ABRT is cleared. Stop both
+        // channels first, or the rest of the command words would go out on
+        // the bus as a transfer of their own.
+        dma_channel_abort(i2c_tx_dma);
+        dma_channel_abort(i2c_rx_dma);
+        (void)hw->clr_tx_abrt;
+        i2c_aborted = true;
+    }
+    if (status & I2C_IC_INTR_STAT_R_STOP_DET_BITS) {
+        (void)hw->clr_stop_det;
+        // the last received byte may still be on its way to memory
+        while (dma_channel_is_busy(i2c_rx_dma))
+            tight_loop_contents();
+
+        hal_i2c_done_t done = i2c_done;
+        i2c_done = NULL;
+        if (done)
+            done(i2c_aborted ? PICO_ERROR_GENERIC : i2c_len);
+        // wake a blocking waiter on the other core
+        __sev();
+    }
+}
+
+// The 74HC595 chain is driven by a PIO state machine, one word per update
+static PIO hc595_pio;
+static uint hc595_sm;
+static int hc595_dma;
+static uint32_t hc595_word;
+
+static void hc595_pio_init(void) {
+    uint offset;
+
+    // PIN_SHCP..PIN_OE are above GPIO 31, which moves the PIO's GPIO base
+    hard_assert(pio_claim_free_sm_and_add_program_for_gpio_range(&hc595_program, &hc595_pio, &hc595_sm, &offset,
+                                                                 PIN_SHCP, PIN_OE - PIN_SHCP + 1, true));
+    hc595_program_init(hc595_pio, hc595_sm, offset, PIN_SHCP, PIN_DS, PIN_STCP, HC595_SHIFT_HZ);
+
+    hc595_dma = dma_claim_unused_channel(true);
+    dma_channel_config c = dma_channel_get_default_config(hc595_dma);
+    channel_config_set_transfer_data_size(&c, DMA_SIZE_32);
+    channel_config_set_read_increment(&c, false);
+    channel_config_set_write_increment(&c, false);
+    channel_config_set_dreq(&c, pio_get_dreq(hc595_pio, hc595_sm, true));
+    dma_channel_configure(hc595_dma, &c, &hc595_pio->txf[hc595_sm], &hc595_word, 1, false);
+}
+
+static void i2c_dma_init(void) {
+    i2c_hw_t *hw = i2c_get_hw(I2C_PORT);
+    dma_channel_config c;
+
+    i2c_tx_dma = dma_claim_unused_channel(true);
+    c = dma_channel_get_default_config(i2c_tx_dma);
+    channel_config_set_transfer_data_size(&c, DMA_SIZE_32);
+    channel_config_set_read_increment(&c, true);
+    channel_config_set_write_increment(&c, false);
+    channel_config_set_dreq(&c, i2c_get_dreq(I2C_PORT, true));
+    dma_channel_set_config(i2c_tx_dma, &c, false);
+    dma_channel_set_write_addr(i2c_tx_dma, &hw->data_cmd, false);
+
+    i2c_rx_dma = dma_claim_unused_channel(true);
+    c = dma_channel_get_default_config(i2c_rx_dma);
+    channel_config_set_transfer_data_size(&c, DMA_SIZE_8);
+    channel_config_set_read_increment(&c, false);
+    channel_config_set_write_increment(&c, true);
+    channel_config_set_dreq(&c, i2c_get_dreq(I2C_PORT, false));
+    dma_channel_set_config(i2c_rx_dma, &c, false);
+    dma_channel_set_read_addr(i2c_rx_dma, &hw->data_cmd, false);
+
+    // i2c_init() already enables the DMA handshake in IC_DMA_CR
+    hw->intr_mask = I2C_IC_INTR_MASK_M_STOP_DET_BITS | I2C_IC_INTR_MASK_M_TX_ABRT_BITS;
+    irq_set_exclusive_handler(I2C0_IRQ + i2c_get_index(I2C_PORT), i2c_irq_handler);
+    hal_i2c_irq_enable(true);
+}
+
+// Plain gpios, set up a group at a time with the masked SIO operations
+static const struct {
+    uint64_t mask;
+    bool output;
+    bool high;              // initial level of outputs
+    bool pull_up;
+} gpio_table[] = {
+    { LED_MASK, true, false, false },               // traffic light leds, off
+    { GPIO_BIT(PIN_MR), true, true, false },        // 74hc595 reset, released
+    { BUTTON_MASK | SWITCH_MASK, false, false, true },
+    { ACCEL_INT_MASK, false, false, true },         // open drain
+};
+
+static void hal_gpio_init_table(void) {
+    for (size_t i = 0; i < count_of(gpio_table); i++) {
+        uint64_t mask = gpio_table[i].mask;
+
+        // level before direction, so an output never glitches
+        gpio_put_masked64(mask, gpio_table[i].high ? mask : 0);
+        if (gpio_table[i].output)
+            gpio_set_dir_out_masked64(mask);
+        else
+            gpio_set_dir_in_masked64(mask);
+        // the pads have no shared register, pulls go one pin at a time
+        for (uint64_t pins = mask; pins; pins &= pins - 1)
+            gpio_set_pulls(__builtin_ctzll(pins), gpio_table[i].pull_up, false);
+        gpio_set_function_masked64(mask, GPIO_FUNC_SIO);
+    }
+}
+
+void hal_init(void) {
+    stdio_init_all();
+    hal_core_init();
+
+    critical_lock = spin_lock_init(spin_lock_claim_unused(true));
+
+    hal_gpio_init_table();
+
+/*#if !defined(I2C_PORT) || !defined(I2C_SDA_PIN) || !defined(I2C_SCL_PIN)
+    #warning i2c/ht16k33_i2c example requires a board with I2C pins
+#endif*/
+    // This example will use I2C0 on the default SDA and SCL pins (4, 5 on a Pico)
+    i2c_baudrate = i2c_init(I2C_PORT, 100 * 1000);
+    gpio_set_function(I2C_SDA_PIN, GPIO_FUNC_I2C);
+    gpio_set_function(I2C_SCL_PIN, GPIO_FUNC_I2C);
+    gpio_pull_up(I2C_SDA_PIN);
+    gpio_pull_up(I2C_SCL_PIN);
+    // Make the I2C pins available to picotool
+    bi_decl(bi_2pins_with_func(I2C_SDA_PIN, I2C_SCL_PIN, GPIO_FUNC_I2C));
+    i2c_dma_init();
+
+    // init 74hc595 chain, MR stays a plain gpio from the table
+    hc595_pio_init();
+}
+
+bool hal_i2c_xfer_start(uint8_t addr, const uint8_t *tx, size_t tx_len,
+                        uint8_t *rx, size_t rx_len, hal_i2c_done_t done) {
+    i2c_hw_t *hw = i2c_get_hw(I2C_PORT);
+    size_t n = 0;
+
+    if (tx_len + rx_len == 0 || tx_len + rx_len > HAL_I2C_XFER_MAX)
+        return false;
+
+    for (size_t i = 0; i < tx_len; i++) {
+        uint32_t cmd = tx[i];
+        if (i == tx_len - 1 && rx_len == 0)
+            cmd |= I2C_IC_DATA_CMD_STOP_BITS;
+        i2c_cmd[n++] = cmd;
+    }
+    for (size_t i = 0; i < rx_len; i++) {
+        uint32_t cmd = I2C_IC_DATA_CMD_CMD_BITS;
+        if (i == 0 && tx_len)
+            cmd |= I2C_IC_DATA_CMD_RESTART_BITS;
+        if (i == rx_len - 1)
+            cmd |= I2C_IC_DATA_CMD_STOP_BITS;
+        i2c_cmd[n++] = cmd;
+    }
+
+    // the target address can only change while the controller is disabled
+    hw->enable = 0;
+    hw->tar = addr;
+    hw->enable = 1;
+
+    i2c_done = done;
+    i2c_len = (int)(tx_len + rx_len);
+    i2c_aborted = false;
+    if (rx_len)
+        dma_channel_transfer_to_buffer_now(i2c_rx_dma, rx, rx_len);
+    dma_channel_transfer_from_buffer_now(i2c_tx_dma, i2c_cmd, n);
+    return true;
+}
+
+uint32_t hal_i2c_baudrate(void) {
+    return i2c_baudrate;
+}
+
+// i2c_set_baudrate() also picks the spike filter and SDA hold time for the
+// speed, and leaves the DMA handshake alone
+uint32_t hal_i2c_set_baudrate(uint32_t hz) {
+    i2c_baudrate = i2c_set_baudrate(I2C_PORT, hz);
+    return i2c_baudrate;
+}
+
+void hal_i2c_irq_enable(bool enabled) {
+    irq_set_enabled(I2C0_IRQ + i2c_get_index(I2C_PORT), enabled);
+}
+
+void hal_hc595_write(uint32_t bits) {
+    // the DMA reads hc595_word as soon as the TX FIFO has room
+    dma_channel_wait_for_finish_blocking(hc595_dma);
+    hc595_word = bits << 8;
+    dma_channel_set_read_addr(hc595_dma, &hc595_word, true);
+}
+
+// flash_safe_execute() parks the other core and masks interrupts around these
+typedef struct {
+    uint32_t offset;
+    const uint8_t *src;
+} flash_op_t;
+
+static void flash_erase_op(void *param) {
+    const flash_op_t *op = param;
+    flash_range_erase(LOG_FLASH_OFFSET + op->offset, FLASH_SECTOR_SIZE);
+}
+
+static void flash_program_op(void *param) {
+    const flash_op_t *op = param;
+    flash_range_program(LOG_FLASH_OFFSET + op->offset, op->src, FLASH_PAGE_SIZE);
+}
+
+bool hal_flash_erase_sector(uint32_t offset) {
+    flash_op_t op = {.offset = offset};
+    return flash_safe_execute(flash_erase_op, &op, 100) == PICO_OK;
+}
+
+bool hal_flash_program_page(uint32_t offset, const uint8_t *src) {
+    flash_op_t op = {.offset = offset, .src = src};
+    return flash_safe_execute(flash_program_op, &op, 100) == PICO_OK;
+}
+
+void hal_flash_read(uint32_t offset, uint8_t *dst, size_t len) {
+    memcpy(dst, (const uint8_t *)(XIP_BASE + LOG_FLASH_OFFSET + offset), len);
+}
+
+int hal_stdio_write(const uint8_t *src, size_t len) {
+    // straight to the CDC driver, printf would translate LF to CRLF
+    stdio_usb.out_chars((const char *)src, (int)len);
+    return (int)len;
+}
+
+bool hal_gpio_get(unsigned int gpio) {
+    return gpio_get(gpio);
+}
+
+void hal_gpio_put(unsigned int gpio, bool value) {
+    gpio_put(gpio, value);
+}
+
+uint64_t hal_gpio_get_all(void) {
+    return gpio_get_all64();
+}
+
+void hal_gpio_set_irq(unsigned int gpio, hal_gpio_irq_handler_t handler) {
+    gpio_irq_handlers[gpio] = handler;
+    gpio_set_irq_enabled_with_callback(gpio, GPIO_IRQ_EDGE_FALL, handler != NULL, gpio_irq_dispatch);
+}
+
+void hal_gpio_set_change_irq(unsigned int gpio, hal_gpio_irq_handler_t handler) {
+    gpio_irq_handlers[gpio] = handler;
+    gpio_set_irq_enabled_with_callback(gpio, GPIO_IRQ_EDGE_FALL | GPIO_IRQ_EDGE_RISE, handler != NULL,
+                                       gpio_irq_dispatch);
+}
+
+uint32_t hal_enter_critical(void) {
+    uint32_t state = save_and_disable_interrupts();
+    int core = (int)get_core_num();
+
+    if (critical_owner != core) {
+        spin_lock_unsafe_blocking(critical_lock);
+        critical_owner = core;
+    }
+    critical_depth++;
+    return state;
+}
+
+void hal_exit_critical(uint32_t state) {
+    if (--critical_depth == 0) {
+        critical_owner = -1;
+        spin_unlock_unsafe(critical_lock);
+    }
+    restore_interrupts(state);
+}
+
+void hal_wait_for_event(void) {
+    __wfe();
+}
+
+// The SDK arms a timer alarm that signals an event at the deadline, so the
+// core sleeps in WFE rather than polling the timer
+bool hal_wait_for_event_until(uint64_t deadline_us) {
+    return best_effort_wfe_or_timeout(from_us_since_boot(deadline_us));
+}
+
+void hal_sleep_ms(uint32_t ms) {
+    sleep_ms(ms);
+}
+
+uint64_t hal_time_us(void) {
+    return time_us_64();
+}
+
+// The DWT is per core, so each core starts its own counter
+void hal_core_init(void) {
+    m33_hw->demcr |= M33_DEMCR_TRCENA_BITS;
+    m33_hw->dwt_cyccnt = 0;
+    m33_hw->dwt_ctrl |= M33_DWT_CTRL_CYCCNTENA_BITS;
+}
+
+uint32_t hal_cycles(void) {
+    return m33_hw->dwt_cyccnt;
+}
+
+uint32_t hal_cycles_per_us(void) {
+    return clock_get_hz(clk_sys) / 1000000;
+}
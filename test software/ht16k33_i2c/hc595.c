@@ -0,0 +1,12 @@
+#include "hal.h"
+#include "hc595.h"
+#include "prof.h"
+
+PROF_HIST(prof_hc595, "hc595 write");
+
+void hc595_write(const uint8_t data[HC595_CHAIN_LEN]) {
+    PROF_BEGIN(prof_hc595);
+    // the last register's byte is shifted in first
+    hal_hc595_write(((uint32_t)data[2] << 16) | ((uint32_t)data[1] << 8) | data[0]);
+    PROF_END(prof_hc595);
+}
@@ -0,0 +1,15 @@
+#ifndef HC595_H
+#define HC595_H
+
+#include <stdint.h>
+
+// Chain of three 74HC595 shift registers driving the switch LEDs.
+// On the Pico the chain is shifted and latched by a PIO state machine fed
+// from DMA, so an update costs the CPU one word.
+
+#define HC595_CHAIN_LEN 3
+
+// data[0] goes to the first register in the chain, the one next to the Pico
+void hc595_write(const uint8_t data[HC595_CHAIN_LEN]);
+
+#endif
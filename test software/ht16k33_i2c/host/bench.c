@@ -0,0 +1,513 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+#include "board.h"
+#include "hal.h"
+#include "accel.h"
+#include "dsp.h"
+#include "ht16k33.h"
+#include "i2c_async.h"
+#include "i2c_bus.h"
+#include "input.h"
+#include "sample_ring.h"
+#include "telemetry.h"
+#include "sim.h"
+
+// Replays a recorded trace, or the simulated tilt, through the sample
+// pipeline in several configurations and reports what each costs on the
+// host: samples per CPU second, CPU time per stage per sample, I2C bytes per
+// sample and samples dropped. Each configuration runs in a process of its
+// own from a fresh board, so none inherits driver state from another.
+//
+// The results can be saved as a baseline and later runs compared against
+// it, failing on any metric that got worse by more than the tolerance.
+
+#define BENCH_SERVICE_US (100 * 1000)
+// The display shows Z in mg, refreshed like a readout would be
+#define BENCH_DISPLAY_US (100 * 1000)
+
+typedef struct {
+    const char *name;
+    bool poll;              // blocking accel_read_data() once per sample period
+    uint8_t watermark;      // FIFO batches, 0 for data-ready interrupts
+    bool dsp;               // DSP_CONFIG_DEFAULT between the ring and the output
+} bench_config_t;
+
+static const bench_config_t configs[] = {
+    { .name = "poll", .poll = true },
+    { .name = "drdy" },
+    { .name = "fifo", .watermark = 16 },
+    { .name = "fifo-dsp", .watermark = 16, .dsp = true },
+};
+#define NUM_CONFIGS (sizeof(configs) / sizeof(configs[0]))
+
+enum { STAGE_ACQUIRE, STAGE_INPUT, STAGE_DSP, STAGE_ENCODE, STAGE_DISPLAY, NUM_STAGES };
+static const char *const stage_names[NUM_STAGES] = {
+    [STAGE_ACQUIRE] = "acquire",
+    [STAGE_INPUT] = "input",
+    [STAGE_DSP] = "dsp",
+    [STAGE_ENCODE] = "encode",
+    [STAGE_DISPLAY] = "display",
+};
+
+typedef struct {
+    bool ok;
+    uint64_t samples;               // into the pipeline
+    uint64_t outputs;               // encoded, after the DSP
+    uint64_t cpu_ns;
+    uint64_t stage_ns[NUM_STAGES];
+    uint64_t i2c_bytes;             // after bring-up
+    uint64_t dropped;               // ring full, FIFO overflows, samples overwritten
+    uint32_t input_events;
+} bench_result_t;
+
+static struct {
+    const char *accel;
+    uint16_t odr_hz;
+    uint64_t duration_ns;
+    double speed;                   // board time per wall time, 0 for as fast as possible
+    int repeat;
+} options = {
+    .accel = "mma8451q",
+    .odr_hz = ACCEL_ODR_HZ,
+    .duration_ns = 60000000000ull,
+    .speed = 0,
+    .repeat = 3,
+};
+
+static uint64_t cpu_time_ns(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static uint64_t wall_time_ns(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+#define STAGE_BEGIN() uint64_t stage_start = cpu_time_ns()
+#define STAGE_END(r, stage) (r)->stage_ns[stage] += cpu_time_ns() - stage_start
+
+static const i2c_bus_device_t bus_devices[] = {
+    { "ht16k33", ht16k33_probe },
+    { "accel", accel_probe },
+};
+
+static sample_ring_t ring;
+static dsp_t dsp;
+
+static bool bench_setup(const bench_config_t *config) {
+    sim_init(100 * 1000, HC595_SHIFT_HZ);
+    sim_ht16k33_attach();
+    if (!strcmp(options.accel, "lis2dw12"))
+        sim_lis2dw12_attach();
+    else
+        sim_mma8451q_attach();
+    sim_74hc595_attach();
+    sim_w25q128_attach();
+    sim_trace_attach();
+    hal_init();
+
+    if (!i2c_bus_init(I2C_BUS_HZ, bus_devices, 2))
+        return false;
+    ht16k33_init();
+    input_init();
+    accel_config_t accel = { .odr_hz = options.odr_hz, .range_g = ACCEL_RANGE_G };
+    if (!accel_init(&accel))
+        return false;
+    sample_ring_init(&ring);
+    if (config->dsp) {
+        const dsp_config_t dsp_config = DSP_CONFIG_DEFAULT(options.odr_hz);
+        if (!dsp_init(&dsp, &dsp_config, 1e6f / accel_odr_period_us()))
+            return false;
+    }
+    if (config->poll)
+        return true;
+    if (config->watermark)
+        return accel_enable_fifo_irq(config->watermark, &ring);
+    return accel_enable_data_ready_irq(&ring);
+}
+
+static void bench_display(int16_t z) {
+    char digits[16];
+
+    snprintf(digits, sizeof(digits), "%4ld", (long)accel_q12_to_mg(z) % 10000);
+    for (int i = 0; i < NUM_DIGITS; i++)
+        ht16k33_display_char(i, digits[i]);
+    ht16k33_flush();
+}
+
+static void bench_run(const bench_config_t *config, bench_result_t *r) {
+    accel_sample_t block[32];
+    uint8_t record[TELEMETRY_RECORD_SIZE];
+    int16_t last_z = 0;
+
+    memset(r, 0, sizeof(*r));
+    if (!bench_setup(config))
+        return;
+
+    uint64_t start_us = hal_time_us();
+    uint64_t end_us = start_us + options.duration_ns / 1000;
+    uint64_t period_us = accel_odr_period_us();
+    uint64_t next_poll_us = start_us;
+    uint64_t next_service_us = start_us + BENCH_SERVICE_US;
+    uint64_t next_display_us = start_us + BENCH_DISPLAY_US;
+    uint64_t next_scan_us = start_us;
+    uint64_t i2c_bytes_start = sim_i2c_stats.bytes;
+    uint64_t wall_start_ns = wall_time_ns();
+    uint64_t cpu_start_ns = cpu_time_ns();
+
+    for (uint64_t now_us = start_us; now_us < end_us; now_us = hal_time_us()) {
+        uint64_t deadline_us = end_us;
+        if (config->poll && next_poll_us < deadline_us)
+            deadline_us = next_poll_us;
+        if (next_service_us < deadline_us)
+            deadline_us = next_service_us;
+        if (next_display_us < deadline_us)
+            deadline_us = next_display_us;
+        if (input_busy() && next_scan_us < deadline_us)
+            deadline_us = next_scan_us;
+
+        // waiting covers the interrupt side: the driver reads, the bus and
+        // the simulated devices
+        {
+            STAGE_BEGIN();
+            if (deadline_us > now_us)
+                hal_wait_for_event_until(deadline_us);
+            now_us = hal_time_us();
+            if (config->poll && now_us >= next_poll_us) {
+                accel_sample_t sample = { .timestamp_us = now_us };
+                if (accel_read_data(&sample.x, &sample.y, &sample.z))
+                    sample_ring_push(&ring, &sample);
+                next_poll_us += period_us;
+            }
+            if (now_us >= next_service_us) {
+                accel_service_irq();
+                i2c_bus_service();
+                next_service_us += BENCH_SERVICE_US;
+            }
+            STAGE_END(r, STAGE_ACQUIRE);
+        }
+        if (input_wake_pending() || (input_busy() && now_us >= next_scan_us)) {
+            STAGE_BEGIN();
+            input_event_t event;
+            input_scan(now_us);
+            next_scan_us = now_us + INPUT_SCAN_PERIOD_US;
+            while (input_event_pop(&event))
+                r->input_events++;
+            STAGE_END(r, STAGE_INPUT);
+        }
+
+        size_t count;
+        while ((count = sample_ring_pop_block(&ring, block, sizeof(block) / sizeof(block[0]))) > 0) {
+            r->samples += count;
+            if (config->dsp) {
+                STAGE_BEGIN();
+                count = dsp_process(&dsp, block, count);
+                STAGE_END(r, STAGE_DSP);
+            }
+            STAGE_BEGIN();
+            uint16_t inputs = ((input_state() >> BTN1) & 0x0f) | (((input_state() >> SW1) & 0xff) << 4);
+            for (size_t i = 0; i < count; i++) {
+                telemetry_record_t rec = {
+                    .timestamp_us = block[i].timestamp_us,
+                    .x = block[i].x,
+                    .y = block[i].y,
+                    .z = block[i].z,
+                    .inputs = inputs,
+                };
+                telemetry_encode(&rec, (uint8_t)r->outputs++, 0, record);
+                last_z = block[i].z;
+            }
+            STAGE_END(r, STAGE_ENCODE);
+        }
+
+        if (now_us >= next_display_us) {
+            STAGE_BEGIN();
+            bench_display(last_z);
+            next_display_us += BENCH_DISPLAY_US;
+            STAGE_END(r, STAGE_DISPLAY);
+        }
+
+        if (options.speed > 0) {
+            uint64_t due_ns = wall_start_ns + (uint64_t)((now_us - start_us) * 1000 / options.speed);
+            uint64_t wall_ns = wall_time_ns();
+            if (due_ns > wall_ns) {
+                struct timespec ts = { .tv_sec = (due_ns - wall_ns) / 1000000000,
+                                       .tv_nsec = (due_ns - wall_ns) % 1000000000 };
+                nanosleep(&ts, NULL);
+            }
+        }
+    }
+
+    r->cpu_ns = cpu_time_ns() - cpu_start_ns;
+    r->i2c_bytes = sim_i2c_stats.bytes - i2c_bytes_start;
+    r->dropped = atomic_load(&ring.dropped) + accel_fifo_overflows();
+    if (!config->poll)
+        r->dropped += accel_timebase()->lost;
+    r->ok = true;
+}
+
+// Each run in a child of its own, the result comes back over a pipe
+static bool bench_fork(const bench_config_t *config, bench_result_t *r) {
+    int fds[2];
+    int status;
+
+    fflush(stdout);
+    if (pipe(fds) < 0)
+        return false;
+    pid_t pid = fork();
+    if (pid < 0)
+        return false;
+    if (pid == 0) {
+        close(fds[0]);
+        // driver chatter stays out of the table
+        if (!freopen("/dev/null", "w", stdout))
+            _exit(EXIT_FAILURE);
+        bench_run(config, r);
+        _exit(write(fds[1], r, sizeof(*r)) == sizeof(*r) ? EXIT_SUCCESS : EXIT_FAILURE);
+    }
+    close(fds[1]);
+    bool ok = read(fds[0], r, sizeof(*r)) == sizeof(*r);
+    close(fds[0]);
+    waitpid(pid, &status, 0);
+    return ok && r->ok && WIFEXITED(status) && WEXITSTATUS(status) == EXIT_SUCCESS;
+}
+
+// Metrics kept in a baseline. CPU time varies from run to run, so a change
+// in a stage only counts if it is also more than floor ns per sample.
+enum { METRIC_HIGHER_BETTER, METRIC_LOWER_BETTER };
+
+typedef struct {
+    char name[32];
+    double value;
+    int direction;
+    double floor;
+} metric_t;
+
+#define NUM_METRICS (3 + NUM_STAGES)
+
+static int bench_metrics(const bench_result_t *r, metric_t m[NUM_METRICS]) {
+    double samples = r->samples ? (double)r->samples : 1;
+    int n = 0;
+
+    m[n++] = (metric_t){ "samples_per_s", r->cpu_ns ? r->samples * 1e9 / r->cpu_ns : 0, METRIC_HIGHER_BETTER, 0 };
+    for (int stage = 0; stage < NUM_STAGES; stage++) {
+        snprintf(m[n].name, sizeof(m[n].name), "%s_ns", stage_names[stage]);
+        m[n].value = r->stage_ns[stage] / samples;
+        m[n].direction = METRIC_LOWER_BETTER;
+        m[n].floor = 50;
+        n++;
+    }
+    m[n++] = (metric_t){ "i2c_bytes_per_sample", r->i2c_bytes / samples, METRIC_LOWER_BETTER, 0 };
+    m[n++] = (metric_t){ "dropped", (double)r->dropped, METRIC_LOWER_BETTER, 0 };
+    return n;
+}
+
+static void bench_print_header(void) {
+    printf("%-10s %9s %10s", "config", "samples", "samples/s");
+    for (int stage = 0; stage < NUM_STAGES; stage++)
+        printf(" %8s", stage_names[stage]);
+    printf(" %10s %8s\n", "i2c B/smp", "dropped");
+}
+
+static void bench_print(const char *name, const bench_result_t *r) {
+    metric_t m[NUM_METRICS];
+
+    bench_metrics(r, m);
+    printf("%-10s %9llu %10.0f", name, (unsigned long long)r->samples, m[0].value);
+    for (int stage = 0; stage < NUM_STAGES; stage++)
+        printf(" %8.0f", m[1 + stage].value);
+    printf(" %10.2f %8llu\n", m[1 + NUM_STAGES].value, (unsigned long long)r->dropped);
+}
+
+static bool bench_save(const char *path, const bench_result_t results[], const bool selected[]) {
+    FILE *out = fopen(path, "w");
+    metric_t m[NUM_METRICS];
+
+    if (!out)
+        return false;
+    fprintf(out, "# config metric value, from ht16k33_i2c_bench --accel %s --odr %u\n", options.accel, options.odr_hz);
+    for (size_t c = 0; c < NUM_CONFIGS; c++) {
+        if (!selected[c])
+            continue;
+        int n = bench_metrics(&results[c], m);
+        for (int i = 0; i < n; i++)
+            fprintf(out, "%s %s %.3f\n", configs[c].name, m[i].name, m[i].value);
+    }
+    return fclose(out) == 0;
+}
+
+// Returns the number of regressions, or -1 if the baseline cannot be read
+static int bench_compare(const char *path, const bench_result_t results[], const bool selected[],
+                         double tolerance) {
+    FILE *in = fopen(path, "r");
+    char line[128];
+    int regressions = 0;
+
+    if (!in)
+        return -1;
+    while (fgets(line, sizeof(line), in)) {
+        char config[32], metric[32];
+        double base;
+
+        if (line[0] == '#' || sscanf(line, "%31s %31s %lf", config, metric, &base) != 3)
+            continue;
+        for (size_t c = 0; c < NUM_CONFIGS; c++) {
+            metric_t m[NUM_METRICS];
+
+            if (!selected[c] || strcmp(configs[c].name, config))
+                continue;
+            int n = bench_metrics(&results[c], m);
+            for (int i = 0; i < n; i++) {
+                if (strcmp(m[i].name, metric))
+                    continue;
+                double change = m[i].value - base;
+                bool worse = m[i].direction == METRIC_HIGHER_BETTER
+                    ? change < -base * tolerance
+                    : change > base * tolerance && change > m[i].floor;
+                if (worse) {
+                    printf("regression: %s %s %.3f -> %.3f", config, metric, base, m[i].value);
+                    if (base != 0)
+                        printf(" (%+.1f%%)", 100 * change / base);
+                    printf("\n");
+                    regressions++;
+                }
+            }
+        }
+    }
+    fclose(in);
+    return regressions;
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr,
+            "usage: %s [--trace FILE] [--seconds S] [--speed X] [--config NAME]... [--accel PART]\n"
+            "          [--odr HZ] [--repeat N] [--save FILE] [--baseline FILE] [--tolerance PCT]\n"
+            "  --trace FILE   replay a telemetry_decode CSV or a binary telemetry capture, for\n"
+            "                 as long as it runs (default: the simulated tilt)\n"
+            "  --seconds S    board time to run without a trace (default 60)\n"
+            "  --speed X      pace board time at X times wall time, 0 runs as fast as the\n"
+            "                 host can (default 0)\n"
+            "  --config NAME  run only this pipeline, poll, drdy, fifo or fifo-dsp (default all)\n"
+            "  --accel PART   mma8451q (default) or lis2dw12\n"
+            "  --odr HZ       accelerometer data rate (default %u)\n"
+            "  --repeat N     runs per pipeline, the fastest counts (default 3)\n"
+            "  --save FILE    write the results as a baseline\n"
+            "  --baseline FILE\n"
+            "                 compare with a saved baseline, exit 1 on a regression\n"
+            "  --tolerance PCT\n"
+            "                 change allowed before a metric counts as worse (default 20)\n",
+            prog, ACCEL_ODR_HZ);
+}
+
+int main(int argc, char **argv) {
+    bool selected[NUM_CONFIGS] = { false };
+    bool any_selected = false;
+    const char *save_path = NULL;
+    const char *baseline_path = NULL;
+    double tolerance = 0.20;
+
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--trace") && i + 1 < argc) {
+            if (!sim_trace_load(argv[++i])) {
+                fprintf(stderr, "%s: no samples\n", argv[i]);
+                return EXIT_FAILURE;
+            }
+            options.duration_ns = sim_trace_duration_ns();
+        } else if (!strcmp(argv[i], "--seconds") && i + 1 < argc) {
+            options.duration_ns = (uint64_t)(strtod(argv[++i], NULL) * 1e9);
+        } else if (!strcmp(argv[i], "--speed") && i + 1 < argc) {
+            options.speed = strtod(argv[++i], NULL);
+        } else if (!strcmp(argv[i], "--config") && i + 1 < argc) {
+            size_t c;
+            for (c = 0; c < NUM_CONFIGS && strcmp(configs[c].name, argv[i + 1]); c++)
+                ;
+            if (c == NUM_CONFIGS) {
+                usage(argv[0]);
+                return EXIT_FAILURE;
+            }
+            selected[c] = any_selected = true;
+            i++;
+        } else if (!strcmp(argv[i], "--accel") && i + 1 < argc) {
+            options.accel = argv[++i];
+            if (strcmp(options.accel, "mma8451q") && strcmp(options.accel, "lis2dw12")) {
+                usage(argv[0]);
+                return EXIT_FAILURE;
+            }
+        } else if (!strcmp(argv[i], "--odr") && i + 1 < argc) {
+            options.odr_hz = strtoul(argv[++i], NULL, 0);
+        } else if (!strcmp(argv[i], "--repeat") && i + 1 < argc) {
+            options.repeat = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--save") && i + 1 < argc) {
+            save_path = argv[++i];
+        } else if (!strcmp(argv[i], "--baseline") && i + 1 < argc) {
+            baseline_path = argv[++i];
+        } else if (!strcmp(argv[i], "--tolerance") && i + 1 < argc) {
+            tolerance = strtod(argv[++i], NULL) / 100;
+        } else {
+            usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    if (options.odr_hz == 0 || options.repeat < 1 || options.speed < 0 || options.duration_ns == 0) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+    if (!any_selected) {
+        for (size_t c = 0; c < NUM_CONFIGS; c++)
+            selected[c] = true;
+    }
+
+    bench_result_t results[NUM_CONFIGS];
+    printf("%s at %u Hz, %.3f s of board time%s, CPU ns per sample per stage\n", options.accel, options.odr_hz,
+           options.duration_ns / 1e9, sim_trace_duration_ns() ? " from the trace" : "");
+    bench_print_header();
+    for (size_t c = 0; c < NUM_CONFIGS; c++) {
+        if (!selected[c])
+            continue;
+        // the bus and sample counts are the same every run, the CPU time is
+        // not, take the least of each stage
+        for (int run = 0; run < options.repeat; run++) {
+            bench_result_t r;
+            if (!bench_fork(&configs[c], &r)) {
+                fprintf(stderr, "%s: the pipeline did not start\n", configs[c].name);
+                return EXIT_FAILURE;
+            }
+            if (run == 0) {
+                results[c] = r;
+                continue;
+            }
+            if (r.cpu_ns < results[c].cpu_ns)
+                results[c].cpu_ns = r.cpu_ns;
+            for (int stage = 0; stage < NUM_STAGES; stage++) {
+                if (r.stage_ns[stage] < results[c].stage_ns[stage])
+                    results[c].stage_ns[stage] = r.stage_ns[stage];
+            }
+        }
+        bench_print(configs[c].name, &results[c]);
+    }
+
+    if (save_path && !bench_save(save_path, results, selected)) {
+        perror(save_path);
+        return EXIT_FAILURE;
+    }
+    if (baseline_path) {
+        int regressions = bench_compare(baseline_path, results, selected, tolerance);
+        if (regressions < 0) {
+            perror(baseline_path);
+            return EXIT_FAILURE;
+        }
+        printf("%d regressions against %s\n", regressions, baseline_path);
+        if (regressions)
+            return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,127 @@
+#include <stdio.h>
+#include "board.h"
+#include "hal.h"
+#include "sim.h"
+
+// HAL implementation for the host build, backed by the simulated board in sim.h
+
+void hal_init(void) {
+    // Buttons and switches idle high through their pull-ups
+    sim_gpio_set_input(BTN1, true);
+    sim_gpio_set_input(BTN2, true);
+    sim_gpio_set_input(BTN3, true);
+    sim_gpio_set_input(BTN4, true);
+
+    hal_gpio_put(PIN_STCP, false);
+    hal_gpio_put(PIN_OE, false);
+    hal_gpio_put(PIN_MR, true);
+}
+
+bool hal_i2c_xfer_start(uint8_t addr, const uint8_t *tx, size_t tx_len,
+                        uint8_t *rx, size_t rx_len, hal_i2c_done_t done) {
+    if (tx_len + rx_len > HAL_I2C_XFER_MAX)
+        return false;
+    return sim_i2c_xfer_start(addr, tx, tx_len, rx, rx_len, done);
+}
+
+uint32_t hal_i2c_baudrate(void) {
+    return sim_i2c_hz();
+}
+
+uint32_t hal_i2c_set_baudrate(uint32_t hz) {
+    sim_i2c_set_hz(hz);
+    return hz;
+}
+
+// The simulated board has a single core
+void hal_i2c_irq_enable(bool enabled) {
+    (void)enabled;
+}
+
+// The PIO shift is modeled as a serial transfer at the --spi-hz clock
+void hal_hc595_write(uint32_t bits) {
+    uint8_t data[3] = {bits >> 16, bits >> 8, bits};
+
+    sim_spi_write(data, sizeof(data));
+    sim_gpio_put(PIN_STCP, true);
+    hal_gpio_put(PIN_STCP, false);
+}
+
+bool hal_flash_erase_sector(uint32_t offset) {
+    return sim_flash_erase(offset, HAL_FLASH_SECTOR_SIZE);
+}
+
+bool hal_flash_program_page(uint32_t offset, const uint8_t *src) {
+    return sim_flash_program(offset, src, HAL_FLASH_PAGE_SIZE);
+}
+
+void hal_flash_read(uint32_t offset, uint8_t *dst, size_t len) {
+    sim_flash_read(offset, dst, len);
+}
+
+// Through stdout, so the host runner can charge it to the modeled USB link
+int hal_stdio_write(const uint8_t *src, size_t len) {
+    size_t written = fwrite(src, 1, len, stdout);
+
+    fflush(stdout);
+    return (int)written;
+}
+
+bool hal_gpio_get(unsigned int gpio) {
+    return sim_gpio_get(gpio);
+}
+
+void hal_gpio_put(unsigned int gpio, bool value) {
+    sim_gpio_put(gpio, value);
+}
+
+uint64_t hal_gpio_get_all(void) {
+    return sim_gpio_get_all();
+}
+
+void hal_gpio_set_irq(unsigned int gpio, hal_gpio_irq_handler_t handler) {
+    sim_gpio_set_irq(gpio, handler);
+}
+
+void hal_gpio_set_change_irq(unsigned int gpio, hal_gpio_irq_handler_t handler) {
+    sim_gpio_set_change_irq(gpio, handler);
+}
+
+uint32_t hal_enter_critical(void) {
+    return sim_irq_disable();
+}
+
+void hal_exit_critical(uint32_t state) {
+    sim_irq_restore(state);
+}
+
+void hal_wait_for_event(void) {
+    sim_wait_for_event();
+}
+
+bool hal_wait_for_event_until(uint64_t deadline_us) {
+    return sim_wait_until(deadline_us * 1000);
+}
+
+void hal_sleep_ms(uint32_t ms) {
+    sim_advance_ns((uint64_t)ms * 1000000);
+}
+
+uint64_t hal_time_us(void) {
+    return sim_time_ns() / 1000;
+}
+
+void hal_core_init(void) {
+}
+
+// Simulated time at the RP2350 default clock. Only bus, flash and console
+// time is modeled, code runs in zero time.
+#define HOST_CYCLES_PER_US 150
+
+uint32_t hal_cycles(void) {
+    return (uint32_t)(sim_time_ns() * HOST_CYCLES_PER_US / 1000);
+}
+
+uint32_t hal_cycles_per_us(void) {
+    return HOST_CYCLES_PER_US;
+}
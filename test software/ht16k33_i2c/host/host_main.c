@@ -0,0 +1,184 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "board.h"
+#include "hal.h"
+#include "app.h"
+#include "boot.h"
+#include "sim.h"
+
+// Runs the firmware main loop against the simulated board and reports bus
+// usage. Firmware output goes to stdout, the report to stderr.
+
+// Inputs held low (pressed, or switched on) for a while, from --hold
+#define MAX_HOLDS 16
+
+static struct {
+    unsigned int gpio;
+    uint64_t start_ns;
+    uint64_t end_ns;
+} holds[MAX_HOLDS];
+static int num_holds;
+
+static uint64_t holds_tick(uint64_t now_ns) {
+    uint64_t next = UINT64_MAX;
+    uint64_t low = 0;
+
+    for (int i = 0; i < num_holds; i++) {
+        bool held = now_ns >= holds[i].start_ns && now_ns < holds[i].end_ns;
+        if (held)
+            low |= 1ull << holds[i].gpio;
+        if (now_ns < holds[i].start_ns && holds[i].start_ns < next)
+            next = holds[i].start_ns;
+        else if (held && holds[i].end_ns < next)
+            next = holds[i].end_ns;
+    }
+    // several holds may share a pin
+    for (int i = 0; i < num_holds; i++)
+        sim_gpio_set_input(holds[i].gpio, !(low & (1ull << holds[i].gpio)));
+    return next;
+}
+
+// GPIO@MS+MS
+static bool parse_hold(const char *arg) {
+    unsigned int gpio;
+    unsigned long start_ms, len_ms;
+
+    if (num_holds == MAX_HOLDS || sscanf(arg, "%u@%lu+%lu", &gpio, &start_ms, &len_ms) != 3 ||
+        gpio >= SIM_NUM_GPIOS)
+        return false;
+    holds[num_holds].gpio = gpio;
+    holds[num_holds].start_ns = start_ms * 1000000ull;
+    holds[num_holds].end_ns = (start_ms + len_ms) * 1000000ull;
+    num_holds++;
+    return true;
+}
+
+// KIND@MS+MS
+static bool parse_motion(const char *arg) {
+    char kind[16];
+    unsigned long start_ms, len_ms;
+
+    if (sscanf(arg, "%15[a-z]@%lu+%lu", kind, &start_ms, &len_ms) != 3)
+        return false;
+    return sim_motion_add(kind, start_ms * 1000000ull, (start_ms + len_ms) * 1000000ull);
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr,
+            "usage: %s [--loops N] [--i2c-max-hz HZ] [--spi-hz HZ] [--hold GPIO@MS+MS]...\n"
+            "          [--motion KIND@MS+MS]... [--trace FILE] [--accel PART] [--flash FILE] [--quiet]\n"
+            "  --loops N    main loop iterations to run (default 100)\n"
+            "  --i2c-max-hz HZ\n"
+            "               fastest i2c clock the devices follow (default 400000), the\n"
+            "               firmware picks its bus speed by probing them\n"
+            "  --spi-hz HZ  modeled 74hc595 shift clock (default %u)\n"
+            "  --hold GPIO@MS+MS\n"
+            "               hold an input low from a time for a duration, e.g. %u@500+1000\n"
+            "               presses button 1 at 0.5 s for 1 s\n"
+            "  --motion KIND@MS+MS\n"
+            "               move the accelerometer, KIND is tap, shake, drop or tilt,\n"
+            "               e.g. tap@500+10\n"
+            "  --trace FILE replay the motion, buttons and switches of a telemetry_decode CSV\n"
+            "               or a binary telemetry capture\n"
+            "  --accel PART accelerometer fitted, mma8451q (default) or lis2dw12\n"
+            "  --flash FILE boot flash image, loaded at start if it exists and saved at\n"
+            "               exit, so the flash log and calibration carry over to the next run\n"
+            "  --quiet      discard firmware output\n", prog, HC595_SHIFT_HZ, BTN1);
+}
+
+int main(int argc, char **argv) {
+    unsigned long loops = 100;
+    uint32_t i2c_max_hz = 0;
+    const char *accel = "mma8451q";
+    const char *flash_image = NULL;
+    uint32_t spi_hz = HC595_SHIFT_HZ;
+
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--loops") && i + 1 < argc) {
+            loops = strtoul(argv[++i], NULL, 0);
+        } else if (!strcmp(argv[i], "--i2c-max-hz") && i + 1 < argc) {
+            i2c_max_hz = strtoul(argv[++i], NULL, 0);
+        } else if (!strcmp(argv[i], "--spi-hz") && i + 1 < argc) {
+            spi_hz = strtoul(argv[++i], NULL, 0);
+        } else if (!strcmp(argv[i], "--hold") && i + 1 < argc) {
+            if (!parse_hold(argv[++i])) {
+                usage(argv[0]);
+                return EXIT_FAILURE;
+            }
+        } else if (!strcmp(argv[i], "--motion") && i + 1 < argc) {
+            if (!parse_motion(argv[++i])) {
+                usage(argv[0]);
+                return EXIT_FAILURE;
+            }
+        } else if (!strcmp(argv[i], "--trace") && i + 1 < argc) {
+            if (!sim_trace_load(argv[++i])) {
+                fprintf(stderr, "%s: no samples\n", argv[i]);
+                return EXIT_FAILURE;
+            }
+        } else if (!strcmp(argv[i], "--accel") && i + 1 < argc) {
+            accel = argv[++i];
+            if (strcmp(accel, "mma8451q") && strcmp(accel, "lis2dw12")) {
+                usage(argv[0]);
+                return EXIT_FAILURE;
+            }
+        } else if (!strcmp(argv[i], "--flash") && i + 1 < argc) {
+            flash_image = argv[++i];
+        } else if (!strcmp(argv[i], "--quiet")) {
+            if (!freopen("/dev/null", "w", stdout))
+                return EXIT_FAILURE;
+        } else {
+            usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    if (spi_hz == 0) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    // hal_init() starts the bus in standard mode, like i2c_init() in hal_pico.c
+    sim_init(100 * 1000, spi_hz);
+    // firmware output takes its time on the USB link, also with --quiet
+    stdout = sim_usb_open(stdout);
+    if (!stdout)
+        return EXIT_FAILURE;
+    sim_ht16k33_attach();
+    if (!strcmp(accel, "lis2dw12"))
+        sim_lis2dw12_attach();
+    else
+        sim_mma8451q_attach();
+    sim_74hc595_attach();
+    sim_w25q128_attach();
+    sim_trace_attach();
+    if (flash_image && !sim_w25q128_load(flash_image)) {
+        fprintf(stderr, "%s: not a flash image\n", flash_image);
+        return EXIT_FAILURE;
+    }
+
+    boot_begin(BOOT_HAL);
+    hal_init();
+    boot_end(BOOT_HAL);
+    if (i2c_max_hz)
+        sim_i2c_set_device_max_hz(i2c_max_hz);
+    if (num_holds)
+        sim_add_tick(holds_tick);
+    if (!app_bus_init())
+        fprintf(stderr, "app_bus_init: devices fail at every bus speed\n");
+    if (!app_init()) {
+        fprintf(stderr, "app_init failed\n");
+        sim_report(stderr);
+        return EXIT_FAILURE;
+    }
+    for (unsigned long i = 0; i < loops; i++)
+        app_step();
+
+    fflush(stdout);
+    app_report(stderr);
+    sim_report(stderr);
+    if (flash_image && !sim_w25q128_save(flash_image)) {
+        fprintf(stderr, "%s: cannot save the flash image\n", flash_image);
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,364 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "board.h"
+#include "hal.h"
+#include "dsp.h"
+#include "flash_log.h"
+#include "ht16k33.h"
+#include "input.h"
+#include "sample_ring.h"
+#include "telemetry.h"
+#include "timebase.h"
+#include "sim.h"
+
+// Unit tests of the firmware modules that need no running main loop, on the
+// simulated board where they touch hardware. Each test is run by name, so
+// ctest lists them separately:
+//
+//   ./build-host/ht16k33_i2c_test font
+
+static int failures;
+
+#define CHECK(cond) do { \
+    if (!(cond)) { \
+        fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+        failures++; \
+    } \
+} while (0)
+
+// Bytes outside the font are blank, letters share a glyph across case and a
+// '.' lights the decimal point of the digit before it
+static void test_font(void) {
+    ht16k33_text_t text;
+
+    CHECK(char_to_pattern('A') == 0xF7);
+    CHECK(char_to_pattern('a') == char_to_pattern('A'));
+    CHECK(char_to_pattern('0') == 0x3F);
+    CHECK(char_to_pattern(' ') == 0);
+    CHECK(char_to_pattern('\x7F') == 0);
+    // a UTF-8 lead byte must not fold onto 'C'
+    CHECK(char_to_pattern('\xC3') == 0);
+    CHECK(char_to_pattern('\xFF') == 0);
+
+    ht16k33_text_render(&text, "1.5..");
+    CHECK(text.len == 3);
+    CHECK(text.glyphs[0] == (0x06 | HT16K33_SEG_DP));
+    CHECK(text.glyphs[1] == (0x6D | HT16K33_SEG_DP));
+    CHECK(text.glyphs[2] == HT16K33_SEG_DP);
+
+    char longer[HT16K33_TEXT_MAX + 8];
+    memset(longer, 'X', sizeof(longer) - 1);
+    longer[sizeof(longer) - 1] = '\0';
+    ht16k33_text_render(&text, longer);
+    CHECK(text.len == HT16K33_TEXT_MAX);
+}
+
+// Full, empty and block pops, with the indices about to wrap
+static void test_ring(void) {
+    static sample_ring_t ring;
+    accel_sample_t sample = { 0 };
+    accel_sample_t block[SAMPLE_RING_SIZE];
+
+    sample_ring_init(&ring);
+    atomic_store(&ring.head, UINT32_MAX - 10);
+    atomic_store(&ring.tail, UINT32_MAX - 10);
+    CHECK(!sample_ring_pop(&ring, &sample));
+
+    for (int i = 0; i < SAMPLE_RING_SIZE; i++) {
+        sample.timestamp_us = i;
+        CHECK(sample_ring_push(&ring, &sample));
+    }
+    CHECK(!sample_ring_push(&ring, &sample));
+    CHECK(atomic_load(&ring.dropped) == 1);
+    CHECK(sample_ring_count(&ring) == SAMPLE_RING_SIZE);
+
+    CHECK(sample_ring_pop(&ring, &sample) && sample.timestamp_us == 0);
+    CHECK(sample_ring_pop_block(&ring, block, 10) == 10);
+    CHECK(block[0].timestamp_us == 1 && block[9].timestamp_us == 10);
+    CHECK(sample_ring_pop_block(&ring, block, SAMPLE_RING_SIZE) == SAMPLE_RING_SIZE - 11);
+    CHECK(block[SAMPLE_RING_SIZE - 12].timestamp_us == SAMPLE_RING_SIZE - 1);
+    CHECK(sample_ring_count(&ring) == 0);
+}
+
+static void press(unsigned int gpio, bool pressed) {
+    sim_gpio_set_input(gpio, !pressed);
+    // the edge interrupt runs when time moves
+    sim_advance_ns(0);
+}
+
+static void scan_for(uint64_t ms) {
+    for (uint64_t i = 0; i < ms / 10; i++) {
+        sim_advance_ns(INPUT_SCAN_PERIOD_US * 1000ull);
+        input_scan(hal_time_us());
+    }
+}
+
+// Vertical counters: four scans that differ make a change, a bounce that
+// settles back within them makes none
+static void test_debounce(void) {
+    input_event_t event;
+
+    sim_init(100 * 1000, HC595_SHIFT_HZ);
+    hal_init();
+    input_init();
+
+    sim_advance_ns(5 * 1000 * 1000);
+    press(BTN1, true);
+    CHECK(input_wake_pending());
+    scan_for(20);
+    press(BTN1, false);
+    scan_for(50);
+    CHECK(!input_event_pop(&event));
+    CHECK(!(input_state() & GPIO_BIT(BTN1)));
+
+    sim_advance_ns(3 * 1000 * 1000);
+    uint64_t edge_us = hal_time_us();
+    press(BTN1, true);
+    scan_for(30);
+    CHECK(!input_event_pop(&event));
+    scan_for(10);
+    CHECK(input_event_pop(&event));
+    CHECK(event.gpio == BTN1 && event.type == INPUT_PRESS);
+    // stamped with the first edge, not the scan that settled it
+    CHECK(event.timestamp_us == edge_us);
+    CHECK(input_state() & GPIO_BIT(BTN1));
+
+    scan_for(INPUT_LONG_PRESS_US / 1000);
+    CHECK(input_event_pop(&event) && event.type == INPUT_LONG_PRESS);
+    CHECK(event.timestamp_us == edge_us + INPUT_LONG_PRESS_US);
+
+    press(BTN1, false);
+    scan_for(40);
+    CHECK(input_event_pop(&event) && event.type == INPUT_RELEASE);
+    CHECK(!input_event_pop(&event));
+    CHECK(!input_busy());
+}
+
+// Encoded records, a time sync across a 32-bit wrap and noise in between,
+// read back through the trace loader, which frames like telemetry_decode
+static void test_telemetry(void) {
+    const char *path = "host_test_telemetry.bin";
+    const uint64_t base_us = 0xFFFFFFFFull - 15000;
+    uint8_t record[TELEMETRY_RECORD_SIZE];
+    double g[3];
+
+    telemetry_record_t r = { .timestamp_us = 0x123456789ull, .x = -4096, .y = 2048, .z = 1, .inputs = 0x0A5 };
+    telemetry_encode(&r, 7, TELEMETRY_FLAG_DROPPED, record);
+    CHECK(record[0] == TELEMETRY_SYNC && record[1] == 7);
+    CHECK(record[2] == 0x89 && record[5] == 0x23);
+    CHECK(record[6] == 0x00 && record[7] == 0xF0);
+    CHECK(record[12] == 0xA5 && record[13] == 0x00);
+    CHECK(record[14] == TELEMETRY_FLAG_DROPPED);
+    CHECK(telemetry_crc8(record, TELEMETRY_RECORD_SIZE - 1) == record[TELEMETRY_RECORD_SIZE - 1]);
+    // CRC-8 check value of the poly 0x07 parameters
+    CHECK(telemetry_crc8((const uint8_t *)"123456789", 9) == 0xF4);
+
+    FILE *out = fopen(path, "wb");
+    CHECK(out != NULL);
+    if (!out)
+        return;
+    telemetry_encode_sync(base_us, 0, record);
+    fwrite(record, 1, sizeof(record), out);
+    for (int i = 0; i < 4; i++) {
+        r = (telemetry_record_t){ .timestamp_us = base_us + i * 10000ull, .x = 1000 * i };
+        telemetry_encode(&r, i, 0, record);
+        if (i == 2) {
+            // torn record, then console text before the next one
+            record[8] ^= 0x40;
+            fwrite(record, 1, sizeof(record), out);
+            fputs("\xA5 I2C Write Error\n", out);
+            continue;
+        }
+        fwrite(record, 1, sizeof(record), out);
+    }
+    fclose(out);
+
+    CHECK(sim_trace_load(path));
+    // records 0, 1 and 3, the sync extended the wrapped times past 2^32
+    CHECK(sim_trace_duration_ns() == 30000 * 1000ull);
+    CHECK(sim_trace_g(10000 * 1000ull, g) && g[0] == 1000.0 / 4096);
+    // the torn record is gone, record 2's time lies between its neighbours
+    CHECK(sim_trace_g(20000 * 1000ull, g) && g[0] == 2000.0 / 4096);
+    remove(path);
+}
+
+// Data-ready edges from a sensor running 1200 ppm fast, with interrupt
+// latency jitter, a late edge and three samples the sensor overwrote
+static void test_timebase(void) {
+    const uint64_t start_us = 5000;
+    const uint64_t period_us = 10012;
+    timebase_t tb;
+    accel_sample_t sample;
+
+    timebase_init(&tb, 10000);
+    for (uint64_t n = 0; n < 1000; n++) {
+        uint64_t true_us = start_us + n * period_us;
+        uint64_t edge_us = true_us + (n % 3) * 20;
+
+        if (n >= 600 && n < 603)
+            continue;
+        if (n == 500)
+            edge_us += 4000;
+        timebase_observe_newest(&tb, edge_us, true);
+        timebase_stamp(&tb, &sample, 1, edge_us);
+        // the grid settles on the mean interrupt latency, 20 us, within
+        // a second or so
+        if (n >= 200) {
+            int64_t error_us = (int64_t)sample.timestamp_us - (int64_t)(true_us + 20);
+            CHECK(error_us >= -5 && error_us <= 5);
+        }
+    }
+    int64_t period_ns = tb.period_q8 / 256;
+    // within 10 ppm
+    CHECK(period_ns > 10012000 - 100 && period_ns < 10012000 + 100);
+    CHECK(tb.rejected == 1);
+    CHECK(tb.lost == 3);
+    CHECK(tb.relocks == 0);
+}
+
+static void fill_samples(accel_sample_t *samples, size_t count, int16_t x, int16_t y, int16_t z) {
+    for (size_t i = 0; i < count; i++)
+        samples[i] = (accel_sample_t){ .timestamp_us = i * 1250, .x = x, .y = y, .z = z };
+}
+
+// The low-pass and CIC keep DC exactly, the high-pass takes it out, a tone
+// at the sample rate / 2 is cut, and a window of DC gives its RMS and peak
+static void test_dsp(void) {
+    static dsp_t dsp;
+    accel_sample_t samples[64];
+    dsp_features_t features;
+
+    dsp_config_t config = { .lowpass_hz = 80, .decimation = 4, .cic_order = 2, .window = 32 };
+    CHECK(dsp_init(&dsp, &config, 800));
+    fill_samples(samples, 64, 1000, -500, 4096);
+    // the first CIC output still holds the start up ramp and is dropped
+    CHECK(dsp_process(&dsp, samples, 64) == 15);
+    for (int i = 0; i < 15; i++)
+        CHECK(samples[i].x == 1000 && samples[i].y == -500 && samples[i].z == 4096);
+    CHECK(samples[0].timestamp_us == 7 * 1250);
+    CHECK(samples[14].timestamp_us == 63 * 1250);
+    CHECK(dsp_features_pop(&dsp, &features));
+    CHECK(features.rms[0] == 1000 && features.rms[1] == 500 && features.peak[2] == 4096);
+    CHECK(features.timestamp_us == 31 * 1250);
+    CHECK(dsp_features_pop(&dsp, &features));
+    CHECK(!dsp_features_pop(&dsp, &features));
+
+    config = (dsp_config_t){ .highpass_hz = 0.5f, .decimation = 1, .cic_order = 1 };
+    CHECK(dsp_init(&dsp, &config, 800));
+    fill_samples(samples, 64, 1000, -500, 4096);
+    CHECK(dsp_process(&dsp, samples, 64) == 64);
+    CHECK(samples[0].z == 0 && samples[63].z == 0 && samples[63].x == 0);
+
+    config = (dsp_config_t){ .lowpass_hz = 80, .decimation = 1, .cic_order = 1 };
+    CHECK(dsp_init(&dsp, &config, 800));
+    for (int i = 0; i < 64; i++)
+        samples[i] = (accel_sample_t){ .x = i & 1 ? -1000 : 1000 };
+    dsp_process(&dsp, samples, 64);
+    for (int i = 32; i < 64; i++)
+        CHECK(samples[i].x > -30 && samples[i].x < 30);
+
+    config.decimation = DSP_DECIMATION_MAX + 1;
+    CHECK(!dsp_init(&dsp, &config, 800));
+    config = (dsp_config_t){ .lowpass_hz = 400, .decimation = 1, .cic_order = 1 };
+    CHECK(!dsp_init(&dsp, &config, 800));
+}
+
+static void log_session(uint32_t first_us, int count) {
+    flash_log_start();
+    for (int i = 0; i < count; i++) {
+        telemetry_record_t r = { .timestamp_us = first_us + i, .x = i };
+        flash_log_put(&r);
+        flash_log_service();
+    }
+    flash_log_stop();
+    // program what is still queued before the next reset
+    for (int i = 0; i < 2 * FLASH_LOG_QUEUE_PAGES; i++)
+        flash_log_service();
+}
+
+// Records of the newest session as flash_log_dump() writes them. Returns
+// how many there were, checking each is whole and in order.
+static int dump_session(uint32_t first_us) {
+    char *data = NULL;
+    size_t size = 0;
+    FILE *console = stdout;
+
+    stdout = open_memstream(&data, &size);
+    if (!stdout) {
+        stdout = console;
+        CHECK(false);
+        return -1;
+    }
+    flash_log_dump();
+    fclose(stdout);
+    stdout = console;
+
+    int records = (int)(size / TELEMETRY_RECORD_SIZE);
+    CHECK(size % TELEMETRY_RECORD_SIZE == 0);
+    for (int i = 0; i < records; i++) {
+        const uint8_t *record = (const uint8_t *)data + i * TELEMETRY_RECORD_SIZE;
+        uint32_t t = record[2] | (record[3] << 8) | (record[4] << 16) | ((uint32_t)record[5] << 24);
+        CHECK(telemetry_crc8(record, TELEMETRY_RECORD_SIZE - 1) == record[TELEMETRY_RECORD_SIZE - 1]);
+        CHECK(record[1] == (uint8_t)i);
+        CHECK(t == first_us + i);
+    }
+    free(data);
+    return records;
+}
+
+// After a reset the newest page is found again from the page headers, the
+// next session starts in a fresh sector and a dump returns only that one
+static void test_flash_log(void) {
+    sim_init(100 * 1000, HC595_SHIFT_HZ);
+    sim_w25q128_attach();
+
+    flash_log_init();
+    CHECK(dump_session(0) == 0);
+
+    // 3 pages, the last one partly filled
+    log_session(1000, 2 * FLASH_LOG_RECORDS_PER_PAGE + 10);
+    flash_log_init();
+    CHECK(dump_session(1000) == 2 * FLASH_LOG_RECORDS_PER_PAGE + 10);
+
+    // 20 pages from the second sector into the third
+    flash_log_init();
+    log_session(50000, 20 * FLASH_LOG_RECORDS_PER_PAGE);
+    flash_log_init();
+    CHECK(dump_session(50000) == 20 * FLASH_LOG_RECORDS_PER_PAGE);
+    CHECK(flash_log_dropped() == 0);
+}
+
+static const struct {
+    const char *name;
+    void (*run)(void);
+} tests[] = {
+    { "font", test_font },
+    { "ring", test_ring },
+    { "debounce", test_debounce },
+    { "telemetry", test_telemetry },
+    { "timebase", test_timebase },
+    { "dsp", test_dsp },
+    { "flash_log", test_flash_log },
+};
+
+int main(int argc, char **argv) {
+    int run = 0;
+
+    for (size_t i = 0; i < count_of(tests); i++) {
+        bool selected = argc < 2;
+        for (int arg = 1; arg < argc; arg++)
+            selected |= !strcmp(argv[arg], tests[i].name);
+        if (!selected)
+            continue;
+        int before = failures;
+        tests[i].run();
+        printf("%-12s %s\n", tests[i].name, failures == before ? "ok" : "FAILED");
+        run++;
+    }
+    if (run == 0 || run < argc - 1) {
+        fprintf(stderr, "usage: %s [TEST]...\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+    return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,143 @@
+#ifndef SIM_H
+#define SIM_H
+
+/* Simulated board for the host build.
+
+   The I2C and SPI buses are modeled at bit level: every transfer advances the
+   simulated clock by the time it would take on the wire at the configured bus
+   speed, and is counted per bus and per device. Time otherwise only advances
+   when the firmware sleeps or waits for an event, so host runs are
+   deterministic and independent of the speed of the machine running them.
+*/
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#define SIM_NUM_GPIOS 48
+
+typedef struct {
+    uint32_t transactions;
+    uint64_t bytes;
+    uint64_t busy_ns;
+} sim_bus_stats_t;
+
+typedef struct sim_i2c_device {
+    const char *name;
+    uint8_t address;
+    // Called once per transaction with the bytes following the address byte
+    void (*write)(struct sim_i2c_device *dev, const uint8_t *src, size_t len);
+    void (*read)(struct sim_i2c_device *dev, uint8_t *dst, size_t len);
+    // Fastest clock the device follows. Above it the device still
+    // acknowledges, but samples SDA late and every data byte in either
+    // direction comes out shifted by a bit.
+    uint32_t max_hz;
+    sim_bus_stats_t stats;
+    struct sim_i2c_device *next;
+} sim_i2c_device_t;
+
+extern sim_bus_stats_t sim_i2c_stats;
+extern sim_bus_stats_t sim_spi_stats;
+
+void sim_init(uint32_t i2c_hz, uint32_t spi_hz);
+uint32_t sim_i2c_hz(void);
+// The controller changing its clock
+void sim_i2c_set_hz(uint32_t hz);
+// Override max_hz of every attached device
+void sim_i2c_set_device_max_hz(uint32_t hz);
+uint32_t sim_spi_hz(void);
+
+uint64_t sim_time_ns(void);
+void sim_advance_ns(uint64_t ns);
+
+// Devices with time driven behaviour register a tick. It runs whenever
+// simulated time moves and returns the next time it needs to run, or
+// UINT64_MAX if it has nothing scheduled.
+typedef uint64_t (*sim_tick_t)(uint64_t now_ns);
+void sim_add_tick(sim_tick_t tick);
+
+// Advance to the next scheduled event, or by 1 ms if there is none
+void sim_wait_for_event(void);
+// Advance until an interrupt handler has run or deadline_ns, like WFE with a
+// timer. Returns true if the deadline was reached.
+bool sim_wait_until(uint64_t deadline_ns);
+
+void sim_i2c_attach(sim_i2c_device_t *dev);
+// Write tx, then read rx after a repeated start. done() runs from the
+// interrupt path once the modeled wire time has passed, with the byte count
+// or -1 if the address was not acknowledged. One transfer at a time.
+typedef void (*sim_i2c_done_t)(int result);
+bool sim_i2c_xfer_start(uint8_t addr, const uint8_t *tx, size_t tx_len,
+                        uint8_t *rx, size_t rx_len, sim_i2c_done_t done);
+int sim_spi_write(const uint8_t *src, size_t len);
+
+bool sim_gpio_get(unsigned int gpio);
+uint64_t sim_gpio_get_all(void);
+void sim_gpio_put(unsigned int gpio, bool value);
+// Drive the external level seen on an input pin (buttons, switches, device outputs)
+void sim_gpio_set_input(unsigned int gpio, bool level);
+
+// Falling edge interrupts. Handlers run whenever time moves,
+// never nested, and are held off while interrupts are masked.
+typedef void (*sim_irq_handler_t)(unsigned int gpio);
+void sim_gpio_set_irq(unsigned int gpio, sim_irq_handler_t handler);
+// Both edges
+void sim_gpio_set_change_irq(unsigned int gpio, sim_irq_handler_t handler);
+uint32_t sim_irq_disable(void);
+void sim_irq_restore(uint32_t state);
+
+// Devices
+void sim_ht16k33_attach(void);
+const uint8_t *sim_ht16k33_ram(void);
+
+// Acceleration in g at a time: a slow tilt around 1 g on Z, plus the
+// disturbances added with sim_motion_add(). Both accelerometers sample it.
+void sim_motion_g(uint64_t at_ns, double g[3]);
+// Disturb the slow tilt from start to end: "tap" adds 2 g on Z, "shake"
+// adds 0.8 g at 5 Hz on X, "drop" is freefall and "tilt" turns the board
+// on its side. Returns false for an unknown kind or too many.
+bool sim_motion_add(const char *kind, uint64_t start_ns, uint64_t end_ns);
+
+// Recorded motion and inputs played back in place of the slow tilt, from
+// the CSV of telemetry_decode or a binary telemetry capture. Disturbances
+// from sim_motion_add() still go on top. Returns false if the file holds no
+// samples. sim_trace_attach() then drives the buttons and switches from it.
+bool sim_trace_load(const char *path);
+void sim_trace_attach(void);
+// Time from the first sample to the last, 0 without a trace
+uint64_t sim_trace_duration_ns(void);
+// g at a time from the start, false past the end or without a trace
+bool sim_trace_g(uint64_t at_ns, double g[3]);
+
+// Attach one of the two, they share the interrupt pins
+void sim_mma8451q_attach(void);
+void sim_lis2dw12_attach(void);
+
+// Log region and calibration sector of the boot flash, offsets relative to
+// LOG_FLASH_OFFSET. The image can be loaded from and saved to a file, so
+// what was written survives to the next run.
+#define SIM_FLASH_PAGE_SIZE 256
+#define SIM_FLASH_SECTOR_SIZE 4096
+void sim_w25q128_attach(void);
+bool sim_flash_erase(uint32_t offset, size_t len);
+bool sim_flash_program(uint32_t offset, const uint8_t *src, size_t len);
+void sim_flash_read(uint32_t offset, uint8_t *dst, size_t len);
+bool sim_w25q128_load(const char *path);
+bool sim_w25q128_save(const char *path);
+void sim_w25q128_report(FILE *out);
+
+// Firmware output over the USB console. Returns a stream that writes to out
+// and advances time by its modeled transfer time, NULL if it cannot be made.
+FILE *sim_usb_open(FILE *out);
+void sim_usb_report(FILE *out);
+
+void sim_74hc595_attach(void);
+void sim_74hc595_shift(const uint8_t *src, size_t len);
+void sim_74hc595_gpio(unsigned int gpio, bool value);
+uint32_t sim_74hc595_outputs(void);
+uint32_t sim_74hc595_latches(void);
+
+void sim_report(FILE *out);
+
+#endif
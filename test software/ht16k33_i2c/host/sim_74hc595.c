@@ -0,0 +1,42 @@
+#include <string.h>
+#include "board.h"
+#include "sim.h"
+
+// Three daisy-chained 74HC595s: bytes shift in MSB first, a rising edge on
+// STCP copies the shift register to the outputs, MR low clears it.
+
+static struct {
+    uint32_t shift;
+    uint32_t outputs;
+    uint32_t latches;
+    bool stcp;
+} hc595;
+
+void sim_74hc595_attach(void) {
+    memset(&hc595, 0, sizeof(hc595));
+}
+
+void sim_74hc595_shift(const uint8_t *src, size_t len) {
+    for (size_t i = 0; i < len; i++)
+        hc595.shift = ((hc595.shift << 8) | src[i]) & 0xFFFFFF;
+}
+
+void sim_74hc595_gpio(unsigned int gpio, bool value) {
+    if (gpio == PIN_STCP) {
+        if (value && !hc595.stcp) {
+            hc595.outputs = hc595.shift;
+            hc595.latches++;
+        }
+        hc595.stcp = value;
+    } else if (gpio == PIN_MR && !value) {
+        hc595.shift = 0;
+    }
+}
+
+uint32_t sim_74hc595_outputs(void) {
+    return hc595.outputs;
+}
+
+uint32_t sim_74hc595_latches(void) {
+    return hc595.latches;
+}
@@ -0,0 +1,337 @@
+#include <string.h>
+#include "sim.h"
+
+sim_bus_stats_t sim_i2c_stats;
+sim_bus_stats_t sim_spi_stats;
+
+static uint32_t i2c_hz;
+static uint32_t spi_hz;
+static uint64_t now_ns;
+static sim_i2c_device_t *devices;
+static uint64_t gpio_out;
+static uint64_t gpio_in;
+
+#define SIM_MAX_TICKS 8
+
+static sim_tick_t ticks[SIM_MAX_TICKS];
+static int num_ticks;
+static uint64_t next_tick_ns;
+
+static sim_irq_handler_t irq_handlers[SIM_NUM_GPIOS];
+static uint64_t irq_pending;
+static uint64_t irq_rising;     // pins that also interrupt on a rising edge
+static uint32_t irq_count;      // handlers run, to tell wakeups apart
+static bool irq_masked;
+static bool in_irq;
+
+// Non-blocking I2C transfer on the wire, completed from the interrupt path
+static struct {
+    sim_i2c_done_t done;
+    uint64_t end_ns;
+    int result;
+    bool irq_pending;
+} i2c_xfer;
+
+static uint64_t i2c_xfer_tick(uint64_t now);
+
+void sim_init(uint32_t i2c_clock, uint32_t spi_clock) {
+    i2c_hz = i2c_clock;
+    spi_hz = spi_clock;
+    now_ns = 0;
+    devices = NULL;
+    gpio_out = 0;
+    gpio_in = ~0ull; // everything pulled up until something drives it
+    num_ticks = 0;
+    next_tick_ns = UINT64_MAX;
+    memset(irq_handlers, 0, sizeof(irq_handlers));
+    irq_pending = 0;
+    irq_rising = 0;
+    irq_count = 0;
+    irq_masked = false;
+    in_irq = false;
+    memset(&i2c_xfer, 0, sizeof(i2c_xfer));
+    memset(&sim_i2c_stats, 0, sizeof(sim_i2c_stats));
+    memset(&sim_spi_stats, 0, sizeof(sim_spi_stats));
+    sim_add_tick(i2c_xfer_tick);
+}
+
+uint32_t sim_i2c_hz(void) {
+    return i2c_hz;
+}
+
+void sim_i2c_set_hz(uint32_t hz) {
+    i2c_hz = hz;
+}
+
+void sim_i2c_set_device_max_hz(uint32_t hz) {
+    for (sim_i2c_device_t *dev = devices; dev; dev = dev->next)
+        dev->max_hz = hz;
+}
+
+uint32_t sim_spi_hz(void) {
+    return spi_hz;
+}
+
+uint64_t sim_time_ns(void) {
+    return now_ns;
+}
+
+static void run_ticks(void) {
+    next_tick_ns = UINT64_MAX;
+    for (int i = 0; i < num_ticks; i++) {
+        uint64_t next = ticks[i](now_ns);
+        if (next < next_tick_ns)
+            next_tick_ns = next;
+    }
+}
+
+static void dispatch_irqs(void) {
+    if (irq_masked || in_irq)
+        return;
+
+    in_irq = true;
+    while (i2c_xfer.irq_pending) {
+        sim_i2c_done_t done = i2c_xfer.done;
+        i2c_xfer.irq_pending = false;
+        i2c_xfer.done = NULL;
+        done(i2c_xfer.result);
+        irq_count++;
+    }
+    while (irq_pending) {
+        unsigned int gpio = __builtin_ctzll(irq_pending);
+        irq_pending &= ~(1ull << gpio);
+        if (irq_handlers[gpio]) {
+            irq_handlers[gpio](gpio);
+            irq_count++;
+        }
+    }
+    in_irq = false;
+}
+
+// Move time forward, stopping at every device event on the way so that
+// interrupts are raised at the right moment
+static void advance_to(uint64_t target_ns) {
+    while (next_tick_ns <= target_ns) {
+        if (next_tick_ns > now_ns)
+            now_ns = next_tick_ns;
+        run_ticks();
+        dispatch_irqs();
+    }
+    if (now_ns < target_ns)
+        now_ns = target_ns;
+    run_ticks();
+    dispatch_irqs();
+}
+
+void sim_advance_ns(uint64_t ns) {
+    advance_to(now_ns + ns);
+}
+
+void sim_wait_for_event(void) {
+    if (next_tick_ns > now_ns && next_tick_ns != UINT64_MAX)
+        advance_to(next_tick_ns);
+    else
+        sim_advance_ns(1000000);
+}
+
+bool sim_wait_until(uint64_t deadline_ns) {
+    uint32_t start = irq_count;
+
+    while (now_ns < deadline_ns && irq_count == start) {
+        if (next_tick_ns > now_ns && next_tick_ns < deadline_ns)
+            advance_to(next_tick_ns);
+        else if (deadline_ns != UINT64_MAX)
+            advance_to(deadline_ns);
+        else
+            sim_advance_ns(1000000);
+    }
+    return now_ns >= deadline_ns;
+}
+
+void sim_add_tick(sim_tick_t tick) {
+    if (num_ticks < SIM_MAX_TICKS)
+        ticks[num_ticks++] = tick;
+    run_ticks();
+}
+
+void sim_i2c_attach(sim_i2c_device_t *dev) {
+    memset(&dev->stats, 0, sizeof(dev->stats));
+    dev->next = devices;
+    devices = dev;
+}
+
+static sim_i2c_device_t *find_device(uint8_t addr) {
+    for (sim_i2c_device_t *dev = devices; dev; dev = dev->next) {
+        if (dev->address == addr)
+            return dev;
+    }
+    return NULL;
+}
+
+// START, address byte + ACK, data bytes + ACK each, STOP unless a repeated
+// start follows.
+static uint64_t i2c_transfer_ns(size_t len, bool nostop) {
+    uint64_t bits = 1 + 9 * (1 + (uint64_t)len) + (nostop ? 0 : 1);
+    return bits * 1000000000ull / i2c_hz;
+}
+
+static void account(sim_bus_stats_t *stats, size_t len, uint64_t ns) {
+    stats->transactions++;
+    stats->bytes += len;
+    stats->busy_ns += ns;
+}
+
+// Returns the modeled duration, the caller advances time once the device
+// has seen the transfer
+static uint64_t i2c_transfer(uint8_t addr, size_t len, bool nostop, sim_i2c_device_t **dev) {
+    *dev = find_device(addr);
+    // An unacknowledged address still costs the address byte on the wire
+    uint64_t ns = i2c_transfer_ns(*dev ? len : 0, nostop);
+    account(&sim_i2c_stats, *dev ? len : 0, ns);
+    if (*dev)
+        account(&(*dev)->stats, len, ns);
+    return ns;
+}
+
+static uint64_t i2c_xfer_tick(uint64_t now) {
+    if (!i2c_xfer.done || i2c_xfer.irq_pending)
+        return UINT64_MAX;
+    if (now >= i2c_xfer.end_ns) {
+        i2c_xfer.irq_pending = true;
+        return UINT64_MAX;
+    }
+    return i2c_xfer.end_ns;
+}
+
+// Data sampled one bit late, what an overclocked device sees or sends
+static void shift_late(uint8_t *buf, size_t len) {
+    for (size_t i = len; i-- > 0;)
+        buf[i] = (buf[i] >> 1) | (i ? buf[i - 1] << 7 : 0x80);
+}
+
+static bool overclocked(const sim_i2c_device_t *dev) {
+    return dev->max_hz && i2c_hz > dev->max_hz;
+}
+
+// The device sees the whole transaction up front, the wire time is then
+// spent before done() runs. Time does not advance here.
+bool sim_i2c_xfer_start(uint8_t addr, const uint8_t *tx, size_t tx_len,
+                        uint8_t *rx, size_t rx_len, sim_i2c_done_t done) {
+    sim_i2c_device_t *dev = NULL;
+    uint64_t ns = 0;
+
+    if (i2c_xfer.done || tx_len + rx_len == 0)
+        return false;
+
+    if (tx_len) {
+        ns += i2c_transfer(addr, tx_len, rx_len != 0, &dev);
+        if (dev && overclocked(dev)) {
+            uint8_t garbled[256];
+            size_t len = tx_len < sizeof(garbled) ? tx_len : sizeof(garbled);
+            memcpy(garbled, tx, len);
+            shift_late(garbled, len);
+            dev->write(dev, garbled, len);
+        } else if (dev) {
+            dev->write(dev, tx, tx_len);
+        }
+    }
+    // the read half only goes out if the write half was acknowledged
+    if (rx_len && (dev || !tx_len)) {
+        ns += i2c_transfer(addr, rx_len, false, &dev);
+        if (dev) {
+            dev->read(dev, rx, rx_len);
+            if (overclocked(dev))
+                shift_late(rx, rx_len);
+        }
+    }
+
+    i2c_xfer.done = done;
+    i2c_xfer.end_ns = now_ns + ns;
+    i2c_xfer.result = dev ? (int)(tx_len + rx_len) : -1;
+    if (i2c_xfer.end_ns < next_tick_ns)
+        next_tick_ns = i2c_xfer.end_ns;
+    return true;
+}
+
+int sim_spi_write(const uint8_t *src, size_t len) {
+    uint64_t ns = 8 * (uint64_t)len * 1000000000ull / spi_hz;
+    account(&sim_spi_stats, len, ns);
+    sim_74hc595_shift(src, len);
+    sim_advance_ns(ns);
+    return (int)len;
+}
+
+bool sim_gpio_get(unsigned int gpio) {
+    return (gpio_in >> gpio) & 1;
+}
+
+uint64_t sim_gpio_get_all(void) {
+    return gpio_in & ((1ull << SIM_NUM_GPIOS) - 1);
+}
+
+void sim_gpio_put(unsigned int gpio, bool value) {
+    if (value)
+        gpio_out |= 1ull << gpio;
+    else
+        gpio_out &= ~(1ull << gpio);
+    sim_74hc595_gpio(gpio, value);
+}
+
+void sim_gpio_set_input(unsigned int gpio, bool level) {
+    uint64_t bit = 1ull << gpio;
+
+    bool high = gpio_in & bit;
+    if (irq_handlers[gpio] && ((!level && high) || (level && !high && (irq_rising & bit))))
+        irq_pending |= bit;
+    if (level)
+        gpio_in |= bit;
+    else
+        gpio_in &= ~bit;
+}
+
+void sim_gpio_set_irq(unsigned int gpio, sim_irq_handler_t handler) {
+    irq_handlers[gpio] = handler;
+    irq_pending &= ~(1ull << gpio);
+    irq_rising &= ~(1ull << gpio);
+}
+
+void sim_gpio_set_change_irq(unsigned int gpio, sim_irq_handler_t handler) {
+    sim_gpio_set_irq(gpio, handler);
+    if (handler)
+        irq_rising |= 1ull << gpio;
+}
+
+uint32_t sim_irq_disable(void) {
+    uint32_t state = irq_masked;
+    irq_masked = true;
+    return state;
+}
+
+void sim_irq_restore(uint32_t state) {
+    irq_masked = state;
+    dispatch_irqs();
+}
+
+static void report_bus(FILE *out, const char *name, const sim_bus_stats_t *stats) {
+    double busy_ms = stats->busy_ns / 1e6;
+    double pct = now_ns ? 100.0 * stats->busy_ns / now_ns : 0.0;
+    fprintf(out, "  %-16s %8u transactions %10llu bytes %10.3f ms busy (%5.1f%%)\n",
+            name, stats->transactions, (unsigned long long)stats->bytes, busy_ms, pct);
+}
+
+void sim_report(FILE *out) {
+    char name[32];
+
+    fprintf(out, "simulated time: %.3f ms\n", now_ns / 1e6);
+    fprintf(out, "i2c @ %u Hz\n", i2c_hz);
+    report_bus(out, "total", &sim_i2c_stats);
+    for (sim_i2c_device_t *dev = devices; dev; dev = dev->next) {
+        snprintf(name, sizeof(name), "%s (0x%02X)", dev->name, dev->address);
+        report_bus(out, name, &dev->stats);
+    }
+    fprintf(out, "spi @ %u Hz\n", spi_hz);
+    report_bus(out, "74hc595", &sim_spi_stats);
+    fprintf(out, "  %-16s %8u\n", "latches", sim_74hc595_latches());
+    sim_w25q128_report(out);
+    sim_usb_report(out);
+}
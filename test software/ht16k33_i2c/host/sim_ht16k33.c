@@ -0,0 +1,65 @@
+#include <string.h>
+#include "ht16k33.h"
+#include "sim.h"
+
+// HT16K33 with 16 bytes of display RAM and an auto-incrementing address pointer
+
+static struct {
+    sim_i2c_device_t dev;
+    uint8_t ram[16];
+    uint8_t ptr;
+    uint8_t setup;
+    uint8_t dimming;
+    bool oscillator;
+} ht16k33;
+
+static void ht16k33_write(sim_i2c_device_t *dev, const uint8_t *src, size_t len) {
+    (void)dev;
+    if (len == 0)
+        return;
+
+    uint8_t cmd = src[0];
+    switch (cmd & 0xF0) {
+        case 0x00:
+            ht16k33.ptr = cmd & 0x0F;
+            for (size_t i = 1; i < len; i++) {
+                ht16k33.ram[ht16k33.ptr] = src[i];
+                ht16k33.ptr = (ht16k33.ptr + 1) & 0x0F;
+            }
+            break;
+        case HT16K33_SYSTEM_STANDBY:
+            ht16k33.oscillator = cmd & 0x01;
+            break;
+        case HT16K33_DISPLAY_SETUP:
+            ht16k33.setup = cmd & 0x07;
+            break;
+        case HT16K33_BRIGHTNESS:
+            ht16k33.dimming = cmd & 0x0F;
+            break;
+        default:
+            break;
+    }
+}
+
+static void ht16k33_read(sim_i2c_device_t *dev, uint8_t *dst, size_t len) {
+    (void)dev;
+    for (size_t i = 0; i < len; i++) {
+        dst[i] = ht16k33.ram[ht16k33.ptr];
+        ht16k33.ptr = (ht16k33.ptr + 1) & 0x0F;
+    }
+}
+
+void sim_ht16k33_attach(void) {
+    memset(&ht16k33, 0, sizeof(ht16k33));
+    ht16k33.dev.name = "ht16k33";
+    ht16k33.dev.address = HT16K33_ADDRESS;
+    ht16k33.dev.write = ht16k33_write;
+    ht16k33.dev.read = ht16k33_read;
+    // fast mode, per the datasheet
+    ht16k33.dev.max_hz = 400 * 1000;
+    sim_i2c_attach(&ht16k33.dev);
+}
+
+const uint8_t *sim_ht16k33_ram(void) {
+    return ht16k33.ram;
+}
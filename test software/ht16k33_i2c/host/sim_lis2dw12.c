@@ -0,0 +1,266 @@
+#include <math.h>
+#include <string.h>
+#include "board.h"
+#include "lis2dw12.h"
+#include "sim.h"
+
+/* LIS2DW12 register file in high performance mode. Samples are generated on
+   the ODR grid from the moment ODR leaves power down, like on the MMA8451Q
+   model, and read through OUT_X_L..OUT_Z_H, little-endian and 14 bits
+   left-justified.
+
+   With FMode set in FIFO_CTRL every sample also goes into a 32 deep FIFO,
+   popped one sample at a time by reading OUT_X_L. The register address
+   rolls back from OUT_Z_H to OUT_X_L while the FIFO is on, so one burst
+   drains several samples. Continuous mode overwrites the oldest sample when
+   full, FIFO mode stops.
+
+   Data-ready and FIFO threshold can be routed to INT1, which is push-pull
+   and active high unless H_LACTIVE is set. Only INT1 is modeled, there are
+   no embedded functions.
+
+   The output carries a fixed zero-g offset, which X_OFS_USR..Z_OFS_USR
+   correct once USR_OFF_ON_OUT is set in CTRL7.
+*/
+
+#define NUM_REGS 0x40
+
+static const uint8_t reset_values[NUM_REGS] = {
+    [LIS2DW12_WHO_AM_I] = LIS2DW12_DEVICE_ID,
+    [LIS2DW12_CTRL2] = LIS2DW12_CTRL2_IF_ADD_INC,
+};
+
+// Zero-g offset of this part, in g
+static const double zero_g_offset[3] = {-0.031, 0.012, -0.045};
+
+// Its internal oscillator runs this much fast, in ppm of the sample period
+#define OSCILLATOR_PPM -700
+
+static struct {
+    sim_i2c_device_t dev;
+    uint8_t regs[NUM_REGS];
+    uint8_t ptr;
+    uint64_t active_since_ns;
+    int64_t last_read_sample;
+    int64_t last_produced_sample;
+    int16_t fifo[LIS2DW12_FIFO_SIZE][3];
+    uint8_t fifo_head;
+    uint8_t fifo_count;
+    bool fifo_overflow;
+} lis;
+
+static uint8_t odr_code(void) {
+    return lis.regs[LIS2DW12_CTRL1] >> LIS2DW12_CTRL1_ODR_SHIFT;
+}
+
+static bool active(void) {
+    return odr_code() != LIS2DW12_ODR_OFF;
+}
+
+// Code 1 is 12.5 Hz in high performance mode, the same as code 2
+static uint64_t period_ns(void) {
+    uint8_t code = odr_code() < LIS2DW12_ODR_12_5HZ ? LIS2DW12_ODR_12_5HZ : odr_code();
+    if (code > LIS2DW12_ODR_1600HZ)
+        code = LIS2DW12_ODR_1600HZ;
+    // 12.5 Hz doubling with every step
+    return (80000000ull >> (code - LIS2DW12_ODR_12_5HZ)) * (1000000 + OSCILLATOR_PPM) / 1000000;
+}
+
+// Index of the newest completed sample, -1 before the first one
+static int64_t current_sample(void) {
+    if (!active())
+        return -1;
+    return (int64_t)((sim_time_ns() - lis.active_since_ns) / period_ns()) - 1;
+}
+
+static void sample_counts(int64_t n, int16_t out[3]) {
+    double g[3];
+    sim_motion_g(lis.active_since_ns + (n + 1) * period_ns(), g);
+    uint8_t fs = (lis.regs[LIS2DW12_CTRL6] >> LIS2DW12_CTRL6_FS_SHIFT) & 0x03;
+    double counts_per_g = 4096 >> fs;
+    uint8_t ctrl7 = lis.regs[LIS2DW12_CTRL7];
+    double step_g = (ctrl7 & LIS2DW12_CTRL7_USR_OFF_W) ? 1 / 64.0 : 1 / 1024.0;
+
+    for (int i = 0; i < 3; i++) {
+        double offset = zero_g_offset[i];
+        if (ctrl7 & LIS2DW12_CTRL7_USR_OFF_ON_OUT)
+            offset -= (int8_t)lis.regs[LIS2DW12_X_OFS_USR + i] * step_g;
+        long v = lround((g[i] + offset) * counts_per_g);
+        if (v > 8191) v = 8191;
+        if (v < -8192) v = -8192;
+        out[i] = (int16_t)(v * 4);
+    }
+}
+
+static uint8_t fifo_mode(void) {
+    return lis.regs[LIS2DW12_FIFO_CTRL] >> LIS2DW12_FIFO_CTRL_FMODE_SHIFT;
+}
+
+static bool fifo_threshold_reached(void) {
+    uint8_t fth = lis.regs[LIS2DW12_FIFO_CTRL] & LIS2DW12_FIFO_CTRL_FTH_MASK;
+    return fifo_mode() != LIS2DW12_FMODE_BYPASS && fth && lis.fifo_count >= fth;
+}
+
+static void produce_samples(void) {
+    int64_t n = current_sample();
+
+    for (int64_t i = lis.last_produced_sample + 1; i <= n; i++) {
+        if (fifo_mode() == LIS2DW12_FMODE_BYPASS)
+            continue;
+        if (lis.fifo_count == LIS2DW12_FIFO_SIZE) {
+            lis.fifo_overflow = true;
+            if (fifo_mode() != LIS2DW12_FMODE_CONTINUOUS)
+                continue;
+            lis.fifo_head = (lis.fifo_head + 1) % LIS2DW12_FIFO_SIZE;
+            lis.fifo_count--;
+        }
+        sample_counts(i, lis.fifo[(lis.fifo_head + lis.fifo_count) % LIS2DW12_FIFO_SIZE]);
+        lis.fifo_count++;
+    }
+    if (n > lis.last_produced_sample)
+        lis.last_produced_sample = n;
+}
+
+static void update_interrupts(void) {
+    uint8_t route = lis.regs[LIS2DW12_CTRL4_INT1];
+    bool drdy = fifo_mode() == LIS2DW12_FMODE_BYPASS && current_sample() > lis.last_read_sample;
+    bool int1 = ((route & LIS2DW12_INT1_DRDY) && drdy) || ((route & LIS2DW12_INT1_FTH) && fifo_threshold_reached());
+    bool active_low = lis.regs[LIS2DW12_CTRL3] & LIS2DW12_CTRL3_H_LACTIVE;
+
+    sim_gpio_set_input(ACCEL_INT1_PIN, int1 != active_low);
+}
+
+static uint64_t lis_tick(uint64_t now_ns) {
+    (void)now_ns;
+    produce_samples();
+    update_interrupts();
+    if (!active())
+        return UINT64_MAX;
+    return lis.active_since_ns + (current_sample() + 2) * period_ns();
+}
+
+static void latch_sample(void) {
+    int16_t counts[3];
+    int64_t n = current_sample();
+
+    if (fifo_mode() != LIS2DW12_FMODE_BYPASS) {
+        if (lis.fifo_count == 0)
+            return;
+        memcpy(counts, lis.fifo[lis.fifo_head], sizeof(counts));
+        lis.fifo_head = (lis.fifo_head + 1) % LIS2DW12_FIFO_SIZE;
+        lis.fifo_count--;
+    } else if (n < 0) {
+        memset(&lis.regs[LIS2DW12_OUT_X_L], 0, 6);
+        return;
+    } else {
+        sample_counts(n, counts);
+    }
+    for (int i = 0; i < 3; i++) {
+        lis.regs[LIS2DW12_OUT_X_L + 2 * i] = counts[i] & 0xFF;
+        lis.regs[LIS2DW12_OUT_X_H + 2 * i] = (uint16_t)counts[i] >> 8;
+    }
+    lis.last_read_sample = n;
+}
+
+static uint8_t status(void) {
+    uint8_t s = 0;
+
+    if (current_sample() > lis.last_read_sample)
+        s |= LIS2DW12_STATUS_DRDY;
+    if (fifo_threshold_reached())
+        s |= LIS2DW12_STATUS_FIFO_THS;
+    return s;
+}
+
+static uint8_t fifo_samples(void) {
+    uint8_t s = lis.fifo_count;
+
+    if (fifo_threshold_reached())
+        s |= LIS2DW12_FIFO_SAMPLES_FTH;
+    if (lis.fifo_overflow)
+        s |= LIS2DW12_FIFO_SAMPLES_OVR;
+    lis.fifo_overflow = false;
+    return s;
+}
+
+static uint8_t next_address(uint8_t ptr) {
+    if (!(lis.regs[LIS2DW12_CTRL2] & LIS2DW12_CTRL2_IF_ADD_INC))
+        return ptr;
+    if (ptr == LIS2DW12_OUT_Z_H && fifo_mode() != LIS2DW12_FMODE_BYPASS)
+        return LIS2DW12_OUT_X_L;
+    return (ptr + 1) % NUM_REGS;
+}
+
+static bool read_only(uint8_t reg) {
+    return reg == LIS2DW12_WHO_AM_I || reg == LIS2DW12_STATUS || reg == LIS2DW12_FIFO_SAMPLES ||
+           (reg >= LIS2DW12_OUT_T_L && reg <= LIS2DW12_OUT_T_H) || reg == LIS2DW12_OUT_T ||
+           (reg >= LIS2DW12_OUT_X_L && reg <= LIS2DW12_OUT_Z_H);
+}
+
+static void reset(void) {
+    memcpy(lis.regs, reset_values, sizeof(lis.regs));
+    lis.last_read_sample = -1;
+    lis.last_produced_sample = -1;
+    lis.fifo_head = 0;
+    lis.fifo_count = 0;
+    lis.fifo_overflow = false;
+}
+
+static void lis_write(sim_i2c_device_t *dev, const uint8_t *src, size_t len) {
+    (void)dev;
+    if (len == 0)
+        return;
+
+    produce_samples();
+    lis.ptr = src[0] % NUM_REGS;
+    for (size_t i = 1; i < len; i++) {
+        uint8_t reg = lis.ptr;
+        if (reg == LIS2DW12_CTRL2 && (src[i] & LIS2DW12_CTRL2_SOFT_RESET)) {
+            reset();
+            break;
+        }
+        if (reg == LIS2DW12_CTRL1 && (src[i] >> LIS2DW12_CTRL1_ODR_SHIFT) != odr_code()) {
+            lis.active_since_ns = sim_time_ns();
+            lis.last_read_sample = -1;
+            lis.last_produced_sample = -1;
+        }
+        // bypass mode resets the FIFO
+        if (reg == LIS2DW12_FIFO_CTRL && (src[i] >> LIS2DW12_FIFO_CTRL_FMODE_SHIFT) == LIS2DW12_FMODE_BYPASS) {
+            lis.fifo_count = 0;
+            lis.fifo_overflow = false;
+        }
+        if (!read_only(reg))
+            lis.regs[reg] = src[i];
+        lis.ptr = next_address(reg);
+    }
+    update_interrupts();
+}
+
+static void lis_read(sim_i2c_device_t *dev, uint8_t *dst, size_t len) {
+    (void)dev;
+    produce_samples();
+    for (size_t i = 0; i < len; i++) {
+        uint8_t reg = lis.ptr;
+        if (reg == LIS2DW12_STATUS)
+            lis.regs[reg] = status();
+        else if (reg == LIS2DW12_FIFO_SAMPLES)
+            lis.regs[reg] = fifo_samples();
+        else if (reg == LIS2DW12_OUT_X_L)
+            latch_sample();
+        dst[i] = lis.regs[reg];
+        lis.ptr = next_address(reg);
+    }
+    update_interrupts();
+}
+
+void sim_lis2dw12_attach(void) {
+    memset(&lis, 0, sizeof(lis));
+    reset();
+    lis.dev.name = "lis2dw12";
+    lis.dev.address = LIS2DW12_ADDRESS;
+    lis.dev.write = lis_write;
+    lis.dev.read = lis_read;
+    lis.dev.max_hz = 400 * 1000;
+    sim_i2c_attach(&lis.dev);
+    sim_add_tick(lis_tick);
+}
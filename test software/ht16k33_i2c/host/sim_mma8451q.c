@@ -0,0 +1,477 @@
+#include <math.h>
+#include <string.h>
+#include "board.h"
+#include "mma8451q.h"
+#include "sim.h"
+
+/* MMA8451Q register file. Samples are generated on the ODR grid from the
+   moment the part goes active, so a reader polling too slowly sees skipped
+   samples and one polling too fast sees the same sample twice, like on the
+   real part. Interrupt sources enabled in CTRL_REG4 drive INT1 or INT2 as
+   routed by CTRL_REG5, active low unless IPOL is set in CTRL_REG3.
+
+   With F_MODE set in F_SETUP, every sample is also pushed to a 32 deep FIFO
+   that is popped one sample at a time by reading OUT_X_MSB.
+
+   The embedded freefall/motion, transient, tap and orientation engines are
+   modeled coarsely, enough to raise their interrupts at about the right
+   time: the high-pass filter is a fixed first order one, taps are single
+   axis, and the orientation trip angles are replaced by the dominant axis.
+   Reading a source register clears its event.
+
+   The output carries a fixed zero-g offset, which OFF_X..OFF_Z correct in
+   2 mg steps.
+*/
+
+#define FIFO_SIZE 32
+
+#define CTRL_REG3_IPOL 0x02
+
+// g per count of the FF_MT, TRANSIENT and PULSE thresholds
+#define THS_G 0.063
+// Per sample weight of the transient and pulse high-pass filter
+#define HPF_ALPHA 0.1
+
+// Zero-g offset of this part, in g
+static const double zero_g_offset[3] = {0.024, -0.016, 0.036};
+
+// Its internal oscillator runs this much slow, in ppm of the sample period
+#define OSCILLATOR_PPM 1200
+
+// Output data rates selected by CTRL_REG1 DR[2:0], in mHz
+static const uint32_t odr_mhz[8] = {800000, 400000, 200000, 100000, 50000, 12500, 6250, 1563};
+
+static struct {
+    sim_i2c_device_t dev;
+    uint8_t regs[0x32];
+    uint8_t ptr;
+    uint64_t active_since_ns;
+    int64_t last_read_sample;
+    int64_t last_produced_sample;
+    int16_t fifo[FIFO_SIZE][3];
+    uint8_t fifo_head;
+    uint8_t fifo_count;
+    bool fifo_overflow;
+    // embedded functions
+    int64_t last_engine_sample;
+    double hpf_lp[3];
+    uint8_t ff_mt_count;
+    uint8_t transient_count;
+    int64_t pulse_start;        // first sample above threshold, -1 if none
+    int pulse_axis;
+    bool pulse_negative;
+    uint64_t pulse_end_ns;
+    bool pulse_end_valid;
+    bool pulse_double_pending;
+    uint8_t pl_candidate;
+    uint8_t pl_count;
+} mma;
+
+
+static bool active(void) {
+    return mma.regs[MMA8451Q_CTRL_REG1] & MMA8451Q_CTRL_REG1_ACTIVE;
+}
+
+static uint64_t period_ns(void) {
+    uint8_t dr = (mma.regs[MMA8451Q_CTRL_REG1] & MMA8451Q_CTRL_REG1_DR_MASK) >> MMA8451Q_CTRL_REG1_DR_SHIFT;
+    return 1000000000000ull / odr_mhz[dr] * (1000000 + OSCILLATOR_PPM) / 1000000;
+}
+
+// Index of the newest completed sample, -1 before the first one
+static int64_t current_sample(void) {
+    if (!active())
+        return -1;
+    return (int64_t)((sim_time_ns() - mma.active_since_ns) / period_ns()) - 1;
+}
+
+// What the board feels when sample n completes, see sim_motion_g()
+static void sample_g(int64_t n, double g[3]) {
+    sim_motion_g(mma.active_since_ns + (n + 1) * period_ns(), g);
+}
+
+// Left-justified 14-bit counts at the selected range, offsets applied
+static void sample_counts(int64_t n, int16_t out[3]) {
+    double g[3];
+    sample_g(n, g);
+    double counts_per_g = 4096 >> (mma.regs[MMA8451Q_XYZ_DATA_CFG] & 0x03);
+
+    for (int i = 0; i < 3; i++) {
+        double offset = zero_g_offset[i] + (int8_t)mma.regs[MMA8451Q_OFF_X + i] * 2 / 1024.0;
+        long v = lround((g[i] + offset) * counts_per_g);
+        if (v > 8191) v = 8191;
+        if (v < -8192) v = -8192;
+        out[i] = (int16_t)(v * 4);
+    }
+}
+
+static uint8_t fifo_mode(void) {
+    return mma.regs[MMA8451Q_F_SETUP] >> MMA8451Q_F_SETUP_F_MODE_SHIFT;
+}
+
+static uint8_t fifo_watermark(void) {
+    return mma.regs[MMA8451Q_F_SETUP] & MMA8451Q_F_SETUP_F_WMRK_MASK;
+}
+
+static bool fifo_watermark_reached(void) {
+    return fifo_watermark() && mma.fifo_count >= fifo_watermark();
+}
+
+// Count consecutive samples meeting a condition, true on the one that
+// reaches the debounce count
+static bool debounce(uint8_t *counter, bool condition, uint8_t count) {
+    if (!condition) {
+        *counter = 0;
+        return false;
+    }
+    if (*counter > count)
+        return false;
+    return (*counter)++ == count;
+}
+
+// Event and polarity bits for the axes in FF_MT_SRC and TRANSIENT_SRC
+static uint8_t src_axes(const bool event[3], const bool negative[3]) {
+    uint8_t src = 0;
+    for (int i = 0; i < 3; i++)
+        src |= (event[i] << (2 * i + 1)) | (negative[i] << (2 * i));
+    return src;
+}
+
+static void ff_mt_sample(const double g[3]) {
+    uint8_t cfg = mma.regs[MMA8451Q_FF_MT_CFG];
+    double ths = (mma.regs[MMA8451Q_FF_MT_THS] & 0x7F) * THS_G;
+    bool motion = cfg & MMA8451Q_FF_MT_CFG_OAE;
+    bool above[3], negative[3];
+    bool any = false, all_below = true;
+
+    if (!(cfg & MMA8451Q_FF_MT_CFG_XYZ))
+        return;
+    for (int i = 0; i < 3; i++) {
+        bool enabled = cfg & (0x08 << i);
+        above[i] = enabled && fabs(g[i]) > ths;
+        negative[i] = g[i] < 0;
+        any |= above[i];
+        all_below &= !enabled || !above[i];
+    }
+    if (!debounce(&mma.ff_mt_count, motion ? any : all_below, mma.regs[MMA8451Q_FF_MT_COUNT]))
+        return;
+    mma.regs[MMA8451Q_FF_MT_SRC] = MMA8451Q_SRC_EA | (motion ? src_axes(above, negative) : 0);
+}
+
+static void transient_sample(const double hp[3]) {
+    uint8_t cfg = mma.regs[MMA8451Q_TRANSIENT_CFG];
+    double ths = (mma.regs[MMA8451Q_TRANSIENT_THS] & 0x7F) * THS_G;
+    bool above[3], negative[3];
+    bool any = false;
+
+    if (!(cfg & MMA8451Q_TRANSIENT_CFG_XYZ))
+        return;
+    for (int i = 0; i < 3; i++) {
+        above[i] = (cfg & (0x02 << i)) && fabs(hp[i]) > ths;
+        negative[i] = hp[i] < 0;
+        any |= above[i];
+    }
+    if (!debounce(&mma.transient_count, any, mma.regs[MMA8451Q_TRANSIENT_COUNT]))
+        return;
+    mma.regs[MMA8451Q_TRANSIENT_SRC] = MMA8451Q_TRANSIENT_SRC_EA | src_axes(above, negative);
+}
+
+// A tap is a pulse over threshold that falls back within PULSE_TMLT. A second
+// one starting after PULSE_LTCY and within PULSE_WIND makes a double tap.
+// TMLT counts quarter sample periods, LTCY and WIND half periods.
+static void pulse_sample(int64_t n, const double hp[3]) {
+    uint8_t cfg = mma.regs[MMA8451Q_PULSE_CFG];
+    uint64_t now_ns = mma.active_since_ns + (n + 1) * period_ns();
+    int axis = -1;
+
+    if (!(cfg & (MMA8451Q_PULSE_CFG_SINGLE | MMA8451Q_PULSE_CFG_DOUBLE)))
+        return;
+    for (int i = 0; i < 3; i++) {
+        double ths = (mma.regs[MMA8451Q_PULSE_THSX + i] & 0x7F) * THS_G;
+        if ((cfg & (0x03 << (2 * i))) && fabs(hp[i]) > ths && (axis < 0 || fabs(hp[i]) > fabs(hp[axis])))
+            axis = i;
+    }
+    if (mma.pulse_start < 0) {
+        if (axis < 0)
+            return;
+        if (mma.pulse_end_valid && now_ns < mma.pulse_end_ns + mma.regs[MMA8451Q_PULSE_LTCY] * period_ns() / 2)
+            return;
+        mma.pulse_start = n;
+        mma.pulse_axis = axis;
+        mma.pulse_negative = hp[axis] < 0;
+        return;
+    }
+    if (axis >= 0)
+        return;
+
+    // pulse over, was it short enough
+    uint64_t start_ns = now_ns - (n - mma.pulse_start) * period_ns();
+    mma.pulse_start = -1;
+    if (now_ns - start_ns > mma.regs[MMA8451Q_PULSE_TMLT] * period_ns() / 4)
+        return;
+
+    uint64_t window_ns = mma.regs[MMA8451Q_PULSE_WIND] * period_ns() / 2;
+    uint64_t latency_ns = mma.regs[MMA8451Q_PULSE_LTCY] * period_ns() / 2;
+    bool second = mma.pulse_double_pending && start_ns - mma.pulse_end_ns <= latency_ns + window_ns;
+    uint8_t src = MMA8451Q_SRC_EA | (0x10 << mma.pulse_axis) | (mma.pulse_negative << mma.pulse_axis);
+
+    if (second && (cfg & (0x02 << (2 * mma.pulse_axis)))) {
+        mma.regs[MMA8451Q_PULSE_SRC] = src | MMA8451Q_PULSE_SRC_DPE;
+        mma.pulse_double_pending = false;
+    } else {
+        if (cfg & (0x01 << (2 * mma.pulse_axis)))
+            mma.regs[MMA8451Q_PULSE_SRC] = src;
+        mma.pulse_double_pending = window_ns != 0;
+    }
+    mma.pulse_end_ns = now_ns;
+    mma.pulse_end_valid = true;
+}
+
+// Dominant axis of the tilt instead of the datasheet trip angles. Z within
+// about 30 degrees of vertical locks out portrait/landscape changes.
+static void pl_sample(const double g[3]) {
+    uint8_t status = mma.regs[MMA8451Q_PL_STATUS];
+    uint8_t lapo = (status & MMA8451Q_PL_STATUS_LAPO_MASK) >> 1;
+    bool lockout = hypot(g[0], g[1]) < 0.5;
+
+    if (!(mma.regs[MMA8451Q_PL_CFG] & MMA8451Q_PL_CFG_PL_EN))
+        return;
+    if (!lockout) {
+        if (fabs(g[1]) >= fabs(g[0]))
+            lapo = g[1] < 0 ? MMA8451Q_PORTRAIT_UP : MMA8451Q_PORTRAIT_DOWN;
+        else
+            lapo = g[0] > 0 ? MMA8451Q_LANDSCAPE_RIGHT : MMA8451Q_LANDSCAPE_LEFT;
+    }
+    uint8_t next = (lapo << 1) | (g[2] < 0 ? MMA8451Q_PL_STATUS_BAFRO : 0) | (lockout ? MMA8451Q_PL_STATUS_LO : 0);
+    uint8_t shown = status & ~MMA8451Q_PL_STATUS_NEWLP;
+
+    if (next == shown) {
+        mma.pl_count = 0;
+        return;
+    }
+    if (next != mma.pl_candidate) {
+        mma.pl_candidate = next;
+        mma.pl_count = 0;
+    }
+    if (mma.pl_count++ < mma.regs[MMA8451Q_PL_COUNT])
+        return;
+    mma.pl_count = 0;
+    // only a change of position or side is news, not the lockout flag alone
+    bool news = (next ^ shown) & ~MMA8451Q_PL_STATUS_LO;
+    mma.regs[MMA8451Q_PL_STATUS] = next | (news ? MMA8451Q_PL_STATUS_NEWLP : (status & MMA8451Q_PL_STATUS_NEWLP));
+}
+
+// Run the embedded functions on every sample completed since the last call
+static void engine_samples(void) {
+    int64_t n = current_sample();
+
+    for (int64_t i = mma.last_engine_sample + 1; i <= n; i++) {
+        double g[3], hp[3];
+
+        sample_g(i, g);
+        for (int a = 0; a < 3; a++) {
+            if (i == 0)
+                mma.hpf_lp[a] = g[a];
+            hp[a] = g[a] - mma.hpf_lp[a];
+            mma.hpf_lp[a] += HPF_ALPHA * hp[a];
+        }
+        ff_mt_sample(g);
+        transient_sample(hp);
+        pulse_sample(i, hp);
+        pl_sample(g);
+    }
+    if (n > mma.last_engine_sample)
+        mma.last_engine_sample = n;
+}
+
+// Push every sample completed since the last call into the FIFO
+static void produce_samples(void) {
+    int64_t n = current_sample();
+
+    engine_samples();
+    for (int64_t i = mma.last_produced_sample + 1; i <= n; i++) {
+        if (fifo_mode() == MMA8451Q_F_MODE_OFF)
+            continue;
+        if (mma.fifo_count == FIFO_SIZE) {
+            mma.fifo_overflow = true;
+            if (fifo_mode() != MMA8451Q_F_MODE_CIRCULAR)
+                continue;
+            // circular mode drops the oldest sample
+            mma.fifo_head = (mma.fifo_head + 1) % FIFO_SIZE;
+            mma.fifo_count--;
+        }
+        sample_counts(i, mma.fifo[(mma.fifo_head + mma.fifo_count) % FIFO_SIZE]);
+        mma.fifo_count++;
+    }
+    if (n > mma.last_produced_sample)
+        mma.last_produced_sample = n;
+}
+
+static void update_interrupts(void) {
+    uint8_t source = 0;
+
+    if (fifo_mode() == MMA8451Q_F_MODE_OFF) {
+        if (current_sample() > mma.last_read_sample)
+            source |= MMA8451Q_INT_DRDY;
+    } else if (fifo_watermark_reached() || mma.fifo_overflow) {
+        source |= MMA8451Q_INT_FIFO;
+    }
+    if (mma.regs[MMA8451Q_FF_MT_SRC] & MMA8451Q_SRC_EA)
+        source |= MMA8451Q_INT_FF_MT;
+    if (mma.regs[MMA8451Q_TRANSIENT_SRC] & MMA8451Q_TRANSIENT_SRC_EA)
+        source |= MMA8451Q_INT_TRANS;
+    if (mma.regs[MMA8451Q_PULSE_SRC] & MMA8451Q_SRC_EA)
+        source |= MMA8451Q_INT_PULSE;
+    if (mma.regs[MMA8451Q_PL_STATUS] & MMA8451Q_PL_STATUS_NEWLP)
+        source |= MMA8451Q_INT_LNDPRT;
+    source &= mma.regs[MMA8451Q_CTRL_REG4];
+    mma.regs[MMA8451Q_INT_SOURCE] = source;
+
+    bool int1 = source & mma.regs[MMA8451Q_CTRL_REG5];
+    bool int2 = source & ~mma.regs[MMA8451Q_CTRL_REG5];
+    bool ipol = mma.regs[MMA8451Q_CTRL_REG3] & CTRL_REG3_IPOL;
+    sim_gpio_set_input(ACCEL_INT1_PIN, int1 == ipol);
+    sim_gpio_set_input(ACCEL_INT2_PIN, int2 == ipol);
+}
+
+static uint64_t mma_tick(uint64_t now_ns) {
+    (void)now_ns;
+    produce_samples();
+    update_interrupts();
+    if (!active())
+        return UINT64_MAX;
+    // completion of the sample after the current one
+    return mma.active_since_ns + (current_sample() + 2) * period_ns();
+}
+
+static void latch_sample(void) {
+    int16_t counts[3];
+    int64_t n = current_sample();
+
+    if (fifo_mode() != MMA8451Q_F_MODE_OFF) {
+        // reading an empty FIFO leaves the last sample in place
+        if (mma.fifo_count == 0)
+            return;
+        memcpy(counts, mma.fifo[mma.fifo_head], sizeof(counts));
+        mma.fifo_head = (mma.fifo_head + 1) % FIFO_SIZE;
+        mma.fifo_count--;
+    } else if (n < 0) {
+        memset(&mma.regs[MMA8451Q_OUT_X_MSB], 0, 6);
+        return;
+    } else {
+        sample_counts(n, counts);
+    }
+    for (int i = 0; i < 3; i++) {
+        mma.regs[MMA8451Q_OUT_X_MSB + 2 * i] = (uint16_t)counts[i] >> 8;
+        mma.regs[MMA8451Q_OUT_X_LSB + 2 * i] = counts[i] & 0xFF;
+    }
+    mma.last_read_sample = n;
+}
+
+static uint8_t status(void) {
+    int64_t n = current_sample();
+    uint8_t s = 0;
+
+    if (fifo_mode() != MMA8451Q_F_MODE_OFF) {
+        s = mma.fifo_count;
+        if (mma.fifo_overflow)
+            s |= MMA8451Q_F_STATUS_F_OVF;
+        if (fifo_watermark_reached())
+            s |= MMA8451Q_F_STATUS_F_WMRK_FLAG;
+        // reading F_STATUS clears the overflow flag
+        mma.fifo_overflow = false;
+        return s;
+    }
+    if (n > mma.last_read_sample)
+        s |= MMA8451Q_STATUS_ZYXDR;
+    if (n > mma.last_read_sample + 1)
+        s |= MMA8451Q_STATUS_ZYXOW;
+    return s;
+}
+
+static uint8_t next_address(uint8_t ptr) {
+    bool fifo = fifo_mode() != MMA8451Q_F_MODE_OFF;
+    bool fast = mma.regs[MMA8451Q_CTRL_REG1] & MMA8451Q_CTRL_REG1_F_READ;
+
+    if (fast) {
+        if (ptr == MMA8451Q_OUT_X_MSB || ptr == MMA8451Q_OUT_Y_MSB)
+            return ptr + 2;
+        if (ptr == MMA8451Q_OUT_Z_MSB)
+            return fifo ? MMA8451Q_OUT_X_MSB : MMA8451Q_F_STATUS;
+    } else if (ptr == MMA8451Q_OUT_Z_LSB && fifo) {
+        return MMA8451Q_OUT_X_MSB;
+    }
+    return ptr >= MMA8451Q_OFF_Z ? 0 : ptr + 1;
+}
+
+static bool read_only(uint8_t reg) {
+    return reg == MMA8451Q_WHO_AM_I || reg == MMA8451Q_INT_SOURCE || reg == MMA8451Q_PL_STATUS ||
+           reg == MMA8451Q_FF_MT_SRC || reg == MMA8451Q_TRANSIENT_SRC || reg == MMA8451Q_PULSE_SRC;
+}
+
+static void mma_write(sim_i2c_device_t *dev, const uint8_t *src, size_t len) {
+    (void)dev;
+    if (len == 0)
+        return;
+
+    mma.ptr = src[0];
+    for (size_t i = 1; i < len; i++) {
+        uint8_t reg = mma.ptr;
+        if (reg == MMA8451Q_CTRL_REG1 && (src[i] & MMA8451Q_CTRL_REG1_ACTIVE) &&
+            !(mma.regs[reg] & MMA8451Q_CTRL_REG1_ACTIVE)) {
+            mma.active_since_ns = sim_time_ns();
+            mma.last_read_sample = -1;
+            mma.last_produced_sample = -1;
+            mma.last_engine_sample = -1;
+            mma.ff_mt_count = 0;
+            mma.transient_count = 0;
+            mma.pulse_start = -1;
+            mma.pulse_end_valid = false;
+            mma.pulse_double_pending = false;
+        }
+        if (reg == MMA8451Q_F_SETUP && (src[i] >> MMA8451Q_F_SETUP_F_MODE_SHIFT) == MMA8451Q_F_MODE_OFF) {
+            mma.fifo_count = 0;
+            mma.fifo_overflow = false;
+        }
+        if (reg < sizeof(mma.regs) && !read_only(reg))
+            mma.regs[reg] = src[i];
+        mma.ptr = next_address(reg);
+    }
+    update_interrupts();
+}
+
+static void mma_read(sim_i2c_device_t *dev, uint8_t *dst, size_t len) {
+    (void)dev;
+    produce_samples();
+    for (size_t i = 0; i < len; i++) {
+        uint8_t reg = mma.ptr;
+        if (reg == MMA8451Q_F_STATUS)
+            mma.regs[reg] = status();
+        else if (reg == MMA8451Q_OUT_X_MSB)
+            latch_sample();
+        dst[i] = reg < sizeof(mma.regs) ? mma.regs[reg] : 0;
+        // reading a source register acknowledges its event
+        if (reg == MMA8451Q_FF_MT_SRC || reg == MMA8451Q_TRANSIENT_SRC || reg == MMA8451Q_PULSE_SRC)
+            mma.regs[reg] = 0;
+        else if (reg == MMA8451Q_PL_STATUS)
+            mma.regs[reg] &= ~MMA8451Q_PL_STATUS_NEWLP;
+        mma.ptr = next_address(reg);
+    }
+    update_interrupts();
+}
+
+void sim_mma8451q_attach(void) {
+    memset(&mma, 0, sizeof(mma));
+    mma.regs[MMA8451Q_WHO_AM_I] = MMA8451Q_DEVICE_ID;
+    mma.last_read_sample = -1;
+    mma.last_produced_sample = -1;
+    mma.last_engine_sample = -1;
+    mma.pulse_start = -1;
+    mma.dev.name = "mma8451q";
+    mma.dev.address = MMA8451Q_ADDRESS;
+    mma.dev.write = mma_write;
+    mma.dev.read = mma_read;
+    // fast mode, per the datasheet
+    mma.dev.max_hz = 400 * 1000;
+    sim_i2c_attach(&mma.dev);
+    sim_add_tick(mma_tick);
+}
@@ -0,0 +1,68 @@
+#include <math.h>
+#include <string.h>
+#include "sim.h"
+
+// What the board feels, shared by the simulated accelerometers
+
+#define MAX_MOTIONS 16
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+static struct {
+    enum { MOTION_TAP, MOTION_SHAKE, MOTION_DROP, MOTION_TILT } kind;
+    uint64_t start_ns;
+    uint64_t end_ns;
+} motions[MAX_MOTIONS];
+static int num_motions;
+
+// Slow tilt around 1 g on Z, or a recorded trace, plus any disturbances
+// added from the command line
+void sim_motion_g(uint64_t at_ns, double g[3]) {
+    double t = at_ns / 1e9;
+
+    if (!sim_trace_g(at_ns, g)) {
+        g[0] = 0.05 * sin(2 * M_PI * t);
+        g[1] = 0.05 * cos(2 * M_PI * t);
+        g[2] = 1.0;
+    }
+    for (int i = 0; i < num_motions; i++) {
+        if (at_ns < motions[i].start_ns || at_ns >= motions[i].end_ns)
+            continue;
+        switch (motions[i].kind) {
+        case MOTION_TAP:
+            g[2] += 2.0;
+            break;
+        case MOTION_SHAKE:
+            g[0] += 0.8 * sin(2 * M_PI * 5 * (at_ns - motions[i].start_ns) / 1e9);
+            break;
+        case MOTION_DROP:
+            g[0] = g[1] = g[2] = 0;
+            break;
+        case MOTION_TILT:
+            g[0] = 1.0;
+            g[2] = 0.05;
+            break;
+        }
+    }
+}
+
+bool sim_motion_add(const char *kind, uint64_t start_ns, uint64_t end_ns) {
+    static const char *const names[] = {
+        [MOTION_TAP] = "tap", [MOTION_SHAKE] = "shake", [MOTION_DROP] = "drop", [MOTION_TILT] = "tilt",
+    };
+
+    if (num_motions == MAX_MOTIONS)
+        return false;
+    for (size_t i = 0; i < sizeof(names) / sizeof(names[0]); i++) {
+        if (!strcmp(kind, names[i])) {
+            motions[num_motions].kind = i;
+            motions[num_motions].start_ns = start_ns;
+            motions[num_motions].end_ns = end_ns;
+            num_motions++;
+            return true;
+        }
+    }
+    return false;
+}
@@ -0,0 +1,176 @@
+#include <stdlib.h>
+#include <string.h>
+#include "accel.h"
+#include "board.h"
+#include "sim.h"
+#include "telemetry.h"
+
+// A recorded run played back through the simulated board: acceleration for
+// both accelerometers and the buttons and switches, from the CSV written by
+// telemetry_decode or straight from a binary telemetry capture. Time starts
+// at the first sample of the trace.
+
+typedef struct {
+    uint64_t at_ns;     // from the start of the trace
+    double g[3];
+    uint16_t inputs;    // as in the telemetry records
+} trace_point_t;
+
+static trace_point_t *points;
+static size_t num_points;
+static size_t cap_points;
+
+static void trace_add(uint64_t timestamp_us, int16_t x, int16_t y, int16_t z, uint16_t inputs) {
+    static uint64_t first_us;
+
+    if (num_points == cap_points) {
+        cap_points = cap_points ? 2 * cap_points : 4096;
+        points = realloc(points, cap_points * sizeof(*points));
+        if (!points) {
+            perror("trace");
+            exit(EXIT_FAILURE);
+        }
+    }
+    if (num_points == 0)
+        first_us = timestamp_us;
+    // a sample that goes back in time, such as from a restart in the middle
+    // of a capture, is left out
+    if (num_points && (timestamp_us < first_us || (timestamp_us - first_us) * 1000 < points[num_points - 1].at_ns))
+        return;
+    trace_point_t *p = &points[num_points++];
+    p->at_ns = (timestamp_us - first_us) * 1000;
+    p->g[0] = (double)x / ACCEL_Q12_ONE_G;
+    p->g[1] = (double)y / ACCEL_Q12_ONE_G;
+    p->g[2] = (double)z / ACCEL_Q12_ONE_G;
+    p->inputs = inputs;
+}
+
+// timestamp_us,seq,x,y,z,x_g,y_g,z_g,buttons,switches,...
+static void trace_load_csv(FILE *in) {
+    char line[256];
+
+    while (fgets(line, sizeof(line), in)) {
+        unsigned long long timestamp_us;
+        int x, y, z;
+        unsigned int buttons, switches;
+
+        if (sscanf(line, "%llu,%*u,%d,%d,%d,%*f,%*f,%*f,%x,%x", &timestamp_us, &x, &y, &z, &buttons,
+                   &switches) == 6)
+            trace_add(timestamp_us, x, y, z, (buttons & 0x0f) | ((switches & 0xff) << 4));
+    }
+}
+
+// Same framing as telemetry_decode: skip to the next sync byte on anything
+// that is not a valid record, and take the upper time bits from sync records
+static void trace_load_binary(FILE *in) {
+    uint8_t buf[TELEMETRY_RECORD_SIZE];
+    size_t len = 0;
+    uint64_t last_time = 0;
+    bool have_time = false;
+
+    for (;;) {
+        len += fread(&buf[len], 1, sizeof(buf) - len, in);
+        if (len < sizeof(buf))
+            break;
+        if (buf[0] != TELEMETRY_SYNC ||
+            telemetry_crc8(buf, TELEMETRY_RECORD_SIZE - 1) != buf[TELEMETRY_RECORD_SIZE - 1]) {
+            memmove(buf, buf + 1, --len);
+            continue;
+        }
+        len = 0;
+        if (buf[14] & TELEMETRY_FLAG_TIME_SYNC) {
+            last_time = 0;
+            for (int i = 0; i < 8; i++)
+                last_time |= (uint64_t)buf[2 + i] << (8 * i);
+            have_time = true;
+            continue;
+        }
+        uint32_t t = buf[2] | (buf[3] << 8) | (buf[4] << 16) | ((uint32_t)buf[5] << 24);
+        uint64_t timestamp_us = have_time ? last_time + (int32_t)(t - (uint32_t)last_time) : t;
+        last_time = timestamp_us;
+        have_time = true;
+        trace_add(timestamp_us, (int16_t)(buf[6] | (buf[7] << 8)), (int16_t)(buf[8] | (buf[9] << 8)),
+                  (int16_t)(buf[10] | (buf[11] << 8)), buf[12] | (buf[13] << 8));
+    }
+}
+
+bool sim_trace_load(const char *path) {
+    FILE *in = fopen(path, "rb");
+    if (!in)
+        return false;
+
+    // the CSV starts with its header, a capture with a record or console text
+    int first = fgetc(in);
+    rewind(in);
+    num_points = 0;
+    if (first == 't')
+        trace_load_csv(in);
+    else
+        trace_load_binary(in);
+    fclose(in);
+    return num_points > 0;
+}
+
+uint64_t sim_trace_duration_ns(void) {
+    return num_points ? points[num_points - 1].at_ns : 0;
+}
+
+// Last point at or before at_ns, num_points if there is none
+static size_t trace_find(uint64_t at_ns) {
+    size_t lo = 0, hi = num_points;
+
+    if (num_points == 0 || at_ns > points[num_points - 1].at_ns)
+        return num_points;
+    while (hi - lo > 1) {
+        size_t mid = (lo + hi) / 2;
+        if (points[mid].at_ns <= at_ns)
+            lo = mid;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+bool sim_trace_g(uint64_t at_ns, double g[3]) {
+    size_t i = trace_find(at_ns);
+    if (i == num_points)
+        return false;
+
+    // linear between the recorded samples, a sensor running at another rate
+    // than the recording still sees a smooth signal
+    const trace_point_t *a = &points[i];
+    const trace_point_t *b = i + 1 < num_points ? &points[i + 1] : a;
+    double f = b->at_ns > a->at_ns ? (double)(at_ns - a->at_ns) / (b->at_ns - a->at_ns) : 0;
+    for (int axis = 0; axis < 3; axis++)
+        g[axis] = a->g[axis] + f * (b->g[axis] - a->g[axis]);
+    return true;
+}
+
+// Buttons and switches follow the trace, pressed or on is low. Ticks run
+// whenever time moves, so the next change is worked out once.
+static uint64_t next_input_ns;
+
+static uint64_t trace_inputs_tick(uint64_t now_ns) {
+    if (now_ns < next_input_ns)
+        return next_input_ns;
+
+    size_t i = trace_find(now_ns);
+    if (i == num_points)
+        return next_input_ns = UINT64_MAX;
+    uint16_t inputs = points[i].inputs;
+    for (int b = 0; b < 4; b++)
+        sim_gpio_set_input(BTN1 + b, !(inputs & (1u << b)));
+    for (int s = 0; s < 8; s++)
+        sim_gpio_set_input(SW1 + s, !(inputs & (1u << (4 + s))));
+
+    while (++i < num_points && points[i].inputs == inputs)
+        ;
+    next_input_ns = i < num_points ? points[i].at_ns : UINT64_MAX;
+    return next_input_ns;
+}
+
+void sim_trace_attach(void) {
+    next_input_ns = 0;
+    if (num_points)
+        sim_add_tick(trace_inputs_tick);
+}
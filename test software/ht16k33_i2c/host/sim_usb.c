@@ -0,0 +1,49 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <string.h>
+#include "sim.h"
+
+// The USB CDC console. Output written to the stream from sim_usb_open()
+// is passed on and takes the time it would need on a full-speed link, so
+// printing shows up in the profile like bus time. Interrupt handlers do not
+// print, on the board either, so time can move in the middle of a write.
+
+#define USB_BYTES_PER_S (1000 * 1000)
+
+static struct {
+    FILE *out;
+    sim_bus_stats_t stats;
+} usb;
+
+static ssize_t usb_write(void *cookie, const char *buf, size_t len) {
+    (void)cookie;
+    size_t written = fwrite(buf, 1, len, usb.out);
+    uint64_t ns = (uint64_t)written * 1000000000ull / USB_BYTES_PER_S;
+
+    usb.stats.transactions++;
+    usb.stats.bytes += written;
+    usb.stats.busy_ns += ns;
+    sim_advance_ns(ns);
+    return (ssize_t)written;
+}
+
+FILE *sim_usb_open(FILE *out) {
+    cookie_io_functions_t io = { .write = usb_write };
+
+    memset(&usb, 0, sizeof(usb));
+    usb.out = out;
+    FILE *stream = fopencookie(NULL, "w", io);
+    // line buffered like a terminal, so each line goes out when printed
+    if (stream)
+        setvbuf(stream, NULL, _IOLBF, BUFSIZ);
+    return stream;
+}
+
+void sim_usb_report(FILE *out) {
+    if (!usb.out)
+        return;
+    double pct = sim_time_ns() ? 100.0 * usb.stats.busy_ns / sim_time_ns() : 0.0;
+    fprintf(out, "usb @ %u bytes/s\n", USB_BYTES_PER_S);
+    fprintf(out, "  %-16s %8u transactions %10llu bytes %10.3f ms busy (%5.1f%%)\n",
+            "console", usb.stats.transactions, (unsigned long long)usb.stats.bytes, usb.stats.busy_ns / 1e6, pct);
+}
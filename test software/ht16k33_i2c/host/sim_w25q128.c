@@ -0,0 +1,90 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "board.h"
+#include "sim.h"
+
+// Log region and calibration sector of the W25Q128 boot flash. Erase sets a sector to 0xFF, page
+// program can only clear bits. Both stall the whole chip for their typical
+// duration from the datasheet: XIP is off, so nothing else runs meanwhile.
+
+#define PAGE_PROGRAM_NS  (400 * 1000)
+#define SECTOR_ERASE_NS  (45 * 1000 * 1000)
+
+#define DATA_SIZE (LOG_FLASH_SIZE + CAL_FLASH_SIZE)
+
+static struct {
+    uint8_t *mem;
+    uint32_t programs;
+    uint32_t erases;
+    uint64_t stall_ns;
+} flash;
+
+void sim_w25q128_attach(void) {
+    free(flash.mem);
+    memset(&flash, 0, sizeof(flash));
+    flash.mem = malloc(DATA_SIZE);
+    // an unused part reads back erased
+    memset(flash.mem, 0xFF, DATA_SIZE);
+}
+
+static void stall(uint64_t ns) {
+    uint32_t irq_state = sim_irq_disable();
+    sim_advance_ns(ns);
+    flash.stall_ns += ns;
+    sim_irq_restore(irq_state);
+}
+
+bool sim_flash_erase(uint32_t offset, size_t len) {
+    if (offset % SIM_FLASH_SECTOR_SIZE || len % SIM_FLASH_SECTOR_SIZE || offset + len > DATA_SIZE)
+        return false;
+    for (size_t done = 0; done < len; done += SIM_FLASH_SECTOR_SIZE) {
+        memset(&flash.mem[offset + done], 0xFF, SIM_FLASH_SECTOR_SIZE);
+        flash.erases++;
+        stall(SECTOR_ERASE_NS);
+    }
+    return true;
+}
+
+bool sim_flash_program(uint32_t offset, const uint8_t *src, size_t len) {
+    if (offset % SIM_FLASH_PAGE_SIZE || len % SIM_FLASH_PAGE_SIZE || offset + len > DATA_SIZE)
+        return false;
+    for (size_t i = 0; i < len; i++)
+        flash.mem[offset + i] &= src[i];
+    for (size_t done = 0; done < len; done += SIM_FLASH_PAGE_SIZE) {
+        flash.programs++;
+        stall(PAGE_PROGRAM_NS);
+    }
+    return true;
+}
+
+void sim_flash_read(uint32_t offset, uint8_t *dst, size_t len) {
+    memcpy(dst, &flash.mem[offset], len);
+}
+
+// A missing file is a new part, erased
+bool sim_w25q128_load(const char *path) {
+    FILE *f = fopen(path, "rb");
+
+    if (!f)
+        return true;
+    bool ok = fread(flash.mem, 1, DATA_SIZE, f) == DATA_SIZE;
+    fclose(f);
+    return ok;
+}
+
+bool sim_w25q128_save(const char *path) {
+    FILE *f = fopen(path, "wb");
+
+    if (!f)
+        return false;
+    bool ok = fwrite(flash.mem, 1, DATA_SIZE, f) == DATA_SIZE;
+    return fclose(f) == 0 && ok;
+}
+
+void sim_w25q128_report(FILE *out) {
+    double pct = sim_time_ns() ? 100.0 * flash.stall_ns / sim_time_ns() : 0.0;
+    fprintf(out, "flash\n");
+    fprintf(out, "  %-16s %8u page programs %7u sector erases %8.3f ms stalled (%5.1f%%)\n",
+            "w25q128", flash.programs, flash.erases, flash.stall_ns / 1e6, pct);
+}
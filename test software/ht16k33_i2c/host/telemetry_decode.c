@@ -0,0 +1,138 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "accel.h"
+#include "telemetry.h"
+
+// Decodes the binary telemetry stream from the firmware (see telemetry.h)
+// into CSV. Bytes that do not form a valid record, such as console text
+// interleaved with the stream, are skipped until the next sync byte.
+//
+// Time sync records set the upper 32 bits of the sample times. With --wall
+// each one is also paired with the host clock as it arrives. The smallest
+// difference over the last SYNC_WINDOW of them is the one least delayed on
+// the way, and puts the samples on the host's wall clock.
+
+#define SYNC_WINDOW 16
+
+static void usage(const char *prog) {
+    fprintf(stderr,
+            "usage: %s [--wall] [FILE]\n"
+            "  reads the stream from FILE, or stdin, and writes CSV to stdout\n"
+            "  --wall  add wall_us, the sample time on the host clock, for a live stream\n", prog);
+}
+
+static int64_t host_time_us(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+int main(int argc, char **argv) {
+    FILE *in = stdin;
+    uint8_t buf[TELEMETRY_RECORD_SIZE];
+    size_t len = 0;
+    unsigned long records = 0, skipped = 0, lost = 0, syncs = 0;
+    uint64_t last_time = 0;
+    bool have_time = false;
+    int last_seq = -1;
+    bool wall = false;
+    int64_t offsets[SYNC_WINDOW];
+    int64_t offset = 0;
+
+    int arg = 1;
+    if (arg < argc && !strcmp(argv[arg], "--wall")) {
+        wall = true;
+        arg++;
+    }
+    if (argc - arg > 1 || (arg < argc && argv[arg][0] == '-')) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+    if (arg < argc && !(in = fopen(argv[arg], "rb"))) {
+        perror(argv[arg]);
+        return EXIT_FAILURE;
+    }
+    // a sync is timed as it is read, not when a buffer of them came in
+    if (wall)
+        setvbuf(in, NULL, _IONBF, 0);
+
+    printf("timestamp_us,seq,x,y,z,x_g,y_g,z_g,buttons,switches,dropped%s\n", wall ? ",wall_us" : "");
+    for (;;) {
+        size_t n = fread(&buf[len], 1, sizeof(buf) - len, in);
+        len += n;
+        if (len < sizeof(buf))
+            break;
+
+        if (buf[0] != TELEMETRY_SYNC ||
+            telemetry_crc8(buf, TELEMETRY_RECORD_SIZE - 1) != buf[TELEMETRY_RECORD_SIZE - 1]) {
+            // resync one byte further on
+            memmove(buf, buf + 1, --len);
+            skipped++;
+            continue;
+        }
+
+        uint8_t seq = buf[1];
+        uint8_t flags = buf[14];
+
+        if (flags & TELEMETRY_FLAG_TIME_SYNC) {
+            uint64_t board_us = 0;
+            for (int i = 0; i < 8; i++)
+                board_us |= (uint64_t)buf[2 + i] << (8 * i);
+            if (last_seq >= 0)
+                lost += (uint8_t)(seq - last_seq - 1);
+            last_seq = (uint8_t)(seq - 1);
+            last_time = board_us;
+            have_time = true;
+
+            if (wall) {
+                offsets[syncs % SYNC_WINDOW] = host_time_us() - (int64_t)board_us;
+                offset = offsets[0];
+                for (unsigned long i = 1; i < syncs + 1 && i < SYNC_WINDOW; i++) {
+                    if (offsets[i] < offset)
+                        offset = offsets[i];
+                }
+            }
+            syncs++;
+            len = 0;
+            continue;
+        }
+
+        uint32_t t = buf[2] | (buf[3] << 8) | (buf[4] << 16) | ((uint32_t)buf[5] << 24);
+        int16_t x = (int16_t)(buf[6] | (buf[7] << 8));
+        int16_t y = (int16_t)(buf[8] | (buf[9] << 8));
+        int16_t z = (int16_t)(buf[10] | (buf[11] << 8));
+        uint16_t inputs = buf[12] | (buf[13] << 8);
+
+        // the timestamp only carries the low 32 bits, take the full time
+        // nearest the last one known
+        uint64_t timestamp_us = t;
+        if (have_time)
+            timestamp_us = last_time + (int32_t)(t - (uint32_t)last_time);
+        last_time = timestamp_us;
+        have_time = true;
+        if (last_seq >= 0)
+            lost += (uint8_t)(seq - last_seq - 1);
+        last_seq = seq;
+
+        printf("%llu,%u,%d,%d,%d,%.4f,%.4f,%.4f,0x%x,0x%02x,%d",
+               (unsigned long long)timestamp_us, seq, x, y, z,
+               (double)x / ACCEL_Q12_ONE_G, (double)y / ACCEL_Q12_ONE_G, (double)z / ACCEL_Q12_ONE_G,
+               inputs & 0x0f, (inputs >> 4) & 0xff, !!(flags & TELEMETRY_FLAG_DROPPED));
+        // empty until the first sync
+        if (wall && syncs)
+            printf(",%lld\n", (long long)((int64_t)timestamp_us + offset));
+        else
+            printf(wall ? ",\n" : "\n");
+        records++;
+        len = 0;
+    }
+
+    fprintf(stderr, "%lu records, %lu time syncs, %lu bytes skipped, %lu records missing\n", records, syncs,
+            skipped, lost);
+    if (in != stdin)
+        fclose(in);
+    return EXIT_SUCCESS;
+}
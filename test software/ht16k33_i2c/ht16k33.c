@@ -0,0 +1,352 @@
+/**
+ * Copyright (c) 2020 Raspberry Pi (Trading) Ltd.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "hal.h"
+#include "i2c_async.h"
+#include "ht16k33.h"
+#include "prof.h"
+
+// ht16k33_flush() to the frame on the chip, including time queued behind sensor reads
+PROF_HIST(prof_flush, "display flush");
+
+/* Driver for a 4 digit 14 segment LED backpack using a HT16K33 I2C driver chip
+
+   Digits are drawn into a RAM framebuffer mirroring the 16 byte display RAM
+   of the chip. ht16k33_flush() compares it against a shadow of what the chip
+   currently shows and writes only the smallest contiguous span of changed
+   digits in one auto-increment burst, so bus time follows the visual change.
+   The burst is queued on the I2C engine below the sensor and does not
+   block. A flush requested while the previous one is still waiting for the
+   bus replaces it, and one requested while it is on the bus is sent when it
+   completes, so each flush carries the latest frame.
+*/
+
+// How long a flush or command may wait behind sensor reads, about a frame
+// at 50 Hz
+#ifndef HT16K33_DEADLINE_US
+#define HT16K33_DEADLINE_US 20000
+#endif
+
+// Both cases of a letter share a glyph
+#define LETTER(upper, pattern) [upper] = (pattern), [(upper) + ('a' - 'A')] = (pattern)
+
+// Segment patterns for printable ASCII, built at compile time into flash.
+// The letters and punctuation are the usual 14 segment shapes, the digits
+// only use the 7 segment subset. Anything else is blank.
+static const uint16_t font[128] = {
+    [' '] = 0x0000, ['!'] = 0x0006, ['"'] = 0x0220, ['#'] = 0x12CE,
+    ['$'] = 0x12ED, ['%'] = 0x0C24, ['&'] = 0x235D, ['\''] = 0x0400,
+    ['('] = 0x2400, [')'] = 0x0900, ['*'] = 0x3FC0, ['+'] = 0x12C0,
+    [','] = 0x0800, ['-'] = 0x00C0, ['.'] = HT16K33_SEG_DP, ['/'] = 0x0C00,
+    ['0'] = 0x3F, ['1'] = 0x06, ['2'] = 0x5B, ['3'] = 0x4F, ['4'] = 0x66,
+    ['5'] = 0x6D, ['6'] = 0x7D, ['7'] = 0x07, ['8'] = 0x7F, ['9'] = 0x6F,
+    [':'] = 0x1200, [';'] = 0x0A00, ['<'] = 0x2440, ['='] = 0x00C8,
+    ['>'] = 0x0980, ['?'] = 0x1083, ['@'] = 0x02BB,
+    LETTER('A', 0xF7), LETTER('B', 0x128F), LETTER('C', 0x39), LETTER('D', 0x120F),
+    LETTER('E', 0xF9), LETTER('F', 0xF1), LETTER('G', 0xBD), LETTER('H', 0xF6),
+    LETTER('I', 0x1209), LETTER('J', 0x1E), LETTER('K', 0x2470), LETTER('L', 0x38),
+    LETTER('M', 0x536), LETTER('N', 0x2136), LETTER('O', 0x3F), LETTER('P', 0xF3),
+    LETTER('Q', 0x203F), LETTER('R', 0x20F3), LETTER('S', 0x18D), LETTER('T', 0x1201),
+    LETTER('U', 0x3E), LETTER('V', 0xC30), LETTER('W', 0x2836), LETTER('X', 0x2D00),
+    LETTER('Y', 0x1500), LETTER('Z', 0xC09),
+    ['['] = 0x0039, ['\\'] = 0x2100, [']'] = 0x000F, ['^'] = 0x0C03,
+    ['_'] = 0x0008, ['`'] = 0x0100, ['{'] = 0x0949, ['|'] = 0x1200,
+    ['}'] = 0x2489, ['~'] = 0x0520,
+};
+
+// Converts a character to the bit pattern needed to display the right segments.
+uint16_t char_to_pattern(char ch) {
+    return (unsigned char)ch < count_of(font) ? font[(unsigned char)ch] : 0;
+}
+
+/**
+ * @brief Renders a string to glyphs once, for showing or scrolling later.
+ * @param text Receives up to HT16K33_TEXT_MAX glyphs, the rest is cut off.
+ * @param str A '.' after a character lights that digit's decimal point
+ *            instead of taking a digit of its own.
+ */
+void ht16k33_text_render(ht16k33_text_t *text, const char *str) {
+    int len = 0;
+
+    for (; *str; str++) {
+        if (*str == '.' && len > 0 && !(text->glyphs[len - 1] & HT16K33_SEG_DP)) {
+            text->glyphs[len - 1] |= HT16K33_SEG_DP;
+            continue;
+        }
+        if (len == HT16K33_TEXT_MAX)
+            break;
+        text->glyphs[len++] = char_to_pattern(*str);
+    }
+    text->len = len;
+}
+
+// Display RAM holds 8 rows of 16 bits, one per digit on this backpack
+#define HT16K33_RAM_ROWS 8
+
+static uint16_t framebuffer[HT16K33_RAM_ROWS];
+// What the chip currently shows. Its RAM is undefined at power up, so the
+// shadow is only trusted after the first full flush.
+static uint16_t shown[HT16K33_RAM_ROWS];
+static bool shown_valid;
+
+// Flush in flight on the bus, and whether another one was asked for meanwhile
+static struct {
+    i2c_xfer_t xfer;
+    uint8_t buf[1 + 2 * HT16K33_RAM_ROWS];
+    int first;
+    int rows;
+    bool busy;
+    bool pending;
+    uint64_t requested_us;      // newest ht16k33_flush() call
+    uint64_t sent_requested_us; // the one whose frame is on the bus
+    uint32_t requested_cycles;  // the same two for the profile
+    uint32_t sent_requested_cycles;
+} flush;
+
+// Frames that reached the chip, stamped when their transfer completed
+static struct {
+    uint32_t count;
+    uint64_t last_us;
+    uint32_t worst_latency_us;  // ht16k33_flush() to completion
+} frames;
+
+// Setup, brightness and display commands go out the same way, in slot
+// order. While one is on the bus only the latest value of each is kept.
+enum { COMMAND_SYSTEM_SETUP, COMMAND_ROW_INT, COMMAND_DISPLAY_SETUP, COMMAND_BRIGHTNESS, COMMAND_SLOTS };
+static struct {
+    i2c_xfer_t xfer;
+    uint8_t cmd;
+    int pending[COMMAND_SLOTS];     // command byte, or -1
+    bool busy;
+} command = { .pending = { -1, -1, -1, -1 } };
+
+static void ht16k33_command(int slot, uint8_t cmd);
+
+bool ht16k33_probe(void) {
+    uint8_t buf[1 + 2 * HT16K33_RAM_ROWS];
+    uint8_t readback[2 * HT16K33_RAM_ROWS];
+
+    // alternating bits, so data shifted by one is caught
+    buf[0] = 0x00;
+    for (int i = 0; i < 2 * HT16K33_RAM_ROWS; i++)
+        buf[1 + i] = (i & 1) ? 0xA5 : 0x5A;
+    if (i2c_async_transfer_blocking(HT16K33_ADDRESS, buf, sizeof(buf), NULL, 0) != (int)sizeof(buf))
+        return false;
+    if (i2c_async_transfer_blocking(HT16K33_ADDRESS, buf, 1, readback, sizeof(readback)) != 1 + (int)sizeof(readback))
+        return false;
+    shown_valid = false;
+    return memcmp(&buf[1], readback, sizeof(readback)) == 0;
+}
+
+// Queued like any other command, so the sensor can be brought up while
+// these are still waiting for the bus
+void ht16k33_init() {
+    ht16k33_command(COMMAND_SYSTEM_SETUP, HT16K33_SYSTEM_RUN);
+    ht16k33_command(COMMAND_ROW_INT, HT16K33_SET_ROW_INT);
+    ht16k33_command(COMMAND_DISPLAY_SETUP, HT16K33_DISPLAY_SETUP | HT16K33_DISPLAY_ON);
+    ht16k33_clear_all();
+}
+
+// Set the binary value of the specified digit in the framebuffer
+void ht16k33_display_set(int position, uint16_t bin) {
+    if (position < 0 || position >= HT16K33_RAM_ROWS)
+        return;
+    framebuffer[position] = bin;
+}
+
+static void ht16k33_flush_done(i2c_xfer_t *xfer);
+
+// Queue the span of digits that differ from the shadow. Called with
+// interrupts masked and no flush in flight.
+static void ht16k33_flush_start(uint64_t deadline_us) {
+    int first = 0;
+    int last = HT16K33_RAM_ROWS - 1;
+
+    flush.pending = false;
+    if (shown_valid) {
+        while (first < HT16K33_RAM_ROWS && framebuffer[first] == shown[first])
+            first++;
+        if (first == HT16K33_RAM_ROWS)
+            return;
+        while (framebuffer[last] == shown[last])
+            last--;
+    }
+
+    size_t len = 0;
+    flush.buf[len++] = first * 2;
+    for (int i = first; i <= last; i++) {
+        flush.buf[len++] = framebuffer[i] & 0xff;
+        flush.buf[len++] = framebuffer[i] >> 8;
+    }
+    flush.first = first;
+    flush.rows = last - first + 1;
+    flush.busy = true;
+    flush.sent_requested_us = flush.requested_us;
+    flush.sent_requested_cycles = flush.requested_cycles;
+
+    flush.xfer.addr = HT16K33_ADDRESS;
+    flush.xfer.tx = flush.buf;
+    flush.xfer.tx_len = len;
+    flush.xfer.rx = NULL;
+    flush.xfer.rx_len = 0;
+    flush.xfer.callback = ht16k33_flush_done;
+    flush.xfer.priority = I2C_PRIORITY_DISPLAY;
+    flush.xfer.deadline_us = deadline_us;
+    i2c_async_submit(&flush.xfer);
+}
+
+static void ht16k33_flush_done(i2c_xfer_t *xfer) {
+    uint32_t irq_state = hal_enter_critical();
+    if (xfer->result == (int)xfer->tx_len) {
+        // the shadow follows what was sent, not the framebuffer, which may have moved on
+        for (int i = 0; i < flush.rows; i++)
+            shown[flush.first + i] = flush.buf[1 + 2 * i] | (flush.buf[2 + 2 * i] << 8);
+        if (flush.first == 0 && flush.rows == HT16K33_RAM_ROWS)
+            shown_valid = true;
+        uint64_t now_us = hal_time_us();
+        uint32_t latency_us = (uint32_t)(now_us - flush.sent_requested_us);
+        frames.count++;
+        frames.last_us = now_us;
+        if (latency_us > frames.worst_latency_us)
+            frames.worst_latency_us = latency_us;
+        PROF_RECORD(prof_flush, hal_cycles() - flush.sent_requested_cycles);
+    }
+    flush.busy = false;
+    if (flush.pending)
+        ht16k33_flush_start(hal_time_us() + HT16K33_DEADLINE_US);
+    hal_exit_critical(irq_state);
+}
+
+// Send the digits that changed since the last flush
+void ht16k33_flush(void) {
+    uint32_t irq_state = hal_enter_critical();
+    flush.requested_us = hal_time_us();
+    flush.requested_cycles = hal_cycles();
+    if (flush.busy && i2c_async_cancel(&flush.xfer)) {
+        // still queued, its rows are not in the shadow yet and go out with
+        // these, by the deadline of the frame that was waiting
+        flush.busy = false;
+        ht16k33_flush_start(flush.xfer.deadline_us);
+    } else if (flush.busy) {
+        flush.pending = true;
+    } else {
+        ht16k33_flush_start(hal_time_us() + HT16K33_DEADLINE_US);
+    }
+    hal_exit_critical(irq_state);
+}
+
+// The time the newest frame was on the chip, 0 before the first
+uint64_t ht16k33_frame_time_us(void) {
+    uint32_t irq_state = hal_enter_critical();
+    uint64_t last_us = frames.last_us;
+    hal_exit_critical(irq_state);
+    return last_us;
+}
+
+void ht16k33_report(FILE *out) {
+    fprintf(out, "display: %lu frames, last at %llu us, worst latency %lu us\n", (unsigned long)frames.count,
+            (unsigned long long)ht16k33_frame_time_us(), (unsigned long)frames.worst_latency_us);
+}
+
+void ht16k33_display_char(int position, char ch) {
+    ht16k33_display_set(position, char_to_pattern(ch));
+}
+
+// Show NUM_DIGITS glyphs of a rendered string from offset, blank past its end
+void ht16k33_text_show(const ht16k33_text_t *text, int offset) {
+    for (int digit = 0; digit < NUM_DIGITS; digit++) {
+        int i = offset + digit;
+        ht16k33_display_set(digit, i >= 0 && i < text->len ? text->glyphs[i] : 0);
+    }
+    ht16k33_flush();
+}
+
+void ht16k33_display_string(char *str) {
+    ht16k33_text_t text;
+
+    ht16k33_text_render(&text, str);
+    ht16k33_text_show(&text, 0);
+}
+
+void ht16k33_scroll_string(char *str, int interval_ms) {
+    ht16k33_text_t text;
+
+    ht16k33_text_render(&text, str);
+    if (text.len <= NUM_DIGITS) {
+        ht16k33_text_show(&text, 0);
+        return;
+    }
+    for (int i = 0; i <= text.len - NUM_DIGITS; i++) {
+        ht16k33_text_show(&text, i);
+        hal_sleep_ms(interval_ms);
+    }
+}
+
+static void ht16k33_command_done(i2c_xfer_t *xfer);
+
+// Send the next pending command. Called with interrupts masked.
+static void ht16k33_command_start(void) {
+    for (int slot = 0; slot < COMMAND_SLOTS; slot++) {
+        if (command.pending[slot] < 0)
+            continue;
+        command.cmd = command.pending[slot];
+        command.pending[slot] = -1;
+        command.busy = true;
+
+        command.xfer.addr = HT16K33_ADDRESS;
+        command.xfer.tx = &command.cmd;
+        command.xfer.tx_len = 1;
+        command.xfer.rx = NULL;
+        command.xfer.rx_len = 0;
+        command.xfer.callback = ht16k33_command_done;
+        command.xfer.priority = I2C_PRIORITY_DISPLAY;
+        command.xfer.deadline_us = hal_time_us() + HT16K33_DEADLINE_US;
+        i2c_async_submit(&command.xfer);
+        return;
+    }
+}
+
+static void ht16k33_command_done(i2c_xfer_t *xfer) {
+    (void)xfer;
+    uint32_t irq_state = hal_enter_critical();
+    command.busy = false;
+    ht16k33_command_start();
+    hal_exit_critical(irq_state);
+}
+
+static void ht16k33_command(int slot, uint8_t cmd) {
+    uint32_t irq_state = hal_enter_critical();
+    command.pending[slot] = cmd;
+    if (!command.busy)
+        ht16k33_command_start();
+    hal_exit_critical(irq_state);
+}
+
+// Queued, does not wait for the bus
+void ht16k33_set_brightness(int bright) {
+    ht16k33_command(COMMAND_BRIGHTNESS, HT16K33_BRIGHTNESS | (bright <= 15 ? bright : 15));
+}
+
+void ht16k33_set_blink(int blink) {
+    int s = 0;
+    switch (blink) {
+        default: break;
+        case 1: s = HT16K33_BLINK_2HZ; break;
+        case 2: s = HT16K33_BLINK_1HZ; break;
+        case 3: s = HT16K33_BLINK_0p5HZ; break;
+    }
+
+    ht16k33_command(COMMAND_DISPLAY_SETUP, HT16K33_DISPLAY_SETUP | HT16K33_DISPLAY_ON | s);
+}
+
+void ht16k33_clear_all() {
+    for (int i = 0; i < HT16K33_RAM_ROWS; i++)
+        ht16k33_display_set(i, 0);
+    ht16k33_flush();
+    return;
+}
@@ -0,0 +1,84 @@
+#ifndef HT16K33_H
+#define HT16K33_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+// How many digits are on our display.
+#define NUM_DIGITS 4
+
+// By default these display drivers are on bus address 0x70. Often there are
+// solder on options on the PCB of the backpack to set an address between
+// 0x70 and 0x77 to allow multiple devices to be used.
+#define HT16K33_ADDRESS 0x70
+
+// commands
+#define HT16K33_SYSTEM_STANDBY  0x20
+#define HT16K33_SYSTEM_RUN      0x21
+
+#define HT16K33_SET_ROW_INT     0xA0
+
+#define HT16K33_BRIGHTNESS      0xE0
+
+// Display on/off/blink
+#define HT16K33_DISPLAY_SETUP   0x80
+// OR/clear these to display setup register
+#define HT16K33_DISPLAY_OFF     0x0
+#define HT16K33_DISPLAY_ON      0x1
+#define HT16K33_BLINK_2HZ       0x2
+#define HT16K33_BLINK_1HZ       0x4
+#define HT16K33_BLINK_0p5HZ     0x6
+
+// Segments of one digit, in the 14 segment layout of the font
+#define HT16K33_SEG_A   0x0001  // top
+#define HT16K33_SEG_B   0x0002  // top right
+#define HT16K33_SEG_C   0x0004  // bottom right
+#define HT16K33_SEG_D   0x0008  // bottom
+#define HT16K33_SEG_E   0x0010  // bottom left
+#define HT16K33_SEG_F   0x0020  // top left
+#define HT16K33_SEG_G1  0x0040  // middle left
+#define HT16K33_SEG_G2  0x0080  // middle right
+#define HT16K33_SEG_H   0x0100  // top left diagonal
+#define HT16K33_SEG_J   0x0200  // top centre
+#define HT16K33_SEG_K   0x0400  // top right diagonal
+#define HT16K33_SEG_L   0x0800  // bottom left diagonal
+#define HT16K33_SEG_M   0x1000  // bottom centre
+#define HT16K33_SEG_N   0x2000  // bottom right diagonal
+#define HT16K33_SEG_DP  0x4000
+
+uint16_t char_to_pattern(char ch);
+
+// A string rendered to segment patterns, see ht16k33_text_render()
+#define HT16K33_TEXT_MAX 64
+typedef struct {
+    int len;
+    uint16_t glyphs[HT16K33_TEXT_MAX];
+} ht16k33_text_t;
+
+void ht16k33_text_render(ht16k33_text_t *text, const char *str);
+void ht16k33_text_show(const ht16k33_text_t *text, int offset);
+
+// Display RAM write and readback, for checking the bus speed. Leaves the
+// test pattern in RAM, so run it before ht16k33_init(), which clears it.
+bool ht16k33_probe(void);
+// Queues the setup commands and a clear, returns without waiting for them
+void ht16k33_init(void);
+// ht16k33_display_set() and ht16k33_display_char() only update the framebuffer,
+// call ht16k33_flush() to send it. The other display functions flush themselves.
+// Flushes, brightness and blink are queued on the bus and return at once.
+void ht16k33_display_set(int position, uint16_t bin);
+void ht16k33_flush(void);
+// Completion time of the newest frame to reach the chip, for lining the
+// display up with the samples, and frame counts and latency
+uint64_t ht16k33_frame_time_us(void);
+void ht16k33_report(FILE *out);
+void ht16k33_display_char(int position, char ch);
+void ht16k33_display_string(char *str);
+// Blocks between frames, see anim.h for scrolling from the main loop
+void ht16k33_scroll_string(char *str, int interval_ms);
+void ht16k33_set_brightness(int bright);
+void ht16k33_set_blink(int blink);
+void ht16k33_clear_all(void);
+
+#endif
@@ -0,0 +1,234 @@
+#include "hal.h"
+#include "i2c_async.h"
+
+static const char *const priority_names[I2C_PRIORITIES] = { "sensor", "display" };
+
+// Waiting transfers, one FIFO per priority, and the one on the bus
+static i2c_xfer_t *head[I2C_PRIORITIES];
+static i2c_xfer_t *tail[I2C_PRIORITIES];
+static i2c_xfer_t *active;
+
+// Bus kept free from reserved_us until reserved_until_us, 0 for none
+static uint64_t reserved_us;
+static uint64_t reserved_until_us;
+
+static struct {
+    uint32_t xfers;
+    uint32_t cancelled;
+    uint32_t missed;
+    uint32_t errors;
+    uint64_t bytes;
+    uint64_t worst_us;
+} stats[I2C_PRIORITIES];
+
+static void i2c_async_done(int result);
+
+uint32_t i2c_async_xfer_time_us(const i2c_xfer_t *xfer) {
+    // start, address and data bytes with their ACKs, and a repeated start
+    // plus address before the read
+    uint64_t bits = 1 + 9 * (1 + (uint64_t)xfer->tx_len) + 1;
+    if (xfer->rx_len)
+        bits += 1 + 9 * (1 + (uint64_t)xfer->rx_len);
+    return (uint32_t)((bits * 1000000 + hal_i2c_baudrate() - 1) / hal_i2c_baudrate());
+}
+
+// Whether a lower priority transfer can go now without running into the
+// reserved slot
+static bool fits_before_reservation(const i2c_xfer_t *xfer, uint64_t now_us) {
+    if (!reserved_us)
+        return true;
+    if (now_us >= reserved_until_us) {
+        reserved_us = 0;
+        return true;
+    }
+    if (xfer->deadline_us && now_us >= xfer->deadline_us)
+        return true;
+    return now_us + i2c_async_xfer_time_us(xfer) <= reserved_us;
+}
+
+static i2c_xfer_t *dequeue(int prio) {
+    i2c_xfer_t *xfer = head[prio];
+    head[prio] = xfer->next;
+    if (!head[prio])
+        tail[prio] = NULL;
+    return xfer;
+}
+
+static void complete(i2c_xfer_t *xfer, int result, uint64_t now_us) {
+    int prio = xfer->priority;
+    uint64_t waited_us = now_us - xfer->submitted_us;
+
+    stats[prio].xfers++;
+    if (result == PICO_ERROR_GENERIC)
+        stats[prio].errors++;
+    else
+        stats[prio].bytes += result;
+    if (xfer->deadline_us && now_us > xfer->deadline_us)
+        stats[prio].missed++;
+    if (waited_us > stats[prio].worst_us)
+        stats[prio].worst_us = waited_us;
+
+    // a blocking waiter may drop the descriptor as soon as done is set
+    i2c_xfer_callback_t callback = xfer->callback;
+    xfer->result = result;
+    xfer->done = true;
+    if (callback)
+        callback(xfer);
+}
+
+// Called with interrupts masked. Starts the most urgent transfer that may go
+// if the bus is idle.
+static void start_next(void) {
+    while (!active) {
+        uint64_t now_us = hal_time_us();
+        int prio = 0;
+
+        while (prio < I2C_PRIORITIES && !head[prio])
+            prio++;
+        if (prio == I2C_PRIORITIES)
+            return;
+        if (prio > I2C_PRIORITY_SENSOR && !fits_before_reservation(head[prio], now_us))
+            return;
+
+        i2c_xfer_t *xfer = dequeue(prio);
+        if (hal_i2c_xfer_start(xfer->addr, xfer->tx, xfer->tx_len, xfer->rx, xfer->rx_len, i2c_async_done)) {
+            active = xfer;
+            return;
+        }
+        // rejected outright (empty or too long), fail it and move on
+        complete(xfer, PICO_ERROR_GENERIC, now_us);
+    }
+}
+
+static void i2c_async_done(int result) {
+    uint32_t irq_state = hal_enter_critical();
+    i2c_xfer_t *xfer = active;
+    active = NULL;
+    // keep the bus busy before running the callback, which may queue more
+    start_next();
+    hal_exit_critical(irq_state);
+
+    complete(xfer, result, hal_time_us());
+}
+
+void i2c_async_submit(i2c_xfer_t *xfer) {
+    int prio = xfer->priority < I2C_PRIORITIES ? xfer->priority : I2C_PRIORITIES - 1;
+
+    xfer->priority = prio;
+    xfer->done = false;
+    xfer->next = NULL;
+    xfer->submitted_us = hal_time_us();
+
+    uint32_t irq_state = hal_enter_critical();
+    if (tail[prio])
+        tail[prio]->next = xfer;
+    else
+        head[prio] = xfer;
+    tail[prio] = xfer;
+    start_next();
+    hal_exit_critical(irq_state);
+}
+
+bool i2c_async_cancel(i2c_xfer_t *xfer) {
+    bool found = false;
+
+    uint32_t irq_state = hal_enter_critical();
+    int prio = xfer->priority;
+    i2c_xfer_t *prev = NULL;
+    for (i2c_xfer_t *it = head[prio]; it; prev = it, it = it->next) {
+        if (it != xfer)
+            continue;
+        if (prev)
+            prev->next = xfer->next;
+        else
+            head[prio] = xfer->next;
+        if (tail[prio] == xfer)
+            tail[prio] = prev;
+        stats[prio].cancelled++;
+        found = true;
+        break;
+    }
+    hal_exit_critical(irq_state);
+    return found;
+}
+
+bool i2c_async_idle(void) {
+    if (active)
+        return false;
+    for (int prio = 0; prio < I2C_PRIORITIES; prio++)
+        if (head[prio])
+            return false;
+    return true;
+}
+
+void i2c_async_reserve(uint64_t at_us, uint32_t hold_us) {
+    uint32_t irq_state = hal_enter_critical();
+    reserved_us = at_us;
+    reserved_until_us = at_us + hold_us;
+    hal_exit_critical(irq_state);
+}
+
+bool i2c_async_set_baudrate(uint32_t hz) {
+    uint32_t irq_state = hal_enter_critical();
+    bool idle = !active;
+    if (idle)
+        hal_i2c_set_baudrate(hz);
+    hal_exit_critical(irq_state);
+    return idle;
+}
+
+void i2c_async_poll(void) {
+    uint32_t irq_state = hal_enter_critical();
+    start_next();
+    hal_exit_critical(irq_state);
+}
+
+int i2c_async_transfer_blocking(uint8_t addr, const uint8_t *tx, size_t tx_len, uint8_t *rx, size_t rx_len) {
+    i2c_xfer_t xfer = {
+        .addr = addr,
+        .tx = tx,
+        .tx_len = tx_len,
+        .rx = rx,
+        .rx_len = rx_len,
+        .priority = I2C_PRIORITY_SENSOR,
+    };
+
+    i2c_async_submit(&xfer);
+    while (!xfer.done)
+        hal_wait_for_event();
+    return xfer.result;
+}
+
+uint32_t i2c_async_missed_deadlines(void) {
+    uint32_t missed = 0;
+
+    for (int prio = 0; prio < I2C_PRIORITIES; prio++)
+        missed += stats[prio].missed;
+    return missed;
+}
+
+uint32_t i2c_async_errors(void) {
+    uint32_t errors = 0;
+
+    for (int prio = 0; prio < I2C_PRIORITIES; prio++)
+        errors += stats[prio].errors;
+    return errors;
+}
+
+uint64_t i2c_async_bytes(void) {
+    uint64_t bytes = 0;
+
+    for (int prio = 0; prio < I2C_PRIORITIES; prio++)
+        bytes += stats[prio].bytes;
+    return bytes;
+}
+
+void i2c_async_report(FILE *out) {
+    fprintf(out, "i2c bus: %lu Hz\n", (unsigned long)hal_i2c_baudrate());
+    for (int prio = 0; prio < I2C_PRIORITIES; prio++) {
+        fprintf(out, "  %-8s %8lu xfers %6lu errors %6lu cancelled %6lu missed, worst %llu us\n",
+                priority_names[prio], (unsigned long)stats[prio].xfers, (unsigned long)stats[prio].errors,
+                (unsigned long)stats[prio].cancelled, (unsigned long)stats[prio].missed,
+                (unsigned long long)stats[prio].worst_us);
+    }
+}
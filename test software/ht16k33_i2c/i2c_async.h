@@ -0,0 +1,84 @@
+#ifndef I2C_ASYNC_H
+#define I2C_ASYNC_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/* Scheduled queue of non-blocking transactions on I2C_PORT.
+
+   Drivers fill in a transfer descriptor and submit it, from the main loop or
+   from an interrupt handler. Transfers run back-to-back from DMA, and each
+   one's callback runs from the I2C interrupt when it completes, so the CPU is
+   free while the bus is busy. All bus traffic goes through this queue, which
+   also keeps interrupt-driven reads from splitting transactions started by
+   the main loop.
+
+   The display and the accelerometer share the bus, so the queue is ordered
+   by priority, then by submission. A transfer on the bus is never cut short,
+   so a sensor driver that knows when its next read comes can reserve the bus
+   for it: lower priority transfers that would still be running then wait
+   until after it, unless they are already past their own deadline. Every
+   transfer with a deadline that completes late is counted as a miss.
+
+   A descriptor and its buffers must stay valid until it completes.
+*/
+
+// Lower values go first
+#define I2C_PRIORITY_SENSOR  0
+#define I2C_PRIORITY_DISPLAY 1
+#define I2C_PRIORITIES       2
+
+struct i2c_xfer;
+typedef void (*i2c_xfer_callback_t)(struct i2c_xfer *xfer);
+
+typedef struct i2c_xfer {
+    uint8_t addr;
+    const uint8_t *tx;              // written first, may be empty
+    size_t tx_len;
+    uint8_t *rx;                    // read after a repeated start, may be empty
+    size_t rx_len;
+    i2c_xfer_callback_t callback;   // optional, runs in interrupt context
+    void *ctx;
+    uint8_t priority;               // I2C_PRIORITY_*
+    uint64_t deadline_us;           // must complete by then, 0 for none
+    volatile int result;            // bytes transferred or PICO_ERROR_GENERIC
+    volatile bool done;
+    uint64_t submitted_us;
+    struct i2c_xfer *next;
+} i2c_xfer_t;
+
+void i2c_async_submit(i2c_xfer_t *xfer);
+// Take back a transfer that has not started yet. Its callback does not run.
+// Returns false if it is already on the bus or done.
+bool i2c_async_cancel(i2c_xfer_t *xfer);
+bool i2c_async_idle(void);
+
+// Keep the bus free at at_us for a top priority transfer expected then. The
+// reservation lapses after hold_us if nothing is submitted, or when the next
+// one replaces it.
+void i2c_async_reserve(uint64_t at_us, uint32_t hold_us);
+// Start anything held back by a reservation that has lapsed
+void i2c_async_poll(void);
+
+// Change the bus clock between two transfers. Returns false if one is on
+// the bus, try again later.
+bool i2c_async_set_baudrate(uint32_t hz);
+
+// Wire time of a transfer at the current bus rate
+uint32_t i2c_async_xfer_time_us(const i2c_xfer_t *xfer);
+
+// Submit and wait for completion, at top priority. Main loop only.
+int i2c_async_transfer_blocking(uint8_t addr, const uint8_t *tx, size_t tx_len, uint8_t *rx, size_t rx_len);
+
+// Totals over all priorities: missed deadlines, failed transfers and bytes
+// moved by the ones that succeeded
+uint32_t i2c_async_missed_deadlines(void);
+uint32_t i2c_async_errors(void);
+uint64_t i2c_async_bytes(void);
+// Per priority: transfers, failed ones, cancelled ones, missed deadlines and
+// worst wait from submission to completion
+void i2c_async_report(FILE *out);
+
+#endif
@@ -0,0 +1,107 @@
+#include "hal.h"
+#include "i2c_async.h"
+#include "i2c_bus.h"
+
+const i2c_bus_profile_t i2c_bus_profiles[] = {
+    { "fast mode plus", 1000 * 1000 },
+    { "fast mode", 400 * 1000 },
+    { "standard mode", 100 * 1000 },
+};
+
+#define NUM_PROFILES ((int)count_of(i2c_bus_profiles))
+#define MAX_DEVICES 4
+
+static int current = NUM_PROFILES - 1;
+static uint32_t errors_seen;
+static uint32_t fallbacks;
+
+// Outcome of the boot probe, per profile tried and device
+static struct {
+    int tried;                              // profiles, fastest allowed first
+    int first;                              // index of the first one tried
+    uint8_t failed[NUM_PROFILES];           // bit per device
+    const i2c_bus_device_t *devices;
+    int count;
+    uint64_t bytes;
+    uint64_t elapsed_us;
+} probe;
+
+// Run every probe at the current speed, timing the passing pass for the
+// throughput figure
+static bool i2c_bus_probe_all(int profile) {
+    uint64_t bytes = i2c_async_bytes();
+    uint64_t start_us = hal_time_us();
+    uint8_t failed = 0;
+
+    for (int i = 0; i < probe.count; i++) {
+        if (!probe.devices[i].probe())
+            failed |= 1u << i;
+    }
+    probe.failed[profile] = failed;
+    if (failed)
+        return false;
+    probe.bytes = i2c_async_bytes() - bytes;
+    probe.elapsed_us = hal_time_us() - start_us;
+    return true;
+}
+
+bool i2c_bus_init(uint32_t max_hz, const i2c_bus_device_t *devices, int count) {
+    probe.devices = devices;
+    probe.count = count < MAX_DEVICES ? count : MAX_DEVICES;
+    probe.first = 0;
+    while (probe.first < NUM_PROFILES - 1 && i2c_bus_profiles[probe.first].hz > max_hz)
+        probe.first++;
+
+    for (current = probe.first; current < NUM_PROFILES; current++) {
+        // nothing else is on the bus yet, so it is idle between probes
+        i2c_async_set_baudrate(i2c_bus_profiles[current].hz);
+        probe.tried++;
+        if (i2c_bus_probe_all(current))
+            break;
+    }
+    errors_seen = i2c_async_errors();
+    if (current < NUM_PROFILES)
+        return true;
+    current = NUM_PROFILES - 1;
+    return false;
+}
+
+void i2c_bus_service(void) {
+    uint32_t errors = i2c_async_errors();
+
+    if (errors - errors_seen < I2C_BUS_ERROR_LIMIT || current == NUM_PROFILES - 1) {
+        errors_seen = errors;
+        return;
+    }
+    // only between transfers, otherwise try again next time
+    if (!i2c_async_set_baudrate(i2c_bus_profiles[current + 1].hz))
+        return;
+    current++;
+    fallbacks++;
+    errors_seen = errors;
+}
+
+const i2c_bus_profile_t *i2c_bus_profile(void) {
+    return &i2c_bus_profiles[current];
+}
+
+void i2c_bus_report(FILE *out) {
+    const i2c_bus_profile_t *profile = i2c_bus_profile();
+
+    fprintf(out, "i2c: %s, %lu Hz", profile->name, (unsigned long)hal_i2c_baudrate());
+    if (fallbacks)
+        fprintf(out, ", %lu fallbacks on errors", (unsigned long)fallbacks);
+    fprintf(out, "\n");
+    for (int i = 0; i < probe.tried; i++) {
+        int p = probe.first + i;
+        fprintf(out, "  %-14s", i2c_bus_profiles[p].name);
+        for (int d = 0; d < probe.count; d++)
+            fprintf(out, " %s %s", probe.devices[d].name, (probe.failed[p] >> d) & 1 ? "failed" : "ok");
+        fprintf(out, "\n");
+    }
+    if (probe.elapsed_us) {
+        fprintf(out, "  probe moved %llu bytes in %llu us, %llu bytes/s\n",
+                (unsigned long long)probe.bytes, (unsigned long long)probe.elapsed_us,
+                (unsigned long long)(probe.bytes * 1000000 / probe.elapsed_us));
+    }
+}
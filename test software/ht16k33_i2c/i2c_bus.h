@@ -0,0 +1,49 @@
+#ifndef I2C_BUS_H
+#define I2C_BUS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/* Clock selection for I2C_PORT.
+
+   The bus runs one of three profiles: standard mode (100 kHz), fast mode
+   (400 kHz) or fast mode plus (1 MHz). At boot i2c_bus_init() goes down the
+   list from the fastest one allowed and runs every device's probe at each
+   speed, keeping the first one they all pass. A device clocked beyond its
+   rating usually still acknowledges but shifts its data by a bit, so the
+   probes compare data read back rather than just checking for an ACK.
+
+   Afterwards i2c_bus_service() watches for failed transfers and drops to the
+   next slower profile if they pile up.
+*/
+
+typedef struct {
+    const char *name;
+    uint32_t hz;
+} i2c_bus_profile_t;
+
+typedef struct {
+    const char *name;
+    bool (*probe)(void);    // true if the device answered correctly
+} i2c_bus_device_t;
+
+// Fastest first
+extern const i2c_bus_profile_t i2c_bus_profiles[];
+
+// Failed transfers between two i2c_bus_service() calls that drop the speed
+#ifndef I2C_BUS_ERROR_LIMIT
+#define I2C_BUS_ERROR_LIMIT 3
+#endif
+
+// Probe the devices at each profile up to max_hz. Returns false if they do
+// not all pass even at standard mode, the bus is left there. Main loop only.
+bool i2c_bus_init(uint32_t max_hz, const i2c_bus_device_t *devices, int count);
+// Fall back on errors, call it periodically
+void i2c_bus_service(void);
+const i2c_bus_profile_t *i2c_bus_profile(void);
+
+// Profile, probe results and the throughput measured during the probe
+void i2c_bus_report(FILE *out);
+
+#endif
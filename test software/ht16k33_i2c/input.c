@@ -0,0 +1,155 @@
+#include <stdatomic.h>
+#include "board.h"
+#include "hal.h"
+#include "input.h"
+#include "prof.h"
+
+#define INPUT_MASK (BUTTON_MASK | SWITCH_MASK)
+
+PROF_HIST(prof_scan, "input scan");
+
+static uint64_t state;
+// Two bit vertical counter per input, counting scans that differ from state
+static uint64_t cnt0;
+static uint64_t cnt1;
+
+static uint64_t pressed_at_us[64];
+static uint64_t long_press_pending;
+
+// Set by the edge interrupt while no scans are running
+static volatile bool wake_pending;
+static volatile bool busy;
+
+// Time of the first edge on each input since it last read the same as state,
+// valid for the bits in edge_pending
+static uint64_t edge_us[64];
+static volatile uint64_t edge_pending;
+
+// Single producer / single consumer, same scheme as sample_ring
+static input_event_t queue[INPUT_QUEUE_SIZE];
+static atomic_uint head;
+static atomic_uint tail;
+static atomic_uint dropped;
+
+// Buttons and switches pull up, so a low level is active
+static uint64_t read_inputs(void) {
+    return ~hal_gpio_get_all() & INPUT_MASK;
+}
+
+static void push_event(uint64_t now_us, unsigned int gpio, input_event_type_t type) {
+    unsigned int h = atomic_load_explicit(&head, memory_order_relaxed);
+    unsigned int t = atomic_load_explicit(&tail, memory_order_acquire);
+
+    if (h - t == INPUT_QUEUE_SIZE) {
+        atomic_fetch_add_explicit(&dropped, 1, memory_order_relaxed);
+        return;
+    }
+    queue[h & (INPUT_QUEUE_SIZE - 1)] = (input_event_t){
+        .timestamp_us = now_us,
+        .gpio = gpio,
+        .type = type,
+    };
+    atomic_store_explicit(&head, h + 1, memory_order_release);
+}
+
+// Contact bounce makes more edges, only the first says when the input moved
+static void input_edge_irq(unsigned int gpio) {
+    if (!(edge_pending & GPIO_BIT(gpio))) {
+        edge_us[gpio] = hal_time_us();
+        edge_pending |= GPIO_BIT(gpio);
+    }
+    if (!busy)
+        wake_pending = true;
+}
+
+void input_init(void) {
+    state = read_inputs();
+    cnt0 = 0;
+    cnt1 = 0;
+    long_press_pending = 0;
+    edge_pending = 0;
+    atomic_init(&head, 0);
+    atomic_init(&tail, 0);
+    atomic_init(&dropped, 0);
+    busy = false;
+    wake_pending = false;
+    for (uint64_t pins = INPUT_MASK; pins; pins &= pins - 1)
+        hal_gpio_set_change_irq(__builtin_ctzll(pins), input_edge_irq);
+}
+
+void input_scan(uint64_t now_us) {
+    PROF_BEGIN(prof_scan);
+    wake_pending = false;
+    // the snapshot and the edge times it settles have to agree, so no edge
+    // may come in between
+    uint32_t irq_state = hal_enter_critical();
+    uint64_t delta = read_inputs() ^ state;
+
+    // inputs that agree with state reset their counter, the others count up
+    // and toggle when the counter wraps
+    cnt1 = (cnt1 ^ cnt0) & delta;
+    cnt0 = ~cnt0 & delta;
+    uint64_t toggled = delta & ~(cnt0 | cnt1);
+    state ^= toggled;
+
+    // events are stamped with the first edge of the change, 40 ms of
+    // debouncing earlier, or with the scan if the edge was missed
+    while (toggled) {
+        unsigned int gpio = __builtin_ctzll(toggled);
+        toggled &= toggled - 1;
+        uint64_t at_us = (edge_pending & GPIO_BIT(gpio)) ? edge_us[gpio] : now_us;
+
+        if (state & GPIO_BIT(gpio)) {
+            push_event(at_us, gpio, INPUT_PRESS);
+            pressed_at_us[gpio] = at_us;
+            long_press_pending |= GPIO_BIT(gpio) & BUTTON_MASK;
+        } else {
+            push_event(at_us, gpio, INPUT_RELEASE);
+            long_press_pending &= ~GPIO_BIT(gpio);
+        }
+    }
+    // a bounce that settled back leaves the next edge to be timed afresh
+    edge_pending &= delta & (cnt0 | cnt1);
+    hal_exit_critical(irq_state);
+
+    for (uint64_t held = long_press_pending; held; held &= held - 1) {
+        unsigned int gpio = __builtin_ctzll(held);
+        uint64_t long_at_us = pressed_at_us[gpio] + INPUT_LONG_PRESS_US;
+        if (now_us >= long_at_us) {
+            push_event(long_at_us, gpio, INPUT_LONG_PRESS);
+            long_press_pending &= ~GPIO_BIT(gpio);
+        }
+    }
+    busy = (cnt0 | cnt1) || long_press_pending;
+    // edges while busy were ignored, catch one that came in during the scan
+    if (!busy && read_inputs() != state)
+        wake_pending = true;
+    PROF_END(prof_scan);
+}
+
+bool input_wake_pending(void) {
+    return wake_pending;
+}
+
+bool input_busy(void) {
+    return busy;
+}
+
+bool input_event_pop(input_event_t *event) {
+    unsigned int t = atomic_load_explicit(&tail, memory_order_relaxed);
+    unsigned int h = atomic_load_explicit(&head, memory_order_acquire);
+
+    if (h == t)
+        return false;
+    *event = queue[t & (INPUT_QUEUE_SIZE - 1)];
+    atomic_store_explicit(&tail, t + 1, memory_order_release);
+    return true;
+}
+
+uint32_t input_events_dropped(void) {
+    return atomic_load_explicit(&dropped, memory_order_relaxed);
+}
+
+uint64_t input_state(void) {
+    return state;
+}
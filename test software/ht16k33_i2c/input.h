@@ -0,0 +1,50 @@
+#ifndef INPUT_H
+#define INPUT_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Buttons and slide switches. input_scan() samples every input pin with one
+// gpio snapshot, debounces them with vertical counters and queues an event
+// for each debounced change, so consumers only do work when something
+// actually happened. Events carry the time of the input's first edge, taken
+// by the edge interrupt, not the time debouncing finished.
+
+// An input changes state after reading differently on four consecutive
+// scans, 40 ms at INPUT_SCAN_PERIOD_US. Scans are only needed while an input
+// is settling or a button is held, otherwise an edge interrupt on any input
+// says when to start again.
+#define INPUT_SCAN_PERIOD_US (10 * 1000)
+
+// Buttons held this long also report a long press, once per press
+#define INPUT_LONG_PRESS_US (800 * 1000)
+
+// Must be a power of two
+#define INPUT_QUEUE_SIZE 32
+
+typedef enum {
+    INPUT_PRESS,
+    INPUT_RELEASE,
+    INPUT_LONG_PRESS,
+} input_event_type_t;
+
+typedef struct {
+    uint64_t timestamp_us;
+    uint8_t gpio;
+    uint8_t type;   // input_event_type_t
+} input_event_t;
+
+// Take the current levels as the initial state, without queueing events
+void input_init(void);
+void input_scan(uint64_t now_us);
+// An input changed since the last scan left everything settled
+bool input_wake_pending(void);
+// Keep scanning every INPUT_SCAN_PERIOD_US, an input is settling or held
+bool input_busy(void);
+bool input_event_pop(input_event_t *event);
+uint32_t input_events_dropped(void);
+
+// Debounced state of all inputs, one bit per gpio, set while active
+uint64_t input_state(void);
+
+#endif
@@ -0,0 +1,216 @@
+#include <stdio.h>
+#include <string.h>
+#include "board.h"
+#include "hal.h"
+#include "i2c_async.h"
+#include "lis2dw12.h"
+
+#if LIS2DW12_FIFO_SIZE > ACCEL_FIFO_MAX
+#error "LIS2DW12_FIFO_SIZE is larger than ACCEL_FIFO_MAX"
+#endif
+
+/* Driver for the LIS2DW12, the alternate accelerometer footprint.
+
+   It runs in high performance mode, where samples are 14 bits left-justified
+   like on the MMA8451Q, so both scale to Q12 with the same shift. INT1 is
+   switched to active low to match the falling edge interrupt the board uses
+   for the MMA8451Q, and data-ready stays latched until the sample is read.
+*/
+
+// Set by lis2dw12_init()
+static uint8_t fs = LIS2DW12_FS_2G;
+static uint8_t odr = LIS2DW12_ODR_100HZ;
+
+// Indexed by ODR[3:0] from 12.5 Hz up, in mHz
+// X_OFS_USR..Z_OFS_USR are subtracted from the output in steps of 977 ug,
+// or 15.6 mg with USR_OFF_W set, which is 4 or 64 in Q12
+#define OFFSET_STEP_Q12         4
+#define OFFSET_STEP_COARSE_Q12  64
+
+static const uint32_t odr_mhz[] = {
+    [LIS2DW12_ODR_12_5HZ] = 12500, [LIS2DW12_ODR_25HZ] = 25000, [LIS2DW12_ODR_50HZ] = 50000,
+    [LIS2DW12_ODR_100HZ] = 100000, [LIS2DW12_ODR_200HZ] = 200000, [LIS2DW12_ODR_400HZ] = 400000,
+    [LIS2DW12_ODR_800HZ] = 800000, [LIS2DW12_ODR_1600HZ] = 1600000,
+};
+
+int lis2dw12_write_register(uint8_t reg_address, uint8_t value) {
+    uint8_t buf[2] = {reg_address, value};
+
+    int ret = i2c_async_transfer_blocking(LIS2DW12_ADDRESS, buf, 2, NULL, 0);
+    if (ret != 2) {
+        printf("I2C Write Error to 0x%02X, ret: %d\n", reg_address, ret);
+        return PICO_ERROR_GENERIC;
+    }
+    return ret;
+}
+
+// Burst write of consecutive registers from reg_address, a longer one than
+// the buffer fails like a write the sensor did not take
+static int lis2dw12_write_registers(uint8_t reg_address, const uint8_t *values, size_t len) {
+    uint8_t buf[1 + LIS2DW12_CTRL6 - LIS2DW12_CTRL2 + 1];  // CTRL2..CTRL6, the longest image
+
+    if (len > sizeof(buf) - 1) {
+        printf("I2C Write Error to 0x%02X, %u registers\n", reg_address, (unsigned int)len);
+        return PICO_ERROR_GENERIC;
+    }
+    buf[0] = reg_address;
+    memcpy(&buf[1], values, len);
+    int ret = i2c_async_transfer_blocking(LIS2DW12_ADDRESS, buf, 1 + len, NULL, 0);
+    if (ret != (int)(1 + len)) {
+        printf("I2C Write Error to 0x%02X, ret: %d\n", reg_address, ret);
+        return PICO_ERROR_GENERIC;
+    }
+    return ret;
+}
+
+// Multi-byte reads and writes rely on IF_ADD_INC, which is on from reset
+int lis2dw12_read_register(uint8_t reg_address, uint8_t *buffer, size_t len) {
+    int ret = i2c_async_transfer_blocking(LIS2DW12_ADDRESS, &reg_address, 1, buffer, len);
+    if (ret != (int)(1 + len)) {
+        printf("Accelerometer I2C read data error\n");
+        return PICO_ERROR_GENERIC;
+    }
+    return (int)len;
+}
+
+/**
+ * @brief Converts burst-read output registers to Q12 acceleration.
+ * @param raw_data count blocks of X_L, X_H, Y_L, Y_H, Z_L, Z_H.
+ * @param count Number of samples, e.g. a whole FIFO drain.
+ * @param samples Receives x, y and z, timestamps are left alone.
+ */
+void lis2dw12_unpack_q12(const uint8_t *raw_data, size_t count, accel_sample_t *samples) {
+    // 4096 counts per g at 2 g in high performance mode, as on the MMA8451Q
+    const int shift = 2 - fs;
+
+    for (size_t i = 0; i < count; i++, raw_data += 6) {
+        samples[i].x = (int16_t)((raw_data[0] | (raw_data[1] << 8)) & 0xFFFC) >> shift;
+        samples[i].y = (int16_t)((raw_data[2] | (raw_data[3] << 8)) & 0xFFFC) >> shift;
+        samples[i].z = (int16_t)((raw_data[4] | (raw_data[5] << 8)) & 0xFFFC) >> shift;
+    }
+}
+
+// Read the current sample, in Q12 g
+bool lis2dw12_read_data(int16_t *x, int16_t *y, int16_t *z) {
+    uint8_t raw_data[6];
+    accel_sample_t sample;
+
+    int ret = lis2dw12_read_register(LIS2DW12_OUT_X_L, raw_data, 6);
+    if (ret == PICO_ERROR_GENERIC)
+        return false;
+    lis2dw12_unpack_q12(raw_data, 1, &sample);
+    *x = sample.x;
+    *y = sample.y;
+    *z = sample.z;
+    return true;
+}
+
+bool lis2dw12_probe(void) {
+    uint8_t reg = LIS2DW12_WHO_AM_I;
+    uint8_t id;
+
+    if (i2c_async_transfer_blocking(LIS2DW12_ADDRESS, &reg, 1, &id, 1) != 2)
+        return false;
+    return id == LIS2DW12_DEVICE_ID;
+}
+
+/**
+ * @brief Takes a bias out in the user offset registers, without stopping.
+ * @param bias Q12 g, updated to what was applied, at most +-2 g. The fine
+ *        step is used while every axis fits its +-124 mg range.
+ * @return true if the sensor answered.
+ */
+bool lis2dw12_set_offsets(int16_t bias[3]) {
+    int step = OFFSET_STEP_Q12;
+    uint8_t image[4];
+
+    for (int axis = 0; axis < 3; axis++) {
+        if (bias[axis] > 127 * OFFSET_STEP_Q12 || bias[axis] < -127 * OFFSET_STEP_Q12)
+            step = OFFSET_STEP_COARSE_Q12;
+    }
+    for (int axis = 0; axis < 3; axis++) {
+        int32_t steps = (bias[axis] >= 0 ? bias[axis] + step / 2 : bias[axis] - step / 2) / step;
+        if (steps > 127) steps = 127;
+        if (steps < -128) steps = -128;
+        image[axis] = (uint8_t)(int8_t)steps;
+        bias[axis] = (int16_t)(steps * step);
+    }
+    image[LIS2DW12_CTRL7 - LIS2DW12_X_OFS_USR] =
+        LIS2DW12_CTRL7_USR_OFF_ON_OUT | (step == OFFSET_STEP_COARSE_Q12 ? LIS2DW12_CTRL7_USR_OFF_W : 0);
+    return lis2dw12_write_registers(LIS2DW12_X_OFS_USR, image, sizeof(image)) != PICO_ERROR_GENERIC;
+}
+
+/**
+ * @brief Sets the range and rate and starts sampling, after lis2dw12_probe().
+ * @param config Requested rate, the slowest ODR at or above it is used, and range.
+ * @return true if the sensor answered and was configured.
+ */
+bool lis2dw12_init(const accel_config_t *config) {
+    printf("Initializing LIS2DW12...\n");
+
+    fs = config->range_g <= 2 ? LIS2DW12_FS_2G : config->range_g <= 4 ? LIS2DW12_FS_4G : LIS2DW12_FS_8G;
+    odr = LIS2DW12_ODR_12_5HZ;
+    while (odr < LIS2DW12_ODR_1600HZ && odr_mhz[odr] < config->odr_hz * 1000u)
+        odr++;
+
+    // WHO_AM_I was checked by lis2dw12_probe(). CTRL2..CTRL6 go out as one
+    // image instead of a soft reset and its wait, which also clears any
+    // interrupt routing a previous run left behind. BDU keeps a burst read
+    // of X, Y and Z within one sample.
+    const uint8_t image[] = {
+        [LIS2DW12_CTRL2 - LIS2DW12_CTRL2] = LIS2DW12_CTRL2_BDU | LIS2DW12_CTRL2_IF_ADD_INC,
+        [LIS2DW12_CTRL3 - LIS2DW12_CTRL2] = LIS2DW12_CTRL3_H_LACTIVE,
+        [LIS2DW12_CTRL4_INT1 - LIS2DW12_CTRL2] = 0,
+        [LIS2DW12_CTRL5_INT2 - LIS2DW12_CTRL2] = 0,
+        [LIS2DW12_CTRL6 - LIS2DW12_CTRL2] = (fs << LIS2DW12_CTRL6_FS_SHIFT) | LIS2DW12_CTRL6_LOW_NOISE,
+    };
+    if (lis2dw12_write_registers(LIS2DW12_CTRL2, image, sizeof(image)) == PICO_ERROR_GENERIC) return false;
+    printf("Set accelerometer range to %dg\n", (1 << (fs + 1)));
+
+    // always written, offsets from a previous run survive without a reset
+    int16_t bias[3] = { config->bias[0], config->bias[1], config->bias[2] };
+    if (!lis2dw12_set_offsets(bias)) return false;
+
+    uint8_t ctrl1 = (odr << LIS2DW12_CTRL1_ODR_SHIFT) | LIS2DW12_CTRL1_MODE_HIGH_PERF;
+    if (lis2dw12_write_register(LIS2DW12_CTRL1, ctrl1) == PICO_ERROR_GENERIC) return false;
+    printf("LIS2DW12 activated.\n");
+    return true;
+}
+
+// Sample period at the rate set by lis2dw12_init()
+uint32_t lis2dw12_odr_period_us(void) {
+    return 1000000000u / odr_mhz[odr];
+}
+
+// Route one source to INT1. Unlike on the MMA8451Q this works while the
+// sensor runs. Bypass empties the FIFO, continuous mode then overwrites the
+// oldest samples if a drain is late.
+static bool lis2dw12_route_int1(accel_int1_source_t source, uint8_t watermark) {
+    if (source == ACCEL_INT1_FIFO && watermark > LIS2DW12_FIFO_CTRL_FTH_MASK) return false;
+
+    if (lis2dw12_write_register(LIS2DW12_FIFO_CTRL, LIS2DW12_FMODE_BYPASS << LIS2DW12_FIFO_CTRL_FMODE_SHIFT) == PICO_ERROR_GENERIC) return false;
+    if (source == ACCEL_INT1_FIFO) {
+        uint8_t fifo_ctrl = (LIS2DW12_FMODE_CONTINUOUS << LIS2DW12_FIFO_CTRL_FMODE_SHIFT) | watermark;
+        if (lis2dw12_write_register(LIS2DW12_FIFO_CTRL, fifo_ctrl) == PICO_ERROR_GENERIC) return false;
+    }
+    uint8_t int1_source = source == ACCEL_INT1_FIFO ? LIS2DW12_INT1_FTH : LIS2DW12_INT1_DRDY;
+    return lis2dw12_write_register(LIS2DW12_CTRL4_INT1, int1_source) != PICO_ERROR_GENERIC;
+}
+
+const accel_driver_t accel_lis2dw12 = {
+    .name = "lis2dw12",
+    .address = LIS2DW12_ADDRESS,
+    .fifo_size = LIS2DW12_FIFO_SIZE,
+    // OUT_Z_H rolls back to OUT_X_L while the FIFO is on
+    .sample_reg = LIS2DW12_OUT_X_L,
+    .fifo_status_reg = LIS2DW12_FIFO_SAMPLES,
+    .fifo_count_mask = LIS2DW12_FIFO_SAMPLES_DIFF_MASK,
+    .fifo_overflow = LIS2DW12_FIFO_SAMPLES_OVR,
+    .probe = lis2dw12_probe,
+    .init = lis2dw12_init,
+    .odr_period_us = lis2dw12_odr_period_us,
+    .read_data = lis2dw12_read_data,
+    .unpack_q12 = lis2dw12_unpack_q12,
+    .route_int1 = lis2dw12_route_int1,
+    .set_offsets = lis2dw12_set_offsets,
+};
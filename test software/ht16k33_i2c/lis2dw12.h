@@ -0,0 +1,101 @@
+#ifndef LIS2DW12_H
+#define LIS2DW12_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "accel.h"
+#include "sample_ring.h"
+
+// Alternate accelerometer footprint (LIS2DW12TR). SA0 is tied low on the
+// board, 0x19 with it high.
+#define LIS2DW12_ADDRESS 0x18
+
+// LIS2DW12 register addresses
+#define LIS2DW12_OUT_T_L        0x0D
+#define LIS2DW12_OUT_T_H        0x0E
+#define LIS2DW12_WHO_AM_I       0x0F
+#define LIS2DW12_CTRL1          0x20
+#define LIS2DW12_CTRL2          0x21
+#define LIS2DW12_CTRL3          0x22
+#define LIS2DW12_CTRL4_INT1     0x23
+#define LIS2DW12_CTRL5_INT2     0x24
+#define LIS2DW12_CTRL6          0x25
+#define LIS2DW12_OUT_T          0x26
+#define LIS2DW12_STATUS         0x27
+#define LIS2DW12_OUT_X_L        0x28
+#define LIS2DW12_OUT_X_H        0x29
+#define LIS2DW12_OUT_Y_L        0x2A
+#define LIS2DW12_OUT_Y_H        0x2B
+#define LIS2DW12_OUT_Z_L        0x2C
+#define LIS2DW12_OUT_Z_H        0x2D
+#define LIS2DW12_FIFO_CTRL      0x2E
+#define LIS2DW12_FIFO_SAMPLES   0x2F
+#define LIS2DW12_X_OFS_USR      0x3C
+#define LIS2DW12_Y_OFS_USR      0x3D
+#define LIS2DW12_Z_OFS_USR      0x3E
+#define LIS2DW12_CTRL7          0x3F
+
+#define LIS2DW12_DEVICE_ID      0x44
+
+// CTRL1: ODR[7:4], MODE[3:2], LP_MODE[1:0]
+#define LIS2DW12_CTRL1_ODR_SHIFT        4
+#define LIS2DW12_CTRL1_MODE_HIGH_PERF   0x04
+// CTRL2
+#define LIS2DW12_CTRL2_SOFT_RESET       0x40
+#define LIS2DW12_CTRL2_BDU              0x08
+#define LIS2DW12_CTRL2_IF_ADD_INC       0x04
+// CTRL3
+#define LIS2DW12_CTRL3_H_LACTIVE        0x08
+// CTRL4_INT1_PAD_CTRL
+#define LIS2DW12_INT1_FTH               0x02
+#define LIS2DW12_INT1_DRDY              0x01
+// CTRL6: BW_FILT[7:6], FS[5:4]
+#define LIS2DW12_CTRL6_FS_SHIFT         4
+#define LIS2DW12_CTRL6_LOW_NOISE        0x04
+// CTRL7
+#define LIS2DW12_CTRL7_USR_OFF_ON_OUT   0x10
+#define LIS2DW12_CTRL7_USR_OFF_W        0x04
+// STATUS
+#define LIS2DW12_STATUS_FIFO_THS        0x80
+#define LIS2DW12_STATUS_DRDY            0x01
+// FIFO_CTRL: FMode[7:5], FTH[4:0]
+#define LIS2DW12_FIFO_CTRL_FMODE_SHIFT  5
+#define LIS2DW12_FIFO_CTRL_FTH_MASK     0x1F
+#define LIS2DW12_FMODE_BYPASS           0b000
+#define LIS2DW12_FMODE_FIFO             0b001
+#define LIS2DW12_FMODE_CONTINUOUS       0b110
+// FIFO_SAMPLES
+#define LIS2DW12_FIFO_SAMPLES_FTH       0x80
+#define LIS2DW12_FIFO_SAMPLES_OVR       0x40
+#define LIS2DW12_FIFO_SAMPLES_DIFF_MASK 0x3F
+
+#define LIS2DW12_FIFO_SIZE 32
+
+// Full scale range, FS[1:0] in CTRL6. 16 g is left out, it does not fit Q12
+// in an int16.
+#define LIS2DW12_FS_2G          0b00
+#define LIS2DW12_FS_4G          0b01
+#define LIS2DW12_FS_8G          0b10
+
+// Output data rates in high performance mode, ODR[3:0] in CTRL1
+#define LIS2DW12_ODR_OFF        0x0
+#define LIS2DW12_ODR_12_5HZ     0x2
+#define LIS2DW12_ODR_25HZ       0x3
+#define LIS2DW12_ODR_50HZ       0x4
+#define LIS2DW12_ODR_100HZ      0x5
+#define LIS2DW12_ODR_200HZ      0x6
+#define LIS2DW12_ODR_400HZ      0x7
+#define LIS2DW12_ODR_800HZ      0x8
+#define LIS2DW12_ODR_1600HZ     0x9
+
+int lis2dw12_write_register(uint8_t reg_address, uint8_t value);
+int lis2dw12_read_register(uint8_t reg_address, uint8_t *buffer, size_t len);
+void lis2dw12_unpack_q12(const uint8_t *raw_data, size_t count, accel_sample_t *samples);
+bool lis2dw12_read_data(int16_t *x, int16_t *y, int16_t *z);
+bool lis2dw12_probe(void);
+bool lis2dw12_init(const accel_config_t *config);
+uint32_t lis2dw12_odr_period_us(void);
+bool lis2dw12_set_offsets(int16_t bias[3]);
+
+#endif
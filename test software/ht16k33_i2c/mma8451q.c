@@ -0,0 +1,428 @@
+#include <stdatomic.h>
+#include <stdio.h>
+#include <string.h>
+#include "board.h"
+#include "hal.h"
+#include "i2c_async.h"
+#include "mma8451q.h"
+
+#if MMA8451Q_FIFO_SIZE > ACCEL_FIFO_MAX
+#error "MMA8451Q_FIFO_SIZE is larger than ACCEL_FIFO_MAX"
+#endif
+
+// Set by mma8451q_init()
+static uint8_t fs = MMA8451Q_FS_2G;
+static uint8_t dr = MMA8451Q_DR_100HZ;
+
+// Shadow of CTRL_REG1..CTRL_REG5 and OFF_X..OFF_Z, which follow them. The
+// driver is the only writer, so changes are written from here without
+// reading the sensor first.
+#define CTRL(reg) ((reg) - MMA8451Q_CTRL_REG1)
+static uint8_t ctrl[CTRL(MMA8451Q_OFF_Z) + 1];
+
+// OFF_X..OFF_Z are added to the output in steps of 2 mg at every range,
+// which is 8 in Q12
+#define OFFSET_STEP_Q12 8
+
+// Indexed by DR[2:0]
+static const uint32_t dr_mhz[8] = {800000, 400000, 200000, 100000, 50000, 12500, 6250, 1563};
+static const uint32_t dr_period_us[8] = {1250, 2500, 5000, 10000, 20000, 80000, 160000, 640000};
+
+// Embedded function events from INT2. One burst from INT_SOURCE through
+// PULSE_SRC reads, and so clears, every source register at once.
+#define MOTION_READ_LEN (MMA8451Q_PULSE_SRC - MMA8451Q_INT_SOURCE + 1)
+#define MOTION_SRC(reg) ((reg) - MMA8451Q_INT_SOURCE)
+
+// Must be a power of two
+#define MOTION_QUEUE_SIZE 16
+
+static bool motion_enabled;
+static bool ff_mt_motion;
+
+static struct {
+    i2c_xfer_t xfer;
+    uint8_t reg;
+    uint8_t regs[MOTION_READ_LEN];
+    uint64_t timestamp_us;
+    volatile bool busy;
+} motion_read;
+
+static mma8451q_event_t motion_queue[MOTION_QUEUE_SIZE];
+static atomic_uint motion_head;
+static atomic_uint motion_tail;
+static atomic_uint motion_dropped;
+
+int mma8451q_write_register(uint8_t reg_address, uint8_t value) {
+    uint8_t buf[2];
+    buf[0] = reg_address;
+    buf[1] = value;
+
+    int ret = i2c_async_transfer_blocking(MMA8451Q_ADDRESS, buf, 2, NULL, 0);
+
+    if (ret != 2) {
+        printf("I2C Write Error to 0x%02X, ret: %d\n", reg_address, ret);
+        return PICO_ERROR_GENERIC;
+    }
+    return ret;
+}
+
+// Burst write of consecutive registers from reg_address, a longer one than
+// the buffer fails like a write the sensor did not take
+static int mma8451q_write_registers(uint8_t reg_address, const uint8_t *values, size_t len) {
+    uint8_t buf[1 + sizeof(ctrl)];
+
+    if (len > sizeof(buf) - 1) {
+        printf("I2C Write Error to 0x%02X, %u registers\n", reg_address, (unsigned int)len);
+        return PICO_ERROR_GENERIC;
+    }
+    buf[0] = reg_address;
+    memcpy(&buf[1], values, len);
+    int ret = i2c_async_transfer_blocking(MMA8451Q_ADDRESS, buf, 1 + len, NULL, 0);
+    if (ret != (int)(1 + len)) {
+        printf("I2C Write Error to 0x%02X, ret: %d\n", reg_address, ret);
+        return PICO_ERROR_GENERIC;
+    }
+    return ret;
+}
+
+int mma8451q_read_register(uint8_t reg_address, uint8_t *buffer, size_t len) {
+    // first send (device address + write)
+    // then send register address
+    // first tell accelerometer which address to read from
+    // then read from accelerometer after a repeated start
+    int ret = i2c_async_transfer_blocking(MMA8451Q_ADDRESS, &reg_address, 1, buffer, len);
+    if (ret != (int)(1 + len)) { // check if number of transferred bytes is correct
+        printf("Accelerometer I2C read data error\n");
+        return PICO_ERROR_GENERIC;
+    }
+    return (int)len;
+}
+
+
+
+/**
+ * @brief Converts burst-read output registers to Q12 acceleration.
+ * @param raw_data count blocks of X_MSB, X_LSB, Y_MSB, Y_LSB, Z_MSB, Z_LSB.
+ * @param count Number of samples, e.g. a whole FIFO drain.
+ * @param samples Receives x, y and z, timestamps are left alone.
+ */
+void mma8451q_unpack_q12(const uint8_t *raw_data, size_t count, accel_sample_t *samples) {
+    // The 14-bit value is left-justified in 16 bits. Dropping the two unused
+    // bits and shifting right by what remains above Q12 sign extends and
+    // scales in one arithmetic shift.
+    const int shift = 2 - fs;
+
+    for (size_t i = 0; i < count; i++, raw_data += 6) {
+        samples[i].x = (int16_t)(((raw_data[0] << 8) | raw_data[1]) & 0xFFFC) >> shift;
+        samples[i].y = (int16_t)(((raw_data[2] << 8) | raw_data[3]) & 0xFFFC) >> shift;
+        samples[i].z = (int16_t)(((raw_data[4] << 8) | raw_data[5]) & 0xFFFC) >> shift;
+    }
+}
+
+// Read the current sample, in Q12 g
+bool mma8451q_read_data(int16_t *x, int16_t *y, int16_t *z) {
+    uint8_t raw_data[6]; // X_MSB, X_LSB, Y_MSB, Y_LSB, Z_MSB, Z_LSB
+    accel_sample_t sample;
+
+    // read 6 bytes starting from OUT_X_MSB (0x01)
+    int ret = mma8451q_read_register(MMA8451Q_OUT_X_MSB, raw_data, 6);
+    if (ret == PICO_ERROR_GENERIC) {return false;}
+
+    mma8451q_unpack_q12(raw_data, 1, &sample);
+    *x = sample.x;
+    *y = sample.y;
+    *z = sample.z;
+
+    return true;
+}
+
+bool mma8451q_probe(void) {
+    uint8_t reg = MMA8451Q_WHO_AM_I;
+    uint8_t id;
+
+    if (i2c_async_transfer_blocking(MMA8451Q_ADDRESS, &reg, 1, &id, 1) != 2)
+        return false;
+    return id == MMA8451Q_DEVICE_ID;
+}
+
+static bool mma8451q_set_active(bool active);
+
+// Offset registers that take out bias, and the bias they actually take out
+static void mma8451q_set_offset_image(int16_t bias[3]) {
+    for (int axis = 0; axis < 3; axis++) {
+        int32_t steps = (bias[axis] >= 0 ? bias[axis] + OFFSET_STEP_Q12 / 2 : bias[axis] - OFFSET_STEP_Q12 / 2) / OFFSET_STEP_Q12;
+        if (steps > 128) steps = 128;
+        if (steps < -127) steps = -127;
+        ctrl[CTRL(MMA8451Q_OFF_X) + axis] = (uint8_t)(int8_t)-steps;
+        bias[axis] = (int16_t)(steps * OFFSET_STEP_Q12);
+    }
+}
+
+/**
+ * @brief Sets the range and rate and activates the sensor, after mma8451q_probe().
+ * @param config Requested rate, the slowest DR at or above it is used, and range.
+ * @return true if the sensor answered and was configured.
+ */
+bool mma8451q_init(const accel_config_t *config) {
+    printf("Initializing MMA8451Q...\n");
+
+    fs = config->range_g <= 2 ? MMA8451Q_FS_2G : config->range_g <= 4 ? MMA8451Q_FS_4G : MMA8451Q_FS_8G;
+    dr = MMA8451Q_DR_1_56HZ;
+    while (dr > MMA8451Q_DR_800HZ && dr_mhz[dr] < config->odr_hz * 1000u)
+        dr--;
+
+    // WHO_AM_I was checked by mma8451q_probe(). The whole control block and
+    // the offsets are written from an image, no reads and no delays: the
+    // first byte puts the sensor in standby, the next disable and unroute
+    // every interrupt a previous run left behind. The FIFO is turned off
+    // separately. The motion engines keep their settings, but raise nothing
+    // with their CTRL_REG4 bits clear, and mma8451q_enable_motion_events()
+    // rewrites each one it turns on.
+    int16_t bias[3] = { config->bias[0], config->bias[1], config->bias[2] };
+    memset(ctrl, 0, sizeof(ctrl));
+    ctrl[CTRL(MMA8451Q_CTRL_REG1)] = dr << MMA8451Q_CTRL_REG1_DR_SHIFT;
+    mma8451q_set_offset_image(bias);
+    if (mma8451q_write_registers(MMA8451Q_CTRL_REG1, ctrl, sizeof(ctrl)) == PICO_ERROR_GENERIC) return false;
+    if (mma8451q_write_register(MMA8451Q_F_SETUP, 0) == PICO_ERROR_GENERIC) return false;
+
+    if (mma8451q_write_register(MMA8451Q_XYZ_DATA_CFG, fs) == PICO_ERROR_GENERIC) return false;
+    printf("Set accelerometer range to %dg\n", (1 << (fs + 1)));
+
+    if (!mma8451q_set_active(true)) return false;
+    printf("MMA8451Q activated.\n");
+    return true;
+}
+
+// Going active starts a new sample clock, so the timebase starts over
+static bool mma8451q_set_active(bool active) {
+    if (active) {
+        ctrl[CTRL(MMA8451Q_CTRL_REG1)] |= MMA8451Q_CTRL_REG1_ACTIVE;
+        timebase_restart(accel_timebase());
+    } else {
+        ctrl[CTRL(MMA8451Q_CTRL_REG1)] &= ~MMA8451Q_CTRL_REG1_ACTIVE;
+    }
+    return mma8451q_write_register(MMA8451Q_CTRL_REG1, ctrl[CTRL(MMA8451Q_CTRL_REG1)]) != PICO_ERROR_GENERIC;
+}
+
+// Interrupt enables (CTRL_REG4) and pins (CTRL_REG5) in one burst
+static bool mma8451q_write_int_ctrl(void) {
+    return mma8451q_write_registers(MMA8451Q_CTRL_REG4, &ctrl[CTRL(MMA8451Q_CTRL_REG4)], 2) != PICO_ERROR_GENERIC;
+}
+
+/**
+ * @brief Takes a new bias out in OFF_X..OFF_Z, briefly in standby.
+ * @param bias Q12 g, updated to the 2 mg steps within +-250 mg actually applied.
+ * @return true if the sensor was reconfigured.
+ */
+bool mma8451q_set_offsets(int16_t bias[3]) {
+    mma8451q_set_offset_image(bias);
+    // the control block up to the offsets in one burst, starting in standby
+    ctrl[CTRL(MMA8451Q_CTRL_REG1)] &= ~MMA8451Q_CTRL_REG1_ACTIVE;
+    if (mma8451q_write_registers(MMA8451Q_CTRL_REG1, ctrl, sizeof(ctrl)) == PICO_ERROR_GENERIC) return false;
+    return mma8451q_set_active(true);
+}
+
+// Sample period at the rate set by mma8451q_init()
+uint32_t mma8451q_odr_period_us(void) {
+    return dr_period_us[dr];
+}
+
+// Enable one interrupt source on INT1, the FIFO in circular mode so a late
+// drain keeps the newest samples. Interrupt configuration can only be
+// changed in standby. The other source is turned off, and for data ready
+// so is the FIFO, which would otherwise hold back DRDY.
+static bool mma8451q_route_int1(accel_int1_source_t source, uint8_t watermark) {
+    uint8_t int_source = source == ACCEL_INT1_FIFO ? MMA8451Q_INT_FIFO : MMA8451Q_INT_DRDY;
+    uint8_t f_setup = 0;
+
+    if (source == ACCEL_INT1_FIFO)
+        f_setup = (MMA8451Q_F_MODE_CIRCULAR << MMA8451Q_F_SETUP_F_MODE_SHIFT) | (watermark & MMA8451Q_F_SETUP_F_WMRK_MASK);
+
+    if (!mma8451q_set_active(false)) return false;
+    if (mma8451q_write_register(MMA8451Q_F_SETUP, f_setup) == PICO_ERROR_GENERIC) return false;
+    ctrl[CTRL(MMA8451Q_CTRL_REG4)] &= ~(MMA8451Q_INT_FIFO | MMA8451Q_INT_DRDY);
+    ctrl[CTRL(MMA8451Q_CTRL_REG5)] &= ~(MMA8451Q_INT_FIFO | MMA8451Q_INT_DRDY);
+    ctrl[CTRL(MMA8451Q_CTRL_REG4)] |= int_source;
+    ctrl[CTRL(MMA8451Q_CTRL_REG5)] |= int_source;
+    if (!mma8451q_write_int_ctrl()) return false;
+    return mma8451q_set_active(true);
+}
+
+static void mma8451q_event_push(uint8_t type, uint8_t axes, uint8_t negative, uint8_t pl_status) {
+    unsigned int h = atomic_load_explicit(&motion_head, memory_order_relaxed);
+    unsigned int t = atomic_load_explicit(&motion_tail, memory_order_acquire);
+
+    if (h - t == MOTION_QUEUE_SIZE) {
+        atomic_fetch_add_explicit(&motion_dropped, 1, memory_order_relaxed);
+        return;
+    }
+    motion_queue[h & (MOTION_QUEUE_SIZE - 1)] = (mma8451q_event_t){
+        .timestamp_us = motion_read.timestamp_us,
+        .type = type,
+        .axes = axes,
+        .negative = negative,
+        .orientation = (pl_status & MMA8451Q_PL_STATUS_LAPO_MASK) >> 1,
+        .back = pl_status & MMA8451Q_PL_STATUS_BAFRO,
+    };
+    atomic_store_explicit(&motion_head, h + 1, memory_order_release);
+}
+
+// FF_MT_SRC and TRANSIENT_SRC keep event/polarity pairs for X, Y and Z in bits 1:0, 3:2 and 5:4
+static uint8_t mma8451q_src_axes(uint8_t src, int shift) {
+    return ((src >> shift) & 1) | ((src >> (shift + 1)) & 2) | ((src >> (shift + 2)) & 4);
+}
+
+static void mma8451q_motion_sources_read(i2c_xfer_t *xfer) {
+    const uint8_t *regs = motion_read.regs;
+    motion_read.busy = false;
+    if (xfer->result == PICO_ERROR_GENERIC)
+        return;
+
+    uint8_t source = regs[MOTION_SRC(MMA8451Q_INT_SOURCE)];
+    uint8_t pl_status = regs[MOTION_SRC(MMA8451Q_PL_STATUS)];
+
+    if (source & MMA8451Q_INT_FF_MT) {
+        uint8_t src = regs[MOTION_SRC(MMA8451Q_FF_MT_SRC)];
+        // freefall is all axes below threshold at once, so no axis is flagged
+        mma8451q_event_push(ff_mt_motion ? MMA8451Q_EVENT_MOTION : MMA8451Q_EVENT_FREEFALL,
+                            mma8451q_src_axes(src, 1), mma8451q_src_axes(src, 0), pl_status);
+    }
+    if (source & MMA8451Q_INT_TRANS) {
+        uint8_t src = regs[MOTION_SRC(MMA8451Q_TRANSIENT_SRC)];
+        mma8451q_event_push(MMA8451Q_EVENT_TRANSIENT,
+                            mma8451q_src_axes(src, 1), mma8451q_src_axes(src, 0), pl_status);
+    }
+    if (source & MMA8451Q_INT_PULSE) {
+        uint8_t src = regs[MOTION_SRC(MMA8451Q_PULSE_SRC)];
+        mma8451q_event_push((src & MMA8451Q_PULSE_SRC_DPE) ? MMA8451Q_EVENT_DOUBLE_TAP : MMA8451Q_EVENT_TAP,
+                            (src >> 4) & 0x07, src & 0x07, pl_status);
+    }
+    if ((source & MMA8451Q_INT_LNDPRT) && (pl_status & MMA8451Q_PL_STATUS_NEWLP))
+        mma8451q_event_push(MMA8451Q_EVENT_ORIENTATION, 0, 0, pl_status);
+}
+
+// Timestamp the edge and fetch every source register in one transfer
+static void mma8451q_motion_irq(unsigned int gpio) {
+    (void)gpio;
+    if (motion_read.busy)
+        return;
+    motion_read.busy = true;
+    motion_read.timestamp_us = hal_time_us();
+    motion_read.reg = MMA8451Q_INT_SOURCE;
+    motion_read.xfer.addr = MMA8451Q_ADDRESS;
+    motion_read.xfer.tx = &motion_read.reg;
+    motion_read.xfer.tx_len = 1;
+    motion_read.xfer.rx = motion_read.regs;
+    motion_read.xfer.rx_len = MOTION_READ_LEN;
+    motion_read.xfer.callback = mma8451q_motion_sources_read;
+    motion_read.xfer.priority = I2C_PRIORITY_SENSOR;
+    i2c_async_submit(&motion_read.xfer);
+}
+
+/**
+ * @brief Runs freefall/motion, transient, tap and orientation detection on the
+ *        sensor and reports only their events, on INT2.
+ * @param config Engines to enable in sources and their thresholds.
+ * @return true if the sensor was reconfigured.
+ *
+ * The sensor keeps sampling at its output data rate but nothing is read unless an
+ * event fires, so the bus stays idle while nothing happens. This can be
+ * combined with a sample stream on INT1.
+ */
+bool mma8451q_enable_motion_events(const mma8451q_motion_config_t *config) {
+    uint8_t sources = config->sources & (MMA8451Q_INT_FF_MT | MMA8451Q_INT_TRANS | MMA8451Q_INT_PULSE | MMA8451Q_INT_LNDPRT);
+
+    if (!mma8451q_set_active(false)) return false;
+
+    if (sources & MMA8451Q_INT_FF_MT) {
+        uint8_t cfg = MMA8451Q_FF_MT_CFG_ELE | MMA8451Q_FF_MT_CFG_XYZ | (config->ff_mt_motion ? MMA8451Q_FF_MT_CFG_OAE : 0);
+        if (mma8451q_write_register(MMA8451Q_FF_MT_CFG, cfg) == PICO_ERROR_GENERIC) return false;
+        if (mma8451q_write_register(MMA8451Q_FF_MT_THS, config->ff_mt_threshold & 0x7F) == PICO_ERROR_GENERIC) return false;
+        if (mma8451q_write_register(MMA8451Q_FF_MT_COUNT, config->ff_mt_count) == PICO_ERROR_GENERIC) return false;
+    }
+    if (sources & MMA8451Q_INT_TRANS) {
+        // high-pass filter left in, so gravity and slow tilt do not count
+        if (mma8451q_write_register(MMA8451Q_TRANSIENT_CFG, MMA8451Q_TRANSIENT_CFG_ELE | MMA8451Q_TRANSIENT_CFG_XYZ) == PICO_ERROR_GENERIC) return false;
+        if (mma8451q_write_register(MMA8451Q_TRANSIENT_THS, config->transient_threshold & 0x7F) == PICO_ERROR_GENERIC) return false;
+        if (mma8451q_write_register(MMA8451Q_TRANSIENT_COUNT, config->transient_count) == PICO_ERROR_GENERIC) return false;
+    }
+    if (sources & MMA8451Q_INT_PULSE) {
+        uint8_t cfg = MMA8451Q_PULSE_CFG_ELE | MMA8451Q_PULSE_CFG_SINGLE | (config->pulse_window ? MMA8451Q_PULSE_CFG_DOUBLE : 0);
+        const uint8_t pulse[] = {
+            MMA8451Q_PULSE_CFG, cfg,
+            MMA8451Q_PULSE_THSX, config->pulse_threshold & 0x7F,
+            MMA8451Q_PULSE_THSY, config->pulse_threshold & 0x7F,
+            MMA8451Q_PULSE_THSZ, config->pulse_threshold & 0x7F,
+            MMA8451Q_PULSE_TMLT, config->pulse_time_limit,
+            MMA8451Q_PULSE_LTCY, config->pulse_latency,
+            MMA8451Q_PULSE_WIND, config->pulse_window,
+        };
+        for (size_t i = 0; i < count_of(pulse); i += 2)
+            if (mma8451q_write_register(pulse[i], pulse[i + 1]) == PICO_ERROR_GENERIC) return false;
+    }
+    if (sources & MMA8451Q_INT_LNDPRT) {
+        if (mma8451q_write_register(MMA8451Q_PL_CFG, MMA8451Q_PL_CFG_DBCNTM | MMA8451Q_PL_CFG_PL_EN) == PICO_ERROR_GENERIC) return false;
+        if (mma8451q_write_register(MMA8451Q_PL_COUNT, config->pl_count) == PICO_ERROR_GENERIC) return false;
+    }
+
+    // enable the sources and route them to INT2 by clearing their CTRL_REG5 bits
+    ctrl[CTRL(MMA8451Q_CTRL_REG4)] |= sources;
+    ctrl[CTRL(MMA8451Q_CTRL_REG5)] &= ~sources;
+    if (!mma8451q_write_int_ctrl()) return false;
+
+    ff_mt_motion = config->ff_mt_motion;
+    motion_enabled = true;
+    hal_gpio_set_irq(ACCEL_INT2_PIN, mma8451q_motion_irq);
+    return mma8451q_set_active(true);
+}
+
+// Oldest event from INT2, false if there is none
+bool mma8451q_event_pop(mma8451q_event_t *event) {
+    unsigned int t = atomic_load_explicit(&motion_tail, memory_order_relaxed);
+    unsigned int h = atomic_load_explicit(&motion_head, memory_order_acquire);
+
+    if (t == h)
+        return false;
+    *event = motion_queue[t & (MOTION_QUEUE_SIZE - 1)];
+    atomic_store_explicit(&motion_tail, t + 1, memory_order_release);
+    return true;
+}
+
+bool mma8451q_event_pending(void) {
+    return atomic_load_explicit(&motion_head, memory_order_acquire) !=
+           atomic_load_explicit(&motion_tail, memory_order_relaxed);
+}
+
+// Events lost because nobody popped them in time
+uint32_t mma8451q_events_dropped(void) {
+    return atomic_load_explicit(&motion_dropped, memory_order_relaxed);
+}
+
+// INT2 stays asserted until the sources are read. If a read failed there is
+// no new edge to trigger the interrupt again, so pick it up from the main
+// loop.
+void mma8451q_service_irq(void) {
+    uint32_t irq_state = hal_enter_critical();
+    if (motion_enabled && !motion_read.busy && !hal_gpio_get(ACCEL_INT2_PIN))
+        mma8451q_motion_irq(ACCEL_INT2_PIN);
+    hal_exit_critical(irq_state);
+}
+
+const accel_driver_t accel_mma8451q = {
+    .name = "mma8451q",
+    .address = MMA8451Q_ADDRESS,
+    .fifo_size = MMA8451Q_FIFO_SIZE,
+    // OUT_Z_LSB wraps back to OUT_X_MSB while the FIFO is on
+    .sample_reg = MMA8451Q_OUT_X_MSB,
+    .fifo_status_reg = MMA8451Q_F_STATUS,
+    .fifo_count_mask = MMA8451Q_F_STATUS_F_CNT_MASK,
+    .fifo_overflow = MMA8451Q_F_STATUS_F_OVF,
+    .probe = mma8451q_probe,
+    .init = mma8451q_init,
+    .odr_period_us = mma8451q_odr_period_us,
+    .read_data = mma8451q_read_data,
+    .unpack_q12 = mma8451q_unpack_q12,
+    .route_int1 = mma8451q_route_int1,
+    .service_irq = mma8451q_service_irq,
+    .set_offsets = mma8451q_set_offsets,
+};
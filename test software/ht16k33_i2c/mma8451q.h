@@ -0,0 +1,209 @@
+#ifndef MMA8451Q_H
+#define MMA8451Q_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "accel.h"
+#include "sample_ring.h"
+
+// MMA8451Q Accelerometer commands
+#define MMA8451Q_ADDRESS 0x1C
+
+// MMA8451Q Accelerometer register addresses
+#define MMA8451Q_F_STATUS 0x00
+#define MMA8451Q_OUT_X_MSB 0x01
+#define MMA8451Q_OUT_X_LSB 0x02
+#define MMA8451Q_OUT_Y_MSB 0x03
+#define MMA8451Q_OUT_Y_LSB 0x04
+#define MMA8451Q_OUT_Z_MSB 0x05
+#define MMA8451Q_OUT_Z_LSB 0x06
+#define MMA8451Q_F_SETUP 0x09
+#define MMA8451Q_TRIG_CFG 0x0A
+#define MMA8451Q_SYSMOD 0x0B
+#define MMA8451Q_INT_SOURCE 0x0C
+#define MMA8451Q_WHO_AM_I 0x0D
+#define MMA8451Q_XYZ_DATA_CFG 0x0E
+#define MMA8451Q_HP_FILTER_CUTOFF 0x0F
+#define MMA8451Q_PL_STATUS 0x10
+#define MMA8451Q_PL_CFG 0x11
+#define MMA8451Q_PL_COUNT 0x12
+#define MMA8451Q_PL_BF_ZCOMP 0x13
+#define MMA8451Q_P_L_THS_REG 0x14
+#define MMA8451Q_FF_MT_CFG 0x15
+#define MMA8451Q_FF_MT_SRC 0x16
+#define MMA8451Q_FF_MT_THS 0x17
+#define MMA8451Q_FF_MT_COUNT 0x18
+#define MMA8451Q_TRANSIENT_CFG 0x1D
+#define MMA8451Q_TRANSIENT_SRC 0x1E
+#define MMA8451Q_TRANSIENT_THS 0x1F
+#define MMA8451Q_TRANSIENT_COUNT 0x20
+#define MMA8451Q_PULSE_CFG 0x21
+#define MMA8451Q_PULSE_SRC 0x22
+#define MMA8451Q_PULSE_THSX 0x23
+#define MMA8451Q_PULSE_THSY 0x24
+#define MMA8451Q_PULSE_THSZ 0x25
+#define MMA8451Q_PULSE_TMLT 0x26
+#define MMA8451Q_PULSE_LTCY 0x27
+#define MMA8451Q_PULSE_WIND 0x28
+#define MMA8451Q_ALSP_COUNT 0x29
+#define MMA8451Q_CTRL_REG1 0x2A
+#define MMA8451Q_CTRL_REG2 0x2B
+#define MMA8451Q_CTRL_REG3 0x2C
+#define MMA8451Q_CTRL_REG4 0x2D
+#define MMA8451Q_CTRL_REG5 0x2E
+#define MMA8451Q_OFF_X 0x2F
+#define MMA8451Q_OFF_Y 0x30
+#define MMA8451Q_OFF_Z 0x31
+
+// CTRL_REG1
+#define MMA8451Q_CTRL_REG1_ACTIVE   0x01
+#define MMA8451Q_CTRL_REG1_F_READ   0x02
+#define MMA8451Q_CTRL_REG1_DR_SHIFT 3
+#define MMA8451Q_CTRL_REG1_DR_MASK  0x38
+// CTRL_REG4/CTRL_REG5 and INT_SOURCE share bit positions per interrupt source
+#define MMA8451Q_INT_DRDY           0x01
+#define MMA8451Q_INT_FF_MT          0x04
+#define MMA8451Q_INT_PULSE          0x08
+#define MMA8451Q_INT_LNDPRT         0x10
+#define MMA8451Q_INT_TRANS          0x20
+#define MMA8451Q_INT_FIFO           0x40
+// FF_MT_CFG
+#define MMA8451Q_FF_MT_CFG_ELE      0x80
+#define MMA8451Q_FF_MT_CFG_OAE      0x40
+#define MMA8451Q_FF_MT_CFG_XYZ      0x38
+// TRANSIENT_CFG
+#define MMA8451Q_TRANSIENT_CFG_ELE  0x10
+#define MMA8451Q_TRANSIENT_CFG_XYZ  0x0E
+// PULSE_CFG
+#define MMA8451Q_PULSE_CFG_ELE      0x40
+#define MMA8451Q_PULSE_CFG_SINGLE   0x15
+#define MMA8451Q_PULSE_CFG_DOUBLE   0x2A
+// PL_CFG
+#define MMA8451Q_PL_CFG_DBCNTM      0x80
+#define MMA8451Q_PL_CFG_PL_EN       0x40
+// Event flag in FF_MT_SRC and PULSE_SRC, TRANSIENT_SRC has it one bit lower
+#define MMA8451Q_SRC_EA             0x80
+#define MMA8451Q_TRANSIENT_SRC_EA   0x40
+#define MMA8451Q_PULSE_SRC_DPE      0x08
+// PL_STATUS
+#define MMA8451Q_PL_STATUS_NEWLP    0x80
+#define MMA8451Q_PL_STATUS_LO       0x40
+#define MMA8451Q_PL_STATUS_LAPO_MASK 0x06
+#define MMA8451Q_PL_STATUS_BAFRO    0x01
+// F_STATUS when the FIFO is off
+#define MMA8451Q_STATUS_ZYXDR       0x08
+#define MMA8451Q_STATUS_ZYXOW       0x80
+// F_STATUS when the FIFO is on
+#define MMA8451Q_F_STATUS_F_CNT_MASK    0x3F
+#define MMA8451Q_F_STATUS_F_WMRK_FLAG   0x40
+#define MMA8451Q_F_STATUS_F_OVF         0x80
+// F_SETUP
+#define MMA8451Q_F_SETUP_F_MODE_SHIFT   6
+#define MMA8451Q_F_SETUP_F_WMRK_MASK    0x3F
+#define MMA8451Q_F_MODE_OFF         0b00
+#define MMA8451Q_F_MODE_CIRCULAR    0b01
+#define MMA8451Q_F_MODE_FILL        0b10
+#define MMA8451Q_F_MODE_TRIGGER     0b11
+
+#define MMA8451Q_FIFO_SIZE 32
+
+// WHO_AM_I value seen on the board
+#define MMA8451Q_DEVICE_ID 0x2A
+
+// Full scale range, FS[1:0] in XYZ_DATA_CFG. Page 10 of the datasheet gives
+// 4096/2048/1024 counts per g at 2/4/8 g, so counts scale to Q12 by a shift
+// of the FS value.
+#define MMA8451Q_FS_2G          0b00
+#define MMA8451Q_FS_4G          0b01
+#define MMA8451Q_FS_8G          0b10
+
+// Output data rates, written to DR[2:0] in CTRL_REG1
+#define MMA8451Q_DR_800HZ       0b000
+#define MMA8451Q_DR_400HZ       0b001
+#define MMA8451Q_DR_200HZ       0b010
+#define MMA8451Q_DR_100HZ       0b011
+#define MMA8451Q_DR_50HZ        0b100
+#define MMA8451Q_DR_12_5HZ      0b101
+#define MMA8451Q_DR_6_25HZ      0b110
+#define MMA8451Q_DR_1_56HZ      0b111
+
+// Events from the embedded freefall/motion, transient, tap and orientation
+// engines, reported on INT2
+typedef enum {
+    MMA8451Q_EVENT_FREEFALL,
+    MMA8451Q_EVENT_MOTION,
+    MMA8451Q_EVENT_TRANSIENT,
+    MMA8451Q_EVENT_TAP,
+    MMA8451Q_EVENT_DOUBLE_TAP,
+    MMA8451Q_EVENT_ORIENTATION,
+} mma8451q_event_type_t;
+
+#define MMA8451Q_AXIS_X 0x01
+#define MMA8451Q_AXIS_Y 0x02
+#define MMA8451Q_AXIS_Z 0x04
+
+// LAPO in PL_STATUS
+#define MMA8451Q_PORTRAIT_UP        0
+#define MMA8451Q_PORTRAIT_DOWN      1
+#define MMA8451Q_LANDSCAPE_RIGHT    2
+#define MMA8451Q_LANDSCAPE_LEFT     3
+
+typedef struct {
+    uint64_t timestamp_us;
+    uint8_t type;           // mma8451q_event_type_t
+    uint8_t axes;           // MMA8451Q_AXIS_* that triggered
+    uint8_t negative;       // of those, the ones in the negative direction
+    uint8_t orientation;    // MMA8451Q_PORTRAIT_UP..LANDSCAPE_LEFT
+    bool back;              // lying face down
+} mma8451q_event_t;
+
+// Thresholds are 0.063 g per count. Counts and pulse timings are in steps of
+// the output data rate, see the datasheet and AN4072 for the step sizes.
+typedef struct {
+    uint8_t sources;            // MMA8451Q_INT_FF_MT, _TRANS, _PULSE, _LNDPRT
+    bool ff_mt_motion;          // motion above threshold instead of freefall below
+    uint8_t ff_mt_threshold;
+    uint8_t ff_mt_count;
+    uint8_t transient_threshold;
+    uint8_t transient_count;
+    uint8_t pulse_threshold;
+    uint8_t pulse_time_limit;   // PULSE_TMLT, longest a tap may last
+    uint8_t pulse_latency;      // PULSE_LTCY, dead time after a tap
+    uint8_t pulse_window;       // PULSE_WIND, second tap of a double tap, 0 for single only
+    uint8_t pl_count;           // orientation debounce
+} mma8451q_motion_config_t;
+
+// Starting point at 100 Hz: freefall below 0.19 g for 60 ms, transient over
+// 0.5 g, taps over 1.5 g shorter than 50 ms, double taps within 300 ms.
+#define MMA8451Q_MOTION_CONFIG_DEFAULT { \
+    .sources = MMA8451Q_INT_FF_MT | MMA8451Q_INT_TRANS | MMA8451Q_INT_PULSE | MMA8451Q_INT_LNDPRT, \
+    .ff_mt_motion = false, \
+    .ff_mt_threshold = 3, \
+    .ff_mt_count = 6, \
+    .transient_threshold = 8, \
+    .transient_count = 2, \
+    .pulse_threshold = 24, \
+    .pulse_time_limit = 20, \
+    .pulse_latency = 20, \
+    .pulse_window = 60, \
+    .pl_count = 10, \
+}
+
+int mma8451q_write_register(uint8_t reg_address, uint8_t value);
+int mma8451q_read_register(uint8_t reg_address, uint8_t *buffer, size_t len);
+void mma8451q_unpack_q12(const uint8_t *raw_data, size_t count, accel_sample_t *samples);
+bool mma8451q_read_data(int16_t *x, int16_t *y, int16_t *z);
+// WHO_AM_I readback without the messages of mma8451q_init(), for checking
+// the bus speed
+bool mma8451q_probe(void);
+bool mma8451q_init(const accel_config_t *config);
+uint32_t mma8451q_odr_period_us(void);
+bool mma8451q_set_offsets(int16_t bias[3]);
+bool mma8451q_enable_motion_events(const mma8451q_motion_config_t *config);
+bool mma8451q_event_pop(mma8451q_event_t *event);
+bool mma8451q_event_pending(void);
+uint32_t mma8451q_events_dropped(void);
+void mma8451q_service_irq(void);
+
+#endif
@@ -0,0 +1,89 @@
+#include <string.h>
+#include "prof.h"
+
+static prof_hist_t *hists;
+
+static unsigned int bucket_index(uint32_t cycles) {
+    if (cycles < 4)
+        return cycles;
+    unsigned int msb = 31 - __builtin_clz(cycles);
+    return (msb - 1) * 4 + ((cycles >> (msb - 2)) & 3);
+}
+
+// Largest value that lands in a bucket
+static uint32_t bucket_max(unsigned int index) {
+    if (index < 4)
+        return index;
+    unsigned int shift = index / 4 - 1;
+    uint64_t lower = (uint64_t)(4 + index % 4) << shift;
+    return (uint32_t)(lower + (1ull << shift) - 1);
+}
+
+void prof_hist_init(prof_hist_t *hist, const char *name) {
+    memset(hist, 0, sizeof(*hist));
+    hist->name = name;
+    hist->min = UINT32_MAX;
+}
+
+void prof_record(prof_hist_t *hist, uint32_t cycles) {
+    if (!hist->registered) {
+        // either core may get here first
+        uint32_t irq_state = hal_enter_critical();
+        if (!hist->registered) {
+            hist->next = hists;
+            hists = hist;
+            hist->registered = true;
+        }
+        hal_exit_critical(irq_state);
+    }
+    hist->count++;
+    hist->sum += cycles;
+    if (cycles < hist->min)
+        hist->min = cycles;
+    if (cycles > hist->max)
+        hist->max = cycles;
+    hist->buckets[bucket_index(cycles)]++;
+}
+
+static uint32_t percentile(const prof_hist_t *hist, unsigned int percent) {
+    uint64_t target = ((uint64_t)hist->count * percent + 99) / 100;
+    uint64_t seen = 0;
+
+    for (unsigned int i = 0; i < PROF_BUCKETS; i++) {
+        seen += hist->buckets[i];
+        if (seen >= target)
+            return bucket_max(i) < hist->max ? bucket_max(i) : hist->max;
+    }
+    return hist->max;
+}
+
+// Cycles to us with one decimal, as tenths
+static unsigned long long tenths_us(uint64_t cycles) {
+    return cycles * 10 / hal_cycles_per_us();
+}
+
+void prof_report(FILE *out) {
+    fprintf(out, "%-16s %8s %10s %10s %10s %10s  (us)\n", "prof", "count", "min", "mean", "p99", "max");
+    for (const prof_hist_t *hist = hists; hist; hist = hist->next) {
+        if (hist->count == 0)
+            continue;
+        unsigned long long values[4] = {
+            tenths_us(hist->min), tenths_us(hist->sum / hist->count),
+            tenths_us(percentile(hist, 99)), tenths_us(hist->max),
+        };
+        fprintf(out, "%-16s %8lu", hist->name, (unsigned long)hist->count);
+        for (int i = 0; i < 4; i++)
+            fprintf(out, " %8llu.%llu", values[i] / 10, values[i] % 10);
+        fprintf(out, "\n");
+    }
+}
+
+void prof_reset(void) {
+    for (prof_hist_t *hist = hists; hist; hist = hist->next) {
+        hist->count = 0;
+        hist->sum = 0;
+        hist->min = UINT32_MAX;
+        hist->max = 0;
+        memset(hist->buckets, 0, sizeof(hist->buckets));
+    }
+}
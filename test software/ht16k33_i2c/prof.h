@@ -0,0 +1,63 @@
+#ifndef PROF_H
+#define PROF_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "hal.h"
+
+/* Cycle histograms for hot paths.
+
+   PROF_BEGIN()/PROF_END() around a section record its duration, read from
+   hal_cycles(), into a histogram declared with PROF_HIST(). Histograms keep
+   min, max and mean, plus buckets four to an octave, so p99 is known to
+   within 25%. They register themselves on their first sample and
+   prof_report() prints them all.
+
+   On the Pico hal_cycles() is the DWT cycle counter. On the host it is
+   simulated time at a nominal clock, which only advances with modeled bus,
+   flash and USB console time, so the report shows where that time goes.
+   Asynchronous work is recorded from request to completion with
+   PROF_RECORD(), since the part that queues it takes no modeled time.
+
+   Built out unless PROF_ENABLED is set.
+*/
+
+#ifndef PROF_ENABLED
+#define PROF_ENABLED 0
+#endif
+
+// Values 0-3 get a bucket each, then four per power of two up to 2^32
+#define PROF_BUCKETS 124
+
+typedef struct prof_hist {
+    const char *name;
+    uint32_t count;
+    uint32_t min;
+    uint32_t max;
+    uint64_t sum;
+    uint32_t buckets[PROF_BUCKETS];
+    struct prof_hist *next;
+    bool registered;
+} prof_hist_t;
+
+void prof_hist_init(prof_hist_t *hist, const char *name);
+void prof_record(prof_hist_t *hist, uint32_t cycles);
+// Every histogram with samples: count, min, mean, p99 and max in us
+void prof_report(FILE *out);
+void prof_reset(void);
+
+#if PROF_ENABLED
+#define PROF_HIST(var, label) static prof_hist_t var = { .name = (label), .min = UINT32_MAX }
+#define PROF_BEGIN(var) uint32_t var##_start = hal_cycles()
+#define PROF_END(var) prof_record(&(var), hal_cycles() - var##_start)
+// For spans that start and end in different functions
+#define PROF_RECORD(var, cycles) prof_record(&(var), (cycles))
+#else
+#define PROF_HIST(var, label) extern prof_hist_t var
+#define PROF_BEGIN(var) ((void)0)
+#define PROF_END(var) ((void)0)
+#define PROF_RECORD(var, cycles) ((void)0)
+#endif
+
+#endif
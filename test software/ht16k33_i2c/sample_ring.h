@@ -0,0 +1,38 @@
+#ifndef SAMPLE_RING_H
+#define SAMPLE_RING_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Lock-free single producer / single consumer ring of timestamped
+// accelerometer samples. The producer is the data-ready interrupt, the
+// consumer the main loop, so neither side ever blocks the other.
+
+// Must be a power of two. 256 samples is 320 ms of headroom at 800 Hz.
+#define SAMPLE_RING_SIZE 256
+
+// x, y and z are in Q12 g, see ACCEL_Q12_ONE_G in accel.h
+typedef struct {
+    uint64_t timestamp_us;
+    int16_t x;
+    int16_t y;
+    int16_t z;
+} accel_sample_t;
+
+typedef struct {
+    accel_sample_t buf[SAMPLE_RING_SIZE];
+    atomic_uint head;       // written by the producer only
+    atomic_uint tail;       // written by the consumer only
+    atomic_uint dropped;    // samples lost because the ring was full
+} sample_ring_t;
+
+void sample_ring_init(sample_ring_t *ring);
+bool sample_ring_push(sample_ring_t *ring, const accel_sample_t *sample);
+bool sample_ring_pop(sample_ring_t *ring, accel_sample_t *sample);
+// Pop up to max samples in one go, returns how many
+size_t sample_ring_pop_block(sample_ring_t *ring, accel_sample_t *samples, size_t max);
+unsigned int sample_ring_count(sample_ring_t *ring);
+
+#endif
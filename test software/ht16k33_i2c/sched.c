@@ -0,0 +1,80 @@
+#include "hal.h"
+#include "sched.h"
+
+void sched_init(sched_t *sched) {
+    sched->tasks = NULL;
+    sched->started_us = hal_time_us();
+    sched->idle_us = 0;
+    sched->wakeups = 0;
+}
+
+void sched_add(sched_t *sched, sched_task_t *task, uint64_t due_us) {
+    sched_task_t **link = &sched->tasks;
+
+    while (*link)
+        link = &(*link)->next;
+    task->next = NULL;
+    task->due_us = due_us;
+    task->runs = 0;
+    task->busy_us = 0;
+#if PROF_ENABLED
+    prof_hist_init(&task->prof, task->name);
+#endif
+    *link = task;
+}
+
+// Run everything that is due or ready once. Returns the earliest deadline
+// left, or 0 if a task ran and the list has to be checked again.
+static uint64_t sched_pass(sched_t *sched, uint64_t now_us) {
+    uint64_t next_us = SCHED_NEVER;
+    bool ran = false;
+
+    for (sched_task_t *task = sched->tasks; task; task = task->next) {
+        if (task->due_us <= now_us || (task->ready && task->ready())) {
+            task->due_us = SCHED_NEVER;
+            PROF_BEGIN(task_cycles);
+            task->run(task, now_us);
+            PROF_RECORD(task->prof, hal_cycles() - task_cycles_start);
+            uint64_t end_us = hal_time_us();
+            task->runs++;
+            task->busy_us += end_us - now_us;
+            now_us = end_us;
+            ran = true;
+        }
+        if (task->due_us < next_us)
+            next_us = task->due_us;
+    }
+    return ran ? 0 : next_us;
+}
+
+void sched_run_until(sched_t *sched, uint64_t until_us) {
+    while (true) {
+        uint64_t next_us = sched_pass(sched, hal_time_us());
+        if (next_us == 0)
+            continue;
+
+        uint64_t now_us = hal_time_us();
+        if (now_us >= until_us)
+            return;
+        if (next_us > until_us)
+            next_us = until_us;
+        if (next_us > now_us) {
+            hal_wait_for_event_until(next_us);
+            sched->idle_us += hal_time_us() - now_us;
+            sched->wakeups++;
+        }
+    }
+}
+
+void sched_report(const sched_t *sched, FILE *out) {
+    uint64_t elapsed_us = hal_time_us() - sched->started_us;
+    unsigned long idle_permille = elapsed_us ? (unsigned long)(sched->idle_us * 1000 / elapsed_us) : 0;
+
+    fprintf(out, "sched: %llu ms, idle %lu.%lu%%, %lu wakeups\n",
+            (unsigned long long)(elapsed_us / 1000), idle_permille / 10, idle_permille % 10,
+            (unsigned long)sched->wakeups);
+    for (const sched_task_t *task = sched->tasks; task; task = task->next) {
+        fprintf(out, "  %-12s %8lu runs %10llu us busy\n", task->name,
+                (unsigned long)task->runs, (unsigned long long)task->busy_us);
+    }
+}
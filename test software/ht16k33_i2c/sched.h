@@ -0,0 +1,58 @@
+#ifndef SCHED_H
+#define SCHED_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "prof.h"
+
+/* Cooperative run-to-completion scheduler, one per core.
+
+   A task runs when its deadline has passed or its ready() check says there
+   is work, for example samples in the ring after an interrupt. The scheduler
+   clears the deadline before each run, so periodic tasks re-arm themselves
+   with sched_at(). With nothing to run the core waits in WFE until the next
+   deadline or an interrupt, and the time spent there is counted as idle.
+*/
+
+#define SCHED_NEVER UINT64_MAX
+
+typedef struct sched_task {
+    const char *name;
+    void (*run)(struct sched_task *task, uint64_t now_us);
+    bool (*ready)(void);        // optional, polled after every wakeup
+    uint64_t due_us;
+    uint32_t runs;
+    uint64_t busy_us;
+#if PROF_ENABLED
+    prof_hist_t prof;           // cycles per run
+#endif
+    struct sched_task *next;
+} sched_task_t;
+
+typedef struct {
+    sched_task_t *tasks;
+    uint64_t started_us;
+    uint64_t idle_us;
+    uint32_t wakeups;
+} sched_t;
+
+#define SCHED_TASK(task_name, run_fn, ready_fn) \
+    { .name = (task_name), .run = (run_fn), .ready = (ready_fn), .due_us = SCHED_NEVER }
+
+void sched_init(sched_t *sched);
+// Tasks run in the order they were added
+void sched_add(sched_t *sched, sched_task_t *task, uint64_t due_us);
+
+static inline void sched_at(sched_task_t *task, uint64_t due_us) {
+    if (due_us < task->due_us)
+        task->due_us = due_us;
+}
+
+// Run tasks and sleep between them until until_us
+void sched_run_until(sched_t *sched, uint64_t until_us);
+
+// Idle time, wakeups and per task run counts and busy time
+void sched_report(const sched_t *sched, FILE *out);
+
+#endif
@@ -0,0 +1,115 @@
+#include "hal.h"
+#include "telemetry.h"
+
+static uint8_t ring[TELEMETRY_RING_SIZE];
+static uint32_t head;
+static uint32_t tail;
+static uint32_t dropped;
+static uint8_t seq;
+static bool drop_pending;
+static uint64_t last_drain_us;
+
+// Time sync record going out ahead of the ring, sync_len bytes of it left
+static uint8_t sync[TELEMETRY_RECORD_SIZE];
+static uint32_t sync_len;
+static uint64_t last_sync_us;
+
+void telemetry_init(void) {
+    head = 0;
+    tail = 0;
+    dropped = 0;
+    seq = 0;
+    drop_pending = false;
+    last_drain_us = hal_time_us();
+    sync_len = 0;
+    // the first chunk gets one
+    last_sync_us = last_drain_us - TELEMETRY_SYNC_PERIOD_US;
+}
+
+void telemetry_encode(const telemetry_record_t *record, uint8_t sequence, uint8_t flags,
+                      uint8_t out[TELEMETRY_RECORD_SIZE]) {
+    uint32_t t = (uint32_t)record->timestamp_us;
+
+    out[0] = TELEMETRY_SYNC;
+    out[1] = sequence;
+    out[2] = t;
+    out[3] = t >> 8;
+    out[4] = t >> 16;
+    out[5] = t >> 24;
+    out[6] = (uint16_t)record->x;
+    out[7] = (uint16_t)record->x >> 8;
+    out[8] = (uint16_t)record->y;
+    out[9] = (uint16_t)record->y >> 8;
+    out[10] = (uint16_t)record->z;
+    out[11] = (uint16_t)record->z >> 8;
+    out[12] = record->inputs;
+    out[13] = record->inputs >> 8;
+    out[14] = flags;
+    out[15] = telemetry_crc8(out, TELEMETRY_RECORD_SIZE - 1);
+}
+
+void telemetry_encode_sync(uint64_t now_us, uint8_t next_sequence, uint8_t out[TELEMETRY_RECORD_SIZE]) {
+    out[0] = TELEMETRY_SYNC;
+    out[1] = next_sequence;
+    for (int i = 0; i < 8; i++)
+        out[2 + i] = now_us >> (8 * i);
+    for (int i = 10; i < 14; i++)
+        out[i] = 0;
+    out[14] = TELEMETRY_FLAG_TIME_SYNC;
+    out[15] = telemetry_crc8(out, TELEMETRY_RECORD_SIZE - 1);
+}
+
+void telemetry_put(const telemetry_record_t *record) {
+    if (head - tail == TELEMETRY_RING_SIZE) {
+        dropped++;
+        drop_pending = true;
+        return;
+    }
+    // records never straddle the end of the ring
+    telemetry_encode(record, seq++, drop_pending ? TELEMETRY_FLAG_DROPPED : 0,
+                     &ring[head & (TELEMETRY_RING_SIZE - 1)]);
+    head += TELEMETRY_RECORD_SIZE;
+    drop_pending = false;
+}
+
+void telemetry_drain(uint64_t now_us) {
+    uint32_t pending = head - tail;
+
+    if (pending == 0)
+        return;
+    if (pending < TELEMETRY_CHUNK_SIZE && now_us - last_drain_us < TELEMETRY_MAX_DELAY_US)
+        return;
+
+    // only between records, and stamped as late as possible so the host
+    // sees it after little more than the transport delay
+    if (sync_len == 0 && tail % TELEMETRY_RECORD_SIZE == 0 && now_us - last_sync_us >= TELEMETRY_SYNC_PERIOD_US) {
+        last_sync_us = now_us;
+        telemetry_encode_sync(hal_time_us(), ring[(tail & (TELEMETRY_RING_SIZE - 1)) + 1], sync);
+        sync_len = TELEMETRY_RECORD_SIZE;
+    }
+    while (sync_len) {
+        int written = hal_stdio_write(&sync[TELEMETRY_RECORD_SIZE - sync_len], sync_len);
+        if (written <= 0) {
+            last_drain_us = now_us;
+            return;
+        }
+        sync_len -= written;
+    }
+
+    while (head != tail) {
+        uint32_t offset = tail & (TELEMETRY_RING_SIZE - 1);
+        uint32_t len = head - tail;
+        if (len > TELEMETRY_RING_SIZE - offset)
+            len = TELEMETRY_RING_SIZE - offset;
+
+        int written = hal_stdio_write(&ring[offset], len);
+        if (written <= 0)
+            break;
+        tail += written;
+    }
+    last_drain_us = now_us;
+}
+
+uint32_t telemetry_dropped(void) {
+    return dropped;
+}
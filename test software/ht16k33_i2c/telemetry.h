@@ -0,0 +1,81 @@
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Binary telemetry stream, an alternative to printing every sample.
+
+   Each sample becomes one fixed-size record, collected in a ring buffer and
+   written out over stdio in large chunks. host/telemetry_decode turns the
+   stream back into CSV. Records are little endian:
+
+     0      sync, TELEMETRY_SYNC
+     1      sequence number, increments per record
+     2..5   timestamp in us, low 32 bits
+     6..11  x, y, z as int16, Q12 g (4096 = 1 g at every range)
+     12..13 inputs, buttons 1-4 in bits 0-3, switches 1-8 in bits 4-11
+     14     flags, TELEMETRY_FLAG_*
+     15     CRC-8 (poly 0x07) over bytes 0..14
+
+   Once every TELEMETRY_SYNC_PERIOD_US the drain puts a time sync record
+   ahead of the next chunk, flagged TELEMETRY_FLAG_TIME_SYNC. It takes no
+   sequence number of its own and carries the full 64-bit board time taken
+   just before it is written, so a host can extend the 32-bit sample times
+   without guessing at wraps and line the board clock up with its own:
+
+     0      sync, TELEMETRY_SYNC
+     1      sequence number of the next sample record
+     2..9   board time in us, 64 bits
+     10..13 0
+     14     TELEMETRY_FLAG_TIME_SYNC
+     15     CRC-8 over bytes 0..14
+
+   The producer and the drain both run in the UI loop.
+*/
+
+#define TELEMETRY_SYNC 0xA5
+#define TELEMETRY_RECORD_SIZE 16
+
+// Records were lost to a full ring just before this one
+#define TELEMETRY_FLAG_DROPPED 0x01
+// Time sync record, not a sample
+#define TELEMETRY_FLAG_TIME_SYNC 0x02
+
+// Must be a power of two and a multiple of the record size
+#define TELEMETRY_RING_SIZE 4096
+// Written out once this much is buffered, or after TELEMETRY_MAX_DELAY_US
+#define TELEMETRY_CHUNK_SIZE 512
+#define TELEMETRY_MAX_DELAY_US (100 * 1000)
+#define TELEMETRY_SYNC_PERIOD_US (1000 * 1000)
+
+typedef struct {
+    uint64_t timestamp_us;
+    int16_t x;
+    int16_t y;
+    int16_t z;
+    uint16_t inputs;
+} telemetry_record_t;
+
+void telemetry_init(void);
+void telemetry_put(const telemetry_record_t *record);
+void telemetry_drain(uint64_t now_us);
+uint32_t telemetry_dropped(void);
+
+void telemetry_encode(const telemetry_record_t *record, uint8_t sequence, uint8_t flags,
+                      uint8_t out[TELEMETRY_RECORD_SIZE]);
+void telemetry_encode_sync(uint64_t now_us, uint8_t next_sequence, uint8_t out[TELEMETRY_RECORD_SIZE]);
+
+static inline uint8_t telemetry_crc8(const uint8_t *data, size_t len) {
+    uint8_t crc = 0;
+
+    for (size_t i = 0; i < len; i++) {
+        crc ^= data[i];
+        for (int bit = 0; bit < 8; bit++)
+            crc = (crc & 0x80) ? (uint8_t)((crc << 1) ^ 0x07) : (uint8_t)(crc << 1);
+    }
+    return crc;
+}
+
+#endif
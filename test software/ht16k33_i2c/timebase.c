@@ -0,0 +1,108 @@
+#include <string.h>
+#include "timebase.h"
+
+void timebase_init(timebase_t *tb, uint32_t nominal_period_us) {
+    memset(tb, 0, sizeof(*tb));
+    tb->nominal_ns = nominal_period_us * 1000;
+    tb->period_q8 = (int64_t)tb->nominal_ns << 8;
+}
+
+void timebase_restart(timebase_t *tb) {
+    tb->outliers = TIMEBASE_RELOCK;
+}
+
+static int64_t timebase_predict(const timebase_t *tb, uint64_t index) {
+    int64_t span = (int64_t)(index - tb->ref_index);
+    return tb->ref_ns + span * tb->period_q8 / 256;
+}
+
+// Take the edge of sample index at edge_ns into the grid
+static void timebase_update(timebase_t *tb, uint64_t index, int64_t edge_ns) {
+    int64_t period = tb->period_q8 >> 8;
+
+    if (tb->anchors == 0 || tb->outliers >= TIMEBASE_RELOCK) {
+        if (tb->anchors)
+            tb->relocks++;
+        else
+            tb->anchors = 1;
+        tb->ref_ns = edge_ns;
+        tb->ref_index = index;
+        tb->outliers = 0;
+        tb->edges++;
+        return;
+    }
+    int64_t span = (int64_t)(index - tb->ref_index);
+    if (span <= 0)
+        return;
+
+    int64_t predicted = timebase_predict(tb, index);
+    int64_t error = edge_ns - predicted;
+    if (error > period / 4 || error < -period / 4) {
+        tb->outliers++;
+        tb->rejected++;
+        return;
+    }
+    tb->outliers = 0;
+    tb->edges++;
+
+    if (tb->anchors == 1) {
+        tb->period_q8 = (edge_ns - tb->ref_ns) * 256 / span;
+        tb->ref_ns = edge_ns;
+        tb->anchors = 2;
+    } else {
+        tb->period_q8 += error * 256 / (span * TIMEBASE_PERIOD_GAIN);
+        tb->ref_ns = predicted + error / TIMEBASE_PHASE_GAIN;
+        uint32_t magnitude = (uint32_t)(error < 0 ? -error : error);
+        if (magnitude > tb->worst_error_ns)
+            tb->worst_error_ns = magnitude;
+    }
+    tb->ref_index = index;
+}
+
+void timebase_observe(timebase_t *tb, size_t index, uint64_t edge_us) {
+    timebase_update(tb, tb->next_index + index, (int64_t)edge_us * 1000);
+}
+
+void timebase_observe_newest(timebase_t *tb, uint64_t now_us, bool edge) {
+    int64_t now_ns = (int64_t)now_us * 1000;
+
+    // newest grid slot at or before now, with a quarter period for jitter
+    if (tb->anchors && tb->outliers < TIMEBASE_RELOCK) {
+        int64_t period = tb->period_q8 >> 8;
+        int64_t slots = (now_ns - tb->ref_ns + period / 4) / period;
+        uint64_t index = tb->ref_index + slots;
+        if (slots > 0 && index > tb->next_index) {
+            tb->lost += (uint32_t)(index - tb->next_index);
+            tb->next_index = index;
+        }
+    }
+    if (edge)
+        timebase_update(tb, tb->next_index, now_ns);
+}
+
+void timebase_stamp(timebase_t *tb, accel_sample_t *samples, size_t count, uint64_t newest_us) {
+    for (size_t i = 0; i < count; i++) {
+        uint64_t t;
+
+        if (tb->anchors)
+            t = (uint64_t)((timebase_predict(tb, tb->next_index + i) + 500) / 1000);
+        else
+            t = newest_us - (uint64_t)(count - 1 - i) * (tb->nominal_ns / 1000);
+        if (t <= tb->last_us)
+            t = tb->last_us + 1;
+        samples[i].timestamp_us = tb->last_us = t;
+    }
+    tb->next_index += count;
+}
+
+void timebase_report(timebase_t *tb, const char *name, FILE *out) {
+    int64_t nominal_q8 = (int64_t)tb->nominal_ns << 8;
+    int64_t ppm = nominal_q8 ? (tb->period_q8 - nominal_q8) * 1000000 / nominal_q8 : 0;
+
+    fprintf(out, "%s timebase: period %lu.%03luus (%+ldppm), %lu edges, worst error %luus, "
+            "%lu left out, %lu samples lost, %lu relocks\n", name,
+            (unsigned long)(tb->period_q8 / 256 / 1000), (unsigned long)(tb->period_q8 / 256 % 1000), (long)ppm,
+            (unsigned long)tb->edges, (unsigned long)(tb->worst_error_ns + 500) / 1000,
+            (unsigned long)tb->rejected, (unsigned long)tb->lost, (unsigned long)tb->relocks);
+    tb->worst_error_ns = 0;
+}
@@ -0,0 +1,86 @@
+#ifndef TIMEBASE_H
+#define TIMEBASE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "sample_ring.h"
+
+/* Sample times recovered from the sensor's output data rate.
+
+   The accelerometer runs from its own oscillator, a fraction of a percent
+   off nominal, and only some interrupt edges say when a sample completed:
+   every data-ready edge, or the watermark edge of a FIFO batch. A timebase
+   numbers every sample the driver reads and keeps the completion time of
+   sample n as
+
+     t(n) = t(ref) + (n - ref) * period
+
+   Each edge, stamped from the microsecond timer as the interrupt comes in,
+   is an observation of one sample. The first two set t(ref) and measure the
+   period. After that a second order loop moves t(ref) by 1/TIMEBASE_PHASE_GAIN
+   of the error and the period by 1/TIMEBASE_PERIOD_GAIN of the error per
+   sample spanned, so interrupt latency averages out and the period follows
+   the oscillator as it drifts. Every sample is stamped on that grid, evenly
+   spaced, including the ones read in a FIFO batch without an edge of their
+   own.
+
+   An edge more than a quarter period off the grid, such as one held up by a
+   flash erase, is left out. After TIMEBASE_RELOCK of those in a row, or
+   after samples were lost to an overflow, the grid starts again from the
+   next edge and keeps the period it had.
+
+   Times are kept in ns, the period with 8 more fraction bits.
+*/
+
+#ifndef TIMEBASE_PHASE_GAIN
+#define TIMEBASE_PHASE_GAIN 16
+#endif
+#ifndef TIMEBASE_PERIOD_GAIN
+#define TIMEBASE_PERIOD_GAIN 256
+#endif
+#ifndef TIMEBASE_RELOCK
+#define TIMEBASE_RELOCK 4
+#endif
+
+typedef struct {
+    uint32_t nominal_ns;
+    int64_t period_q8;          // ns << 8
+    int64_t ref_ns;
+    uint64_t ref_index;
+    uint64_t next_index;        // index of the next sample to stamp
+    uint64_t last_us;           // newest stamp handed out, they never go back
+    uint8_t anchors;            // edges taken so far, up to 2
+    uint8_t outliers;           // left out in a row
+
+    uint32_t edges;
+    uint32_t rejected;
+    uint32_t lost;
+    uint32_t relocks;
+    uint32_t worst_error_ns;    // largest error of an edge taken since the last report
+} timebase_t;
+
+void timebase_init(timebase_t *tb, uint32_t nominal_period_us);
+
+// Throw the grid away at the next edge, after samples were lost or the
+// sensor restarted its sample clock
+void timebase_restart(timebase_t *tb);
+
+// Sample index (from 0) of the next timebase_stamp() call completed at the
+// interrupt edge edge_us
+void timebase_observe(timebase_t *tb, size_t index, uint64_t edge_us);
+
+// The one sample of the next timebase_stamp() call is the newest complete at
+// now_us. Any the sensor overwrote before it are skipped and counted. The
+// loop only learns from it if now_us is its interrupt edge.
+void timebase_observe_newest(timebase_t *tb, uint64_t now_us, bool edge);
+
+// Stamp the next count samples, before the first edge counting back from
+// newest_us at the nominal period
+void timebase_stamp(timebase_t *tb, accel_sample_t *samples, size_t count, uint64_t newest_us);
+
+// Measured period, ppm from nominal, worst edge error and lost samples
+void timebase_report(timebase_t *tb, const char *name, FILE *out);
+
+#endif